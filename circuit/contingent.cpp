@@ -17,14 +17,54 @@ You should have received a copy of the GNU General Public License
 along with Miximus.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include <sstream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <new>
+#include <cstdlib>
 #include "import.hpp"
 #include "contingent.hpp"
+#include "contingent_prover.hpp"
+#include "contingent_verifier.hpp"
+#include "contingent_encoding.hpp"
+#include "contingent_parallel.hpp"
+#include "contingent_pkfile.hpp"
+#include "contingent_keygen.hpp"
+#include "contingent_native.hpp"
+#include "contingent_file.hpp"
+#include "contingent_stats.hpp"
 #include <boost/property_tree/json_parser.hpp>
 
 using std::stringstream;
 using ethsnarks::PropertyTreeT;
 using boost::property_tree::read_json;
 
+/**
+* Counts the bytes allocated for ethsnarks::allocated_bytes(), the other
+* forms of new and delete end up in these two
+*/
+void *operator new(size_t size)
+{
+    ethsnarks::allocated_bytes().fetch_add(size, std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+static bool has_suffix(const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size() && 0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
+}
+
 std::string proof_to_json(ProofT &proof) {
     std::stringstream ss;
 
@@ -39,9 +79,423 @@ std::string proof_to_json(ProofT &proof) {
     return(ss.str());
 }
 
-char *contingent_prove(
+/**
+* Curve parameters, with libff's profiling turned off: enter_block() and
+* leave_block() update global state without a lock and print to stdout,
+* which proofs running on several threads at once would race on
+*/
+static void init_library()
+{
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+}
+
+/**
+* Print why a call failed, and keep it for contingent_last_error()
+*/
+static void report_error(const std::string &error)
+{
+    std::cerr << error << std::endl;
+    ethsnarks::thread_call_stats().error = error;
+}
+
+/**
+* Whether newly opened provers check the witness against every constraint,
+* see contingent_set_full_check()
+*/
+static bool &default_full_check()
+{
+    static bool full_check = true;
+    return full_check;
+}
+
+/**
+* Whether newly opened provers use the lean mode, see
+* contingent_set_lean_proving()
+*/
+static bool &default_lean_proving()
+{
+    static bool lean_proving = false;
+    return lean_proving;
+}
+
+/**
+* Proving context, holds the proving key for a fixed number of blocks so it
+* only needs to be loaded from disk once for many proofs
+*/
+struct contingent_prover
+{
+    const size_t num_blocks;
+
+    // Only in the lean mode, the proving key then has no constraints
+    const std::unique_ptr<ethsnarks::compact_constraint_system> compact_cs;
+
+    const ProvingKeyT proving_key;
+    const std::shared_ptr<ethsnarks::contingent_circuit> circuit;
+
+    // Threads each proof may use, see contingent_prover_set_threads()
+    ethsnarks::thread_budget budget;
+
+    // Evaluate every constraint before proving, see contingent_prover_set_full_check()
+    bool full_check;
+
+    double key_load_ms = 0;
+
+    contingent_prover(const char *pk_file, const size_t in_num_blocks, const unsigned int in_circuit)
+        : num_blocks(in_num_blocks),
+          compact_cs(default_lean_proving() ? new ethsnarks::compact_constraint_system() : nullptr),
+          proving_key(ethsnarks::load_proving_key(pk_file, in_num_blocks, compact_cs.get())),
+          circuit(load_circuit(in_num_blocks, in_circuit, compact_cs.get())),
+          budget(ethsnarks::default_thread_budget()),
+          full_check(default_full_check())
+    {
+        if (proving_key.constraint_system.num_inputs() != circuit->num_inputs)
+            throw std::runtime_error("proving key is for a different circuit variant");
+    }
+
+    /**
+    * The circuit template, sized after the compact constraint system in the
+    * lean mode once it's known to be for the same variant
+    */
+    static std::shared_ptr<ethsnarks::contingent_circuit> load_circuit(
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const ethsnarks::compact_constraint_system *cs)
+    {
+        if (cs != nullptr && cs->num_inputs() != ethsnarks::contingent_num_inputs(num_blocks, circuit))
+            throw std::runtime_error("proving key is for a different circuit variant");
+        return ethsnarks::contingent_circuit::get(num_blocks, circuit, cs);
+    }
+};
+
+contingent_prover_t *contingent_prover_open(
     const char *pk_file,
+    const size_t num_blocks)
+{
+    return contingent_prover_open_ex(pk_file, num_blocks, CONTINGENT_CIRCUIT_DEFAULT);
+}
+
+contingent_prover_t *contingent_prover_open_ex(
+    const char *pk_file,
+    const size_t num_blocks,
+    const unsigned int circuit)
+{
+    init_library();
+
+    if (num_blocks < 1)
+    {
+        std::cerr << "Error: invalid number of blocks: " << num_blocks << std::endl;
+        return nullptr;
+    }
+
+    std::ifstream pk_input(pk_file);
+    if( ! pk_input ) {
+        std::cerr << "Error: cannot open " << pk_file << std::endl;
+        return nullptr;
+    }
+    pk_input.close();
+
+    ethsnarks::stats_call stats("prover_open");
+    try
+    {
+        const double start = ethsnarks::wall_time_ms();
+        contingent_prover_t *prover;
+        {
+            ethsnarks::stats_phase phase("key_load");
+            prover = new contingent_prover(pk_file, num_blocks, circuit);
+        }
+        prover->key_load_ms = ethsnarks::wall_time_ms() - start;
+        ethsnarks::thread_call_stats().key_load_ms = prover->key_load_ms;
+        return prover;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: cannot load " << pk_file << ": " << ex.what() << std::endl;
+        return nullptr;
+    }
+}
+
+static std::vector<FieldT> parse_field_elements(const char **in_values, const size_t count)
+{
+    std::vector<FieldT> values;
+    values.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        values.emplace_back(in_values[i]);
+    return values;
+}
+
+/**
+* Public inputs for the ciphertext: the blocks themselves, or their MiMC
+* Merkle root with CONTINGENT_CIRCUIT_CIPHERTEXT_HASH. The blocks after
+* those given are padding, which is zero.
+*/
+static std::vector<FieldT> ciphertext_to_inputs(
+    const unsigned int circuit,
     const size_t num_blocks,
+    std::vector<FieldT> ciphertext)
+{
+    ciphertext.resize(num_blocks, FieldT::zero());
+
+    if (circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH)
+        return {ethsnarks::mimc_merkle_root(ciphertext)};
+
+    return ciphertext;
+}
+
+/**
+* Plaintext made ready for many proofs by contingent_prover_prepare(), the
+* part of the witness and of the multi-exponentiations which only depends on
+* the file
+*/
+struct contingent_prepared
+{
+    const contingent_prover_t *prover;
+    size_t num_data_blocks;
+    FieldT plaintext_root;
+    std::vector<FieldT> plaintext; // zero-padded to the prover's blocks
+    std::vector<FieldT> merkle_witness;
+    ethsnarks::fixed_variables fixed;
+};
+
+/**
+* Field element arguments of a proof, parsed from either decimal strings or
+* 32 byte little-endian buffers. With `prepared` the plaintext and its root
+* are taken from it.
+*/
+struct prove_arguments
+{
+    std::vector<FieldT> ciphertext;
+    FieldT plaintext_root;
+    FieldT key;
+    std::vector<FieldT> plaintext;
+    const contingent_prepared *prepared = nullptr;
+};
+
+/**
+* Give a witness instance back to the prover's circuit template, or drop it
+* in the lean mode, which doesn't pool them
+*/
+static void release_instance(contingent_prover_t *prover, ethsnarks::contingent_circuit::InstancePtrT &inst)
+{
+    if (prover->compact_cs)
+        inst.reset();
+    else
+        prover->circuit->release(std::move(inst));
+}
+
+/**
+* Make one proof with a loaded prover, either `out_proof` or `out_error` is
+* filled in depending on the result. The FFTs and multi-exponentiations use
+* the threads of `budget`.
+*
+* The ciphertext and plaintext may hold fewer blocks than the prover only
+* with CONTINGENT_CIRCUIT_PADDED.
+*/
+static bool prover_prove_args(
+    contingent_prover_t *prover,
+    const char *in_key_hash,
+    prove_arguments &args,
+    const ethsnarks::thread_budget &budget,
+    ProofT &out_proof,
+    std::string &out_error)
+{
+    const size_t num_blocks = prover->num_blocks;
+    const size_t num_data_blocks = args.plaintext.size();
+    const unsigned int circuit = prover->circuit->circuit;
+
+    if (num_data_blocks > num_blocks || (num_data_blocks != num_blocks && !(circuit & CONTINGENT_CIRCUIT_PADDED)))
+    {
+        out_error = "Cannot prove " + std::to_string(num_data_blocks) + " blocks with a key for " + std::to_string(num_blocks);
+        return false;
+    }
+
+    auto &stats = ethsnarks::thread_call_stats();
+    stats.num_constraints = prover->circuit->num_constraints;
+    stats.num_variables = prover->circuit->num_variables;
+    stats.num_inputs = prover->circuit->num_inputs;
+    if (stats.key_load_ms == 0)
+        stats.key_load_ms = prover->key_load_ms;
+
+    args.plaintext.resize(num_blocks, FieldT::zero());
+
+    // Reject inconsistent arguments natively, saying which check failed,
+    // before any constraint is evaluated. The Merkle tree is only computed
+    // once, by the witness, alongside the key hash and encryption checks,
+    // and the plaintext root is read off it.
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("precheck"));
+    auto inst = prover->circuit->acquire();
+    std::vector<FieldT> merkle_witness;
+    std::thread merkle_thread;
+    if (args.prepared == nullptr)
+    {
+        auto merkle = [&]() { merkle_witness = inst->gadget.merkle_witness(args.plaintext); };
+        if (num_blocks < ethsnarks::contingent_gadget::PARALLEL_WITNESS_MIN_BLOCKS)
+            merkle();
+        else
+            merkle_thread = std::thread(merkle);
+    }
+    const bool ok = ethsnarks::precheck_contingent(circuit, (const uint8_t *)in_key_hash, args.ciphertext, args.plaintext_root, args.key, args.plaintext, budget.num_threads, out_error, false);
+    if (merkle_thread.joinable())
+        merkle_thread.join();
+    if (!ok)
+    {
+        release_instance(prover, inst);
+        return false;
+    }
+    if (args.prepared == nullptr && inst->pb.val(inst->gadget.m_merkle_root_gadget.result()) != args.plaintext_root)
+    {
+        release_instance(prover, inst);
+        out_error = "Plaintext root is not the Merkle root of the plaintext";
+        return false;
+    }
+
+    phase.reset(new ethsnarks::stats_phase("inputs"));
+
+    // convert the 32 bytes key hash into the public inputs of the variant
+    std::vector<FieldT> arg_key_hash;
+    if (!ethsnarks::key_hash_to_inputs(circuit, (const uint8_t *)in_key_hash, arg_key_hash))
+    {
+        release_instance(prover, inst);
+        out_error = "Invalid key hash";
+        return false;
+    }
+    std::vector<FieldT> arg_ciphertext = ciphertext_to_inputs(circuit, num_blocks, std::move(args.ciphertext));
+
+    // Fill in the witness on a protoboard laid out by the circuit template,
+    // the constraints themselves come from the proving key
+    phase.reset(new ethsnarks::stats_phase("witness"));
+    inst->gadget.generate_r1cs_witness(
+        arg_key_hash, arg_ciphertext, args.plaintext_root, args.key, args.plaintext, num_data_blocks,
+        args.prepared ? &args.prepared->merkle_witness : &merkle_witness);
+
+    const ethsnarks::fixed_variables *fixed = args.prepared ? &args.prepared->fixed : nullptr;
+    const ethsnarks::compact_constraint_system *compact_cs = prover->compact_cs.get();
+    if (compact_cs != nullptr)
+    {
+        // 1 || primary_input || auxiliary_input read off the protoboard, which
+        // isn't pooled so only one copy of the witness is held while proving
+        std::vector<FieldT> padded_assignment;
+        padded_assignment.reserve(compact_cs->num_variables() + 1);
+        padded_assignment.emplace_back(FieldT::one());
+        for (size_t i = 1; i <= compact_cs->num_variables(); i++)
+            padded_assignment.emplace_back(inst->pb.val(ethsnarks::VariableT(i)));
+        inst.reset();
+
+        ethsnarks::thread_budget_scope scope(budget);
+        if (prover->full_check)
+        {
+            phase.reset(new ethsnarks::stats_phase("check"));
+            if (!compact_cs->is_satisfied(padded_assignment, scope.num_threads()))
+            {
+                out_error = "Not Satisfied!";
+                return false;
+            }
+        }
+        phase.reset();
+
+        out_proof = ethsnarks::contingent_prover_run(
+            prover->proving_key, *prover->circuit->domain, std::move(padded_assignment), compact_cs, scope.num_threads(), fixed);
+        return true;
+    }
+
+    const auto primary_input = inst->pb.primary_input();
+    const auto auxiliary_input = inst->pb.auxiliary_input();
+    prover->circuit->release(std::move(inst));
+
+    if (prover->full_check)
+    {
+        phase.reset(new ethsnarks::stats_phase("check"));
+        if (!prover->proving_key.constraint_system.is_satisfied(primary_input, auxiliary_input))
+        {
+            out_error = "Not Satisfied!";
+            return false;
+        }
+    }
+    phase.reset();
+
+    ethsnarks::thread_budget_scope scope(budget);
+    out_proof = ethsnarks::contingent_prover_run(
+        prover->proving_key, *prover->circuit->domain, primary_input, auxiliary_input, scope.num_threads(), fixed);
+
+    return true;
+}
+
+/**
+* Same as prover_prove_args() with the field elements as decimal strings,
+* the ciphertext and plaintext hold `num_data_blocks`
+*/
+static bool prover_prove(
+    contingent_prover_t *prover,
+    const size_t num_data_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext,
+    const ethsnarks::thread_budget &budget,
+    ProofT &out_proof,
+    std::string &out_error)
+{
+    if (num_data_blocks > prover->num_blocks)
+    {
+        out_error = "Cannot prove " + std::to_string(num_data_blocks) + " blocks with a key for " + std::to_string(prover->num_blocks);
+        return false;
+    }
+
+    prove_arguments args;
+    {
+        ethsnarks::stats_phase phase("parse");
+        args.ciphertext = parse_field_elements(in_ciphertext, num_data_blocks);
+        args.plaintext_root = FieldT(in_plaintext_root);
+        args.key = FieldT(in_key);
+        args.plaintext = parse_field_elements(in_plaintext, num_data_blocks);
+    }
+
+    return prover_prove_args(prover, in_key_hash, args, budget, out_proof, out_error);
+}
+
+/**
+* Same as prover_prove_args() with the field elements as 32 byte
+* little-endian buffers, the ciphertext and plaintext hold `num_data_blocks`
+*/
+static bool prover_prove_raw(
+    contingent_prover_t *prover,
+    const size_t num_data_blocks,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root,
+    const uint8_t *in_key,
+    const uint8_t *in_plaintext,
+    const ethsnarks::thread_budget &budget,
+    ProofT &out_proof,
+    std::string &out_error)
+{
+    if (num_data_blocks > prover->num_blocks)
+    {
+        out_error = "Cannot prove " + std::to_string(num_data_blocks) + " blocks with a key for " + std::to_string(prover->num_blocks);
+        return false;
+    }
+
+    prove_arguments args;
+    {
+        ethsnarks::stats_phase phase("parse");
+        if (!ethsnarks::decode_field_elements_le(in_ciphertext, num_data_blocks, args.ciphertext, budget.num_threads)
+            || !ethsnarks::decode_field_le(in_plaintext_root, args.plaintext_root)
+            || !ethsnarks::decode_field_le(in_key, args.key)
+            || !ethsnarks::decode_field_elements_le(in_plaintext, num_data_blocks, args.plaintext, budget.num_threads))
+        {
+            out_error = "Field element out of range";
+            return false;
+        }
+    }
+
+    return prover_prove_args(prover, in_key_hash, args, budget, out_proof, out_error);
+}
+
+char *contingent_prover_prove_ex(
+    contingent_prover_t *prover,
+    const size_t num_threads,
     const char *in_key_hash,       // SHA256(key) 32 bytes char array of binary data
     const char **in_ciphertext,    // null-terminated array of null-terminated ascii decimal values
     const char *in_plaintext_root, // null-terminated ascii decimal value
@@ -49,120 +503,1377 @@ char *contingent_prove(
     const char **in_plaintext      // null-terminated array of null-terminated ascii decimal value
 )
 {
-    ppT::init_public_params();
+    ethsnarks::stats_call stats("prove");
+    ProofT proof;
+    std::string error;
 
-    // convert the 32 bytes key hash into 256 bits array
-    libff::bit_vector arg_key_hash = ethsnarks::bytes_to_bv((const uint8_t *)in_key_hash, 32);
-    std::vector<FieldT> arg_ciphertext;
-    arg_ciphertext.reserve(num_blocks);
-    for (size_t i = 0; i < num_blocks; i++)
-        arg_ciphertext.emplace_back(in_ciphertext[i]);
-    FieldT arg_plaintext_root(in_plaintext_root);
-
-    FieldT arg_key(in_key);
-    std::vector<FieldT> arg_plaintext;
-    arg_plaintext.reserve(num_blocks);
-    for (size_t i = 0; i < num_blocks; i++)
-        arg_plaintext.emplace_back(in_plaintext[i]);
-
-    // Create protoboard with gadget
-    ProtoboardT pb;
-    ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget");
-    gadget.generate_r1cs_constraints();
-    gadget.generate_r1cs_witness(
-        arg_key_hash, arg_ciphertext, arg_plaintext_root, arg_key, arg_plaintext);
+    ethsnarks::thread_budget budget = prover->budget;
+    if (num_threads != 0)
+        budget.num_threads = num_threads;
 
-    if (!pb.is_satisfied())
+    if (!prover_prove(prover, prover->num_blocks, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, budget, proof, error))
     {
-        std::cerr << "Not Satisfied!" << std::endl;
+        report_error(error);
         return nullptr;
     }
 
-    std::cerr << pb.num_constraints() << " constraints" << std::endl;
+    // Return proof as a JSON document, which must be destroyed by the caller
+    return ::strdup(proof_to_json(proof).c_str());
+}
+
+char *contingent_prover_prove(
+    contingent_prover_t *prover,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext)
+{
+    return contingent_prover_prove_ex(prover, 0, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext);
+}
+
+char *contingent_prover_prove_raw(
+    contingent_prover_t *prover,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root,
+    const uint8_t *in_key,
+    const uint8_t *in_plaintext)
+{
+    ethsnarks::stats_call stats("prove");
+    ProofT proof;
+    std::string error;
 
-    auto proving_key = ethsnarks::stub_load_pk_from_file(pk_file);
-    auto proof = libsnark::r1cs_gg_ppzksnark_zok_prover<ethsnarks::ppT>(proving_key, pb.primary_input(), pb.auxiliary_input());
-    const auto json = proof_to_json(proof);
+    if (!prover_prove_raw(prover, prover->num_blocks, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, prover->budget, proof, error))
+    {
+        report_error(error);
+        return nullptr;
+    }
 
-    // Return proof as a JSON document, which must be destroyed by the caller
-    return ::strdup(json.c_str());
+    return ::strdup(proof_to_json(proof).c_str());
 }
 
-int contingent_genkeys(const size_t num_blocks, const char *pk_file, const char *vk_file)
+contingent_prepared_t *contingent_prover_prepare(
+    contingent_prover_t *prover,
+    const size_t num_data_blocks,
+    const char **in_plaintext)
 {
-    ppT::init_public_params();
+    ethsnarks::stats_call stats("prepare");
+    const size_t num_blocks = prover->num_blocks;
+    if (num_data_blocks > num_blocks || (num_data_blocks != num_blocks && !(prover->circuit->circuit & CONTINGENT_CIRCUIT_PADDED)))
+    {
+        report_error("Cannot prepare " + std::to_string(num_data_blocks) + " blocks with a key for " + std::to_string(num_blocks));
+        return nullptr;
+    }
 
-    ProtoboardT pb;
-    ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget");
-    gadget.generate_r1cs_constraints();
+    std::unique_ptr<contingent_prepared_t> prepared(new contingent_prepared_t());
+    prepared->prover = prover;
+    prepared->num_data_blocks = num_data_blocks;
 
-    return ethsnarks::stub_genkeys_from_pb(pb, pk_file, vk_file);
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("parse"));
+    prepared->plaintext = parse_field_elements(in_plaintext, num_data_blocks);
+    prepared->plaintext.resize(num_blocks, FieldT::zero());
+
+    phase.reset(new ethsnarks::stats_phase("witness"));
+    auto inst = prover->circuit->acquire();
+    prepared->merkle_witness = inst->gadget.merkle_witness(prepared->plaintext);
+    prepared->plaintext_root = inst->pb.val(inst->gadget.m_merkle_root_gadget.result());
+    const size_t plaintext_begin = inst->gadget.m_in_plaintext[0].index;
+    const size_t merkle_begin = inst->gadget.m_merkle_vars_begin;
+    release_instance(prover, inst);
+
+    // The plaintext and Merkle tree terms of A, B and L, every later proof
+    // only goes over the key and ciphertext dependent variables
+    phase.reset(new ethsnarks::stats_phase("multiexp"));
+    ethsnarks::thread_budget_scope scope(prover->budget);
+    prepared->fixed.add(prover->proving_key, plaintext_begin, prepared->plaintext, scope.num_threads());
+    prepared->fixed.add(prover->proving_key, merkle_begin, prepared->merkle_witness, scope.num_threads());
+
+    return prepared.release();
 }
 
-/**
-* Parse the witness/proof from a property tree
-*   {"A": g1,
-*    "B": g2,
-*    "C": g1}
-*/
-ProofT proof_from_tree(PropertyTreeT &in_tree)
+char *contingent_prepared_plaintext_root(
+    const contingent_prepared_t *prepared)
 {
-    auto A = ethsnarks::create_G1_from_ptree(in_tree, "A");
-    auto B = ethsnarks::create_G2_from_ptree(in_tree, "B");
-    auto C = ethsnarks::create_G1_from_ptree(in_tree, "C");
+    return ::strdup(ethsnarks::field_to_decimal(prepared->plaintext_root).c_str());
+}
 
-    return ProofT(
-        std::move(A),
-        std::move(B),
-        std::move(C));
+char *contingent_prover_prove_prepared(
+    contingent_prover_t *prover,
+    const contingent_prepared_t *prepared,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_key)
+{
+    ethsnarks::stats_call stats("prove");
+    if (prepared->prover != prover)
+    {
+        report_error("Plaintext was prepared for another prover");
+        return nullptr;
+    }
+
+    prove_arguments args;
+    {
+        ethsnarks::stats_phase phase("parse");
+        args.ciphertext = parse_field_elements(in_ciphertext, prepared->num_data_blocks);
+        args.plaintext_root = prepared->plaintext_root;
+        args.key = FieldT(in_key);
+        args.plaintext.assign(prepared->plaintext.begin(), prepared->plaintext.begin() + prepared->num_data_blocks);
+        args.prepared = prepared;
+    }
+
+    ProofT proof;
+    std::string error;
+    if (!prover_prove_args(prover, in_key_hash, args, prover->budget, proof, error))
+    {
+        report_error(error);
+        return nullptr;
+    }
+
+    return ::strdup(proof_to_json(proof).c_str());
 }
 
-/**
-* Parse the proof from a stream of JSON encoded data
-*/
-ProofT proof_from_json(stringstream &in_json)
+void contingent_prepared_close(
+    contingent_prepared_t *prepared)
 {
-    PropertyTreeT root;
-    read_json(in_json, root);
-    return proof_from_tree(root);
+    delete prepared;
 }
 
-bool contingent_verify(
-    const char *vk_file,
-    const char *proof_json,
-    const size_t num_blocks,
+char *contingent_prover_prove_padded(
+    contingent_prover_t *prover,
+    const size_t num_data_blocks,
     const char *in_key_hash,
     const char **in_ciphertext,
-    const char *in_plaintext_root)
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext)
 {
-    ppT::init_public_params();
+    ethsnarks::stats_call stats("prove");
+    ProofT proof;
+    std::string error;
 
-    std::stringstream vk_stream;
-    std::ifstream vk_input(vk_file);
-    if( ! vk_input ) {
-        std::cerr << "Error: cannot open " << vk_file << std::endl;
-        return false;
+    if (!prover_prove(prover, num_data_blocks, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, prover->budget, proof, error))
+    {
+        report_error(error);
+        return nullptr;
     }
-    vk_stream << vk_input.rdbuf();
-    vk_input.close();
-    auto vk = ethsnarks::vk_from_json(vk_stream);
 
-    std::stringstream proof_stream;
-    proof_stream << proof_json;
-    auto proof = proof_from_json(proof_stream);
+    return ::strdup(proof_to_json(proof).c_str());
+}
 
-    PrimaryInputT primary_input;
-    primary_input.reserve(256 + num_blocks + 1);
+void contingent_prover_set_threads(
+    contingent_prover_t *prover,
+    const size_t num_threads,
+    const int first_core)
+{
+    prover->budget = ethsnarks::thread_budget(num_threads, first_core);
+}
+
+void contingent_prover_set_full_check(
+    contingent_prover_t *prover,
+    const bool full_check)
+{
+    prover->full_check = full_check;
+}
+
+void contingent_set_full_check(
+    const bool full_check)
+{
+    default_full_check() = full_check;
+}
+
+void contingent_set_lean_proving(
+    const bool lean)
+{
+    default_lean_proving() = lean;
+}
+
+void contingent_set_threads(
+    const size_t num_threads,
+    const int first_core)
+{
+    ethsnarks::default_thread_budget() = ethsnarks::thread_budget(num_threads, first_core);
+}
+
+size_t contingent_prover_prove_binary(
+    contingent_prover_t *prover,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext,
+    uint8_t *out_proof,
+    const size_t out_size)
+{
+    ethsnarks::stats_call stats("prove");
+    ProofT proof;
+    std::string error;
+
+    if (out_size < CONTINGENT_PROOF_BINARY_SIZE)
+    {
+        std::cerr << "Error: proof buffer too small" << std::endl;
+        return 0;
+    }
 
-    // convert the 32 bytes key hash into 256 bits array
-    libff::bit_vector key_hash_bits = ethsnarks::bytes_to_bv((const uint8_t *)in_key_hash, 32);
-    for (size_t i = 0; i < key_hash_bits.size(); ++i)
+    if (!prover_prove(prover, prover->num_blocks, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, prover->budget, proof, error))
     {
-        primary_input.emplace_back(key_hash_bits[i] ? FieldT::one() : FieldT::zero());
+        report_error(error);
+        return 0;
     }
-    for (size_t i = 0; i < num_blocks; i++)
-        primary_input.emplace_back(in_ciphertext[i]);
-    primary_input.emplace_back(in_plaintext_root);
 
-    return libsnark::r1cs_gg_ppzksnark_zok_verifier_strong_IC<ppT>(vk, primary_input, proof);
+    const auto encoded = ethsnarks::encode_proof(proof);
+    ::memcpy(out_proof, encoded.data(), encoded.size());
+    return encoded.size();
+}
+
+size_t contingent_prover_prove_batch(
+    contingent_prover_t *prover,
+    const contingent_prove_job_t *jobs,
+    const size_t num_jobs,
+    const size_t num_threads,
+    char **out_proofs,
+    char **out_errors)
+{
+    ethsnarks::stats_call stats("prove_batch");
+    const size_t num_workers = std::min(ethsnarks::resolve_num_threads(num_threads), num_jobs);
+
+    // Split the prover's threads between the workers, so the pool
+    // as a whole doesn't use more cores than a single proof would. Pinned
+    // workers get adjacent, non-overlapping sets of cores.
+    const size_t total_threads = prover->budget.num_threads ? prover->budget.num_threads : ethsnarks::prover_max_chunks();
+    const size_t worker_threads = std::max<size_t>(1, total_threads / std::max<size_t>(1, num_workers));
+
+    std::atomic<size_t> next_job(0);
+    std::atomic<size_t> num_failed(0);
+
+    auto worker = [&](const size_t worker_index) {
+        ethsnarks::thread_budget budget(worker_threads);
+        if (prover->budget.first_core >= 0)
+            budget.first_core = prover->budget.first_core + (int)(worker_index * worker_threads);
+
+        for (;;)
+        {
+            const size_t i = next_job++;
+            if (i >= num_jobs)
+                break;
+
+            const contingent_prove_job_t &job = jobs[i];
+            ProofT proof;
+            std::string error;
+            bool ok;
+            try
+            {
+                ok = prover_prove(
+                    prover, prover->num_blocks, job.key_hash, job.ciphertext, job.plaintext_root,
+                    job.key, job.plaintext, budget, proof, error);
+            }
+            catch (const std::exception &ex)
+            {
+                error = ex.what();
+                ok = false;
+            }
+
+            out_proofs[i] = ok ? ::strdup(proof_to_json(proof).c_str()) : nullptr;
+            out_errors[i] = ok ? nullptr : ::strdup(error.c_str());
+            if (!ok)
+                num_failed++;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_workers; i++)
+        workers.emplace_back(worker, i);
+    worker(0);
+    for (auto &t : workers)
+        t.join();
+
+    return num_failed;
+}
+
+size_t contingent_prover_prove_chunked(
+    contingent_prover_t *prover,
+    const size_t num_chunks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_key,
+    const char **in_plaintext,
+    const size_t num_threads,
+    char **out_proofs,
+    char **out_sub_roots,
+    char **out_errors)
+{
+    const size_t chunk_blocks = prover->num_blocks;
+
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        out_proofs[i] = nullptr;
+        out_sub_roots[i] = nullptr;
+        out_errors[i] = nullptr;
+    }
+
+    if (!ethsnarks::is_power_of_two(num_chunks) || !ethsnarks::is_power_of_two(chunk_blocks))
+    {
+        for (size_t i = 0; i < num_chunks; i++)
+            out_errors[i] = ::strdup("Number of chunks and blocks per chunk must be powers of two");
+        return num_chunks;
+    }
+
+    // The sub-root of every segment is a public input of its proof
+    std::vector<std::string> sub_roots(num_chunks);
+    ethsnarks::parallel_for(0, num_chunks, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            std::vector<FieldT> leaves;
+            leaves.reserve(chunk_blocks);
+            for (size_t j = 0; j < chunk_blocks; j++)
+                leaves.emplace_back(in_plaintext[(i * chunk_blocks) + j]);
+            sub_roots[i] = ethsnarks::field_to_decimal(ethsnarks::mimc_merkle_root(leaves));
+        }
+    });
+
+    std::vector<contingent_prove_job_t> jobs(num_chunks);
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        jobs[i].key_hash = in_key_hash;
+        jobs[i].ciphertext = in_ciphertext + (i * chunk_blocks);
+        jobs[i].plaintext_root = sub_roots[i].c_str();
+        jobs[i].key = in_key;
+        jobs[i].plaintext = in_plaintext + (i * chunk_blocks);
+    }
+
+    const size_t num_failed = contingent_prover_prove_batch(
+        prover, jobs.data(), num_chunks, num_threads, out_proofs, out_errors);
+
+    for (size_t i = 0; i < num_chunks; i++)
+        out_sub_roots[i] = ::strdup(sub_roots[i].c_str());
+
+    return num_failed;
+}
+
+void contingent_prover_close(contingent_prover_t *prover)
+{
+    delete prover;
+}
+
+char *contingent_prove(
+    const char *pk_file,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext)
+{
+    return contingent_prove_ex(
+        pk_file, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext);
+}
+
+char *contingent_prove_ex(
+    const char *pk_file,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext)
+{
+    ethsnarks::stats_call stats("prove");
+    contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, circuit);
+    if (prover == nullptr)
+        return nullptr;
+
+    char *json = contingent_prover_prove(
+        prover, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext);
+
+    contingent_prover_close(prover);
+
+    return json;
+}
+
+size_t contingent_prove_binary(
+    const char *pk_file,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext,
+    uint8_t *out_proof,
+    const size_t out_size)
+{
+    return contingent_prove_binary_ex(
+        pk_file, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext,
+        out_proof, out_size);
+}
+
+size_t contingent_prove_binary_ex(
+    const char *pk_file,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root,
+    const char *in_key,
+    const char **in_plaintext,
+    uint8_t *out_proof,
+    const size_t out_size)
+{
+    ethsnarks::stats_call stats("prove");
+    contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, circuit);
+    if (prover == nullptr)
+        return 0;
+
+    const size_t result = contingent_prover_prove_binary(
+        prover, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, out_proof, out_size);
+
+    contingent_prover_close(prover);
+
+    return result;
+}
+
+char *contingent_prove_raw(
+    const char *pk_file,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root,
+    const uint8_t *in_key,
+    const uint8_t *in_plaintext)
+{
+    return contingent_prove_raw_ex(
+        pk_file, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext);
+}
+
+char *contingent_prove_raw_ex(
+    const char *pk_file,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root,
+    const uint8_t *in_key,
+    const uint8_t *in_plaintext)
+{
+    ethsnarks::stats_call stats("prove");
+    contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, circuit);
+    if (prover == nullptr)
+        return nullptr;
+
+    char *json = contingent_prover_prove_raw(
+        prover, in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext);
+
+    contingent_prover_close(prover);
+
+    return json;
+}
+
+size_t contingent_prove_batch(
+    const char *pk_file,
+    const size_t num_blocks,
+    const contingent_prove_job_t *jobs,
+    const size_t num_jobs,
+    const size_t num_threads,
+    char **out_proofs,
+    char **out_errors)
+{
+    contingent_prover_t *prover = contingent_prover_open(pk_file, num_blocks);
+    if (prover == nullptr)
+    {
+        for (size_t i = 0; i < num_jobs; i++)
+        {
+            out_proofs[i] = nullptr;
+            out_errors[i] = ::strdup("Cannot load proving key");
+        }
+        return num_jobs;
+    }
+
+    const size_t num_failed = contingent_prover_prove_batch(
+        prover, jobs, num_jobs, num_threads, out_proofs, out_errors);
+
+    contingent_prover_close(prover);
+
+    return num_failed;
+}
+
+void contingent_free(char *ptr)
+{
+    ::free(ptr);
+}
+
+char *contingent_last_stats(void)
+{
+    const auto &stats = ethsnarks::thread_call_stats();
+    if (stats.call.empty())
+        return nullptr;
+    return ::strdup(stats.to_json().c_str());
+}
+
+char *contingent_last_error(void)
+{
+    const auto &stats = ethsnarks::thread_call_stats();
+    if (stats.error.empty())
+        return nullptr;
+    return ::strdup(stats.error.c_str());
+}
+
+int contingent_decrypt_file(
+    const char *ciphertext_file,
+    const char *out_file,
+    const size_t num_blocks,
+    const uint64_t size,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const char *in_key,
+    const char *in_plaintext_root,
+    const size_t num_threads)
+{
+    init_library();
+
+    if (num_blocks < 1 || size > num_blocks * ethsnarks::FILE_BLOCK_BYTES)
+    {
+        std::cerr << "Error: " << size << " bytes don't fit in " << num_blocks << " blocks" << std::endl;
+        return CONTINGENT_DECRYPT_IO_ERROR;
+    }
+
+    const FieldT key(in_key);
+    const auto key_hash = ethsnarks::contingent_key_hash(key, circuit);
+    if (::memcmp(key_hash.data(), in_key_hash, key_hash.size()) != 0)
+        return CONTINGENT_DECRYPT_BAD_KEY;
+
+    FieldT plaintext_root;
+    if (!ethsnarks::decrypt_file(ciphertext_file, out_file, key, num_blocks, size, num_threads, plaintext_root))
+        return CONTINGENT_DECRYPT_IO_ERROR;
+
+    if (plaintext_root != FieldT(in_plaintext_root))
+    {
+        ::remove(out_file);
+        return CONTINGENT_DECRYPT_BAD_ROOT;
+    }
+
+    return CONTINGENT_DECRYPT_OK;
+}
+
+int contingent_genkeys(const size_t num_blocks, const char *pk_file, const char *vk_file)
+{
+    return contingent_genkeys_ex(num_blocks, CONTINGENT_CIRCUIT_DEFAULT, pk_file, vk_file);
+}
+
+int contingent_genkeys_ex(const size_t num_blocks, const unsigned int circuit, const char *pk_file, const char *vk_file)
+{
+    // The sectioned layout is written section by section as it's generated
+    if (has_suffix(pk_file, ".map"))
+        return contingent_genkeys_mapped(num_blocks, circuit, pk_file, vk_file, 0, nullptr, nullptr);
+
+    init_library();
+
+    ethsnarks::thread_budget_scope scope(ethsnarks::default_thread_budget());
+    ethsnarks::stats_call stats("genkeys");
+
+    ProtoboardT pb;
+    ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget", circuit);
+    {
+        ethsnarks::stats_phase phase("constraints");
+        gadget.generate_r1cs_constraints();
+    }
+
+    auto &call_stats = ethsnarks::thread_call_stats();
+    call_stats.num_constraints = pb.num_constraints();
+    call_stats.num_variables = pb.num_variables();
+    call_stats.num_inputs = pb.num_inputs();
+
+    ethsnarks::stats_phase phase("keygen");
+    return ethsnarks::stub_genkeys_from_pb(pb, pk_file, vk_file);
+}
+
+int contingent_genkeys_mapped(
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *pk_file,
+    const char *vk_file,
+    const size_t num_threads,
+    contingent_progress_fn progress,
+    void *progress_arg)
+{
+    init_library();
+
+    ethsnarks::thread_budget budget = ethsnarks::default_thread_budget();
+    if (num_threads != 0)
+        budget.num_threads = num_threads;
+    ethsnarks::thread_budget_scope scope(budget);
+    ethsnarks::stats_call stats("genkeys");
+
+    // Only the constraint system is kept, the protoboard goes out of scope
+    ethsnarks::ConstraintSystemT cs;
+    {
+        ethsnarks::stats_phase phase("constraints");
+        ProtoboardT pb;
+        ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget", circuit);
+        gadget.generate_r1cs_constraints();
+        cs = pb.get_constraint_system();
+    }
+
+    auto &call_stats = ethsnarks::thread_call_stats();
+    call_stats.num_constraints = cs.num_constraints();
+    call_stats.num_variables = cs.num_variables();
+    call_stats.num_inputs = cs.num_inputs();
+
+    ethsnarks::keygen_progress_fn progress_fn;
+    if (progress != nullptr)
+    {
+        progress_fn = [progress, progress_arg](const char *stage, uint64_t done, uint64_t total) {
+            progress(stage, done, total, progress_arg);
+        };
+    }
+
+    ethsnarks::VerificationKeyT vk;
+    try
+    {
+        if (!ethsnarks::generate_mapped_keys(std::move(cs), num_blocks, pk_file, vk, scope.num_threads(), progress_fn))
+        {
+            std::cerr << "Error: cannot write " << pk_file << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: cannot write " << pk_file << ": " << ex.what() << std::endl;
+        return 1;
+    }
+
+    ethsnarks::vk2json_file(vk, vk_file);
+    return 0;
+}
+
+/**
+* Parse the witness/proof from a property tree
+*   {"A": g1,
+*    "B": g2,
+*    "C": g1}
+*/
+ProofT proof_from_tree(PropertyTreeT &in_tree)
+{
+    auto A = ethsnarks::fix_json_infinity(ethsnarks::create_G1_from_ptree(in_tree, "A"));
+    auto B = ethsnarks::fix_json_infinity(ethsnarks::create_G2_from_ptree(in_tree, "B"));
+    auto C = ethsnarks::fix_json_infinity(ethsnarks::create_G1_from_ptree(in_tree, "C"));
+
+    return ProofT(
+        std::move(A),
+        std::move(B),
+        std::move(C));
+}
+
+/**
+* Parse the proof from a stream of JSON encoded data
+*/
+ProofT proof_from_json(stringstream &in_json)
+{
+    PropertyTreeT root;
+    read_json(in_json, root);
+    return proof_from_tree(root);
+}
+
+/**
+* Load a verification key from a file, either JSON or the binary encoding
+*/
+static bool load_vk_file(const char *vk_file, ethsnarks::VerificationKeyT &out_vk)
+{
+    std::stringstream vk_stream;
+    std::ifstream vk_input(vk_file, std::ios::binary);
+    if( ! vk_input ) {
+        std::cerr << "Error: cannot open " << vk_file << std::endl;
+        return false;
+    }
+    vk_stream << vk_input.rdbuf();
+    vk_input.close();
+
+    const std::string vk_data = vk_stream.str();
+    const uint8_t *vk_bytes = (const uint8_t *)vk_data.data();
+    if (ethsnarks::is_binary_encoding(vk_bytes, vk_data.size(), ethsnarks::BINARY_KIND_VK))
+    {
+        if (!ethsnarks::decode_vk(vk_bytes, vk_data.size(), out_vk))
+        {
+            std::cerr << "Error: invalid binary verification key " << vk_file << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    out_vk = ethsnarks::vk_from_json(vk_stream);
+    return true;
+}
+
+/**
+* Public inputs of the circuit, in the order of contingent_gadget:
+* key_hash, ciphertext blocks or their root, plaintext root, and the number
+* of data blocks with CONTINGENT_CIRCUIT_PADDED
+*
+* A key hash which isn't valid for the variant gives an empty input, which
+* never verifies.
+*/
+static PrimaryInputT make_primary_input(
+    const unsigned int circuit,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    std::vector<FieldT> in_ciphertext,
+    const FieldT &in_plaintext_root)
+{
+    PrimaryInputT primary_input;
+    if (!ethsnarks::key_hash_to_inputs(circuit, (const uint8_t *)in_key_hash, primary_input))
+    {
+        primary_input.clear();
+        return primary_input;
+    }
+
+    const size_t num_data_blocks = in_ciphertext.size();
+    const auto ciphertext = ciphertext_to_inputs(circuit, num_blocks, std::move(in_ciphertext));
+    primary_input.insert(primary_input.end(), ciphertext.begin(), ciphertext.end());
+    primary_input.push_back(in_plaintext_root);
+    if (circuit & CONTINGENT_CIRCUIT_PADDED)
+        primary_input.emplace_back(num_data_blocks);
+
+    return primary_input;
+}
+
+static PrimaryInputT make_primary_input(
+    const unsigned int circuit,
+    const size_t num_blocks,
+    const size_t num_data_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    return make_primary_input(circuit, num_blocks, in_key_hash, parse_field_elements(in_ciphertext, num_data_blocks), FieldT(in_plaintext_root));
+}
+
+/**
+* Verification context, holds the parsed and pre-processed verification key
+*/
+struct contingent_verifier
+{
+    const unsigned int circuit;
+    const size_t num_blocks;
+    const ethsnarks::prepared_verification_key key;
+
+    double key_load_ms = 0;
+
+    contingent_verifier(const ethsnarks::VerificationKeyT &in_vk, const size_t in_num_blocks, const unsigned int in_circuit)
+        : circuit(in_circuit),
+          num_blocks(in_num_blocks),
+          key(in_vk)
+    {
+    }
+};
+
+contingent_verifier_t *contingent_verifier_open(
+    const char *vk_file)
+{
+    return contingent_verifier_open_ex(vk_file, 0, CONTINGENT_CIRCUIT_DEFAULT);
+}
+
+contingent_verifier_t *contingent_verifier_open_ex(
+    const char *vk_file,
+    const size_t num_blocks,
+    const unsigned int circuit)
+{
+    init_library();
+
+    ethsnarks::stats_call stats("verifier_open");
+    const double start = ethsnarks::wall_time_ms();
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("key_load"));
+
+    ethsnarks::VerificationKeyT vk;
+    if (!load_vk_file(vk_file, vk))
+        return nullptr;
+
+    const size_t vk_num_inputs = vk.gamma_ABC_g1.domain_size();
+    size_t vk_num_blocks = num_blocks;
+    if (!(circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH))
+    {
+        // key_hash + at least one ciphertext block + plaintext root
+        if (vk_num_inputs < ethsnarks::contingent_num_inputs(1, circuit))
+        {
+            std::cerr << "Error: " << vk_file << " is not a contingent verification key" << std::endl;
+            return nullptr;
+        }
+        vk_num_blocks = vk_num_inputs - ethsnarks::key_hash_num_inputs(circuit) - 1 - ethsnarks::length_num_inputs(circuit);
+    }
+    else if (num_blocks == 0)
+    {
+        std::cerr << "Error: the number of blocks must be given for a ciphertext hash circuit" << std::endl;
+        return nullptr;
+    }
+
+    if (vk_num_inputs != ethsnarks::contingent_num_inputs(vk_num_blocks, circuit))
+    {
+        std::cerr << "Error: " << vk_file << " is not a verification key for this circuit variant" << std::endl;
+        return nullptr;
+    }
+
+    if (num_blocks != 0 && num_blocks != vk_num_blocks)
+    {
+        std::cerr << "Error: " << vk_file << " is for " << vk_num_blocks << " blocks, not " << num_blocks << std::endl;
+        return nullptr;
+    }
+
+    phase.reset(new ethsnarks::stats_phase("key_prepare"));
+    contingent_verifier_t *verifier = new contingent_verifier(vk, vk_num_blocks, circuit);
+    phase.reset();
+
+    verifier->key_load_ms = ethsnarks::wall_time_ms() - start;
+    ethsnarks::thread_call_stats().key_load_ms = verifier->key_load_ms;
+    return verifier;
+}
+
+/**
+* Sizes and key load time of a verifier, for the stats of a verify call
+*/
+static void record_verifier_stats(const contingent_verifier_t *verifier)
+{
+    auto &stats = ethsnarks::thread_call_stats();
+    stats.num_inputs = ethsnarks::contingent_num_inputs(verifier->num_blocks, verifier->circuit);
+    if (stats.key_load_ms == 0)
+        stats.key_load_ms = verifier->key_load_ms;
+}
+
+size_t contingent_verifier_num_blocks(
+    const contingent_verifier_t *verifier)
+{
+    return verifier->num_blocks;
+}
+
+bool contingent_verifier_verify(
+    const contingent_verifier_t *verifier,
+    const char *proof_json,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    record_verifier_stats(verifier);
+
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("parse"));
+    std::stringstream proof_stream;
+    proof_stream << proof_json;
+    auto proof = proof_from_json(proof_stream);
+
+    phase.reset(new ethsnarks::stats_phase("inputs"));
+    const auto primary_input = make_primary_input(verifier->circuit, verifier->num_blocks, verifier->num_blocks, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    phase.reset(new ethsnarks::stats_phase("pairing"));
+    return verifier->key.verify(proof, primary_input);
+}
+
+bool contingent_verifier_verify_raw(
+    const contingent_verifier_t *verifier,
+    const char *proof_json,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    record_verifier_stats(verifier);
+
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("parse"));
+    std::stringstream proof_stream;
+    proof_stream << proof_json;
+    auto proof = proof_from_json(proof_stream);
+
+    std::vector<FieldT> ciphertext;
+    FieldT plaintext_root;
+    if (!ethsnarks::decode_field_elements_le(in_ciphertext, verifier->num_blocks, ciphertext)
+        || !ethsnarks::decode_field_le(in_plaintext_root, plaintext_root))
+    {
+        std::cerr << "Error: field element out of range" << std::endl;
+        return false;
+    }
+
+    phase.reset(new ethsnarks::stats_phase("inputs"));
+    const auto primary_input = make_primary_input(verifier->circuit, verifier->num_blocks, in_key_hash, std::move(ciphertext), plaintext_root);
+
+    phase.reset(new ethsnarks::stats_phase("pairing"));
+    return verifier->key.verify(proof, primary_input);
+}
+
+bool contingent_verifier_verify_padded(
+    const contingent_verifier_t *verifier,
+    const size_t num_data_blocks,
+    const char *proof_json,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    record_verifier_stats(verifier);
+
+    if (!(verifier->circuit & CONTINGENT_CIRCUIT_PADDED) || num_data_blocks > verifier->num_blocks)
+    {
+        std::cerr << "Error: cannot verify " << num_data_blocks << " blocks with a key for " << verifier->num_blocks << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("parse"));
+    std::stringstream proof_stream;
+    proof_stream << proof_json;
+    auto proof = proof_from_json(proof_stream);
+
+    phase.reset(new ethsnarks::stats_phase("inputs"));
+    const auto primary_input = make_primary_input(verifier->circuit, verifier->num_blocks, num_data_blocks, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    phase.reset(new ethsnarks::stats_phase("pairing"));
+    return verifier->key.verify(proof, primary_input);
+}
+
+bool contingent_verifier_verify_binary(
+    const contingent_verifier_t *verifier,
+    const uint8_t *proof_data,
+    const size_t proof_size,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    record_verifier_stats(verifier);
+
+    std::unique_ptr<ethsnarks::stats_phase> phase(new ethsnarks::stats_phase("parse"));
+    ProofT proof;
+    if (!ethsnarks::decode_proof(proof_data, proof_size, proof))
+    {
+        std::cerr << "Error: invalid binary proof" << std::endl;
+        return false;
+    }
+
+    phase.reset(new ethsnarks::stats_phase("inputs"));
+    const auto primary_input = make_primary_input(verifier->circuit, verifier->num_blocks, verifier->num_blocks, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    phase.reset(new ethsnarks::stats_phase("pairing"));
+    return verifier->key.verify(proof, primary_input);
+}
+
+size_t contingent_verifier_verify_batch(
+    const contingent_verifier_t *verifier,
+    const contingent_verify_job_t *jobs,
+    const size_t num_jobs,
+    bool *out_results)
+{
+    for (size_t i = 0; i < num_jobs; i++)
+        out_results[i] = false;
+
+    // Proofs which can't even be parsed are failed straight away
+    std::vector<size_t> indices;
+    std::vector<ProofT> proofs;
+    std::vector<PrimaryInputT> primary_inputs;
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        const contingent_verify_job_t &job = jobs[i];
+        try
+        {
+            std::stringstream proof_stream;
+            proof_stream << job.proof_json;
+            proofs.emplace_back(proof_from_json(proof_stream));
+        }
+        catch (const std::exception &ex)
+        {
+            std::cerr << "Error: cannot parse proof " << i << ": " << ex.what() << std::endl;
+            continue;
+        }
+        primary_inputs.emplace_back(make_primary_input(verifier->circuit, verifier->num_blocks, verifier->num_blocks, job.key_hash, job.ciphertext, job.plaintext_root));
+        indices.emplace_back(i);
+    }
+
+    if (ethsnarks::batch_verify(verifier->key, proofs, primary_inputs))
+    {
+        for (const size_t i : indices)
+            out_results[i] = true;
+    }
+    else
+    {
+        // At least one is bad, check them one by one to find out which
+        for (size_t j = 0; j < indices.size(); j++)
+        {
+            out_results[indices[j]] = verifier->key.verify(proofs[j], primary_inputs[j]);
+        }
+    }
+
+    size_t num_failed = 0;
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        if (!out_results[i])
+            num_failed++;
+    }
+
+    return num_failed;
+}
+
+bool contingent_verifier_verify_chunked(
+    const contingent_verifier_t *verifier,
+    const size_t num_chunks,
+    const char **proof_jsons,
+    const char **sub_roots,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    const size_t chunk_blocks = verifier->num_blocks;
+
+    if (!ethsnarks::is_power_of_two(num_chunks) || !ethsnarks::is_power_of_two(chunk_blocks))
+    {
+        std::cerr << "Error: number of chunks and blocks per chunk must be powers of two" << std::endl;
+        return false;
+    }
+
+    // Top level of the tree, the sub-roots are public so this is done natively
+    std::vector<FieldT> sub_root_values;
+    sub_root_values.reserve(num_chunks);
+    for (size_t i = 0; i < num_chunks; i++)
+        sub_root_values.emplace_back(sub_roots[i]);
+
+    if (ethsnarks::mimc_merkle_root(sub_root_values) != FieldT(in_plaintext_root))
+    {
+        std::cerr << "Error: sub-roots don't match the plaintext root" << std::endl;
+        return false;
+    }
+
+    std::vector<ProofT> proofs;
+    std::vector<PrimaryInputT> primary_inputs;
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        try
+        {
+            std::stringstream proof_stream;
+            proof_stream << proof_jsons[i];
+            proofs.emplace_back(proof_from_json(proof_stream));
+        }
+        catch (const std::exception &ex)
+        {
+            std::cerr << "Error: cannot parse proof " << i << ": " << ex.what() << std::endl;
+            return false;
+        }
+        primary_inputs.emplace_back(make_primary_input(
+            verifier->circuit, chunk_blocks, chunk_blocks, in_key_hash, in_ciphertext + (i * chunk_blocks), sub_roots[i]));
+    }
+
+    return ethsnarks::batch_verify(verifier->key, proofs, primary_inputs);
+}
+
+void contingent_verifier_close(contingent_verifier_t *verifier)
+{
+    delete verifier;
+}
+
+/**
+* Open a verifier for a single call, checking that the key matches the
+* expected number of blocks
+*/
+static contingent_verifier_t *open_verifier_for(const char *vk_file, const size_t num_blocks, const unsigned int circuit)
+{
+    return contingent_verifier_open_ex(vk_file, num_blocks, circuit);
+}
+
+bool contingent_verify(
+    const char *vk_file,
+    const char *proof_json,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    return contingent_verify_ex(
+        vk_file, proof_json, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root);
+}
+
+bool contingent_verify_ex(
+    const char *vk_file,
+    const char *proof_json,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, circuit);
+    if (verifier == nullptr)
+        return false;
+
+    const bool result = contingent_verifier_verify(
+        verifier, proof_json, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    contingent_verifier_close(verifier);
+
+    return result;
+}
+
+bool contingent_verify_binary(
+    const char *vk_file,
+    const uint8_t *proof_data,
+    const size_t proof_size,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    return contingent_verify_binary_ex(
+        vk_file, proof_data, proof_size, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root);
+}
+
+bool contingent_verify_binary_ex(
+    const char *vk_file,
+    const uint8_t *proof_data,
+    const size_t proof_size,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const char **in_ciphertext,
+    const char *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, circuit);
+    if (verifier == nullptr)
+        return false;
+
+    const bool result = contingent_verifier_verify_binary(
+        verifier, proof_data, proof_size, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    contingent_verifier_close(verifier);
+
+    return result;
+}
+
+bool contingent_verify_raw(
+    const char *vk_file,
+    const char *proof_json,
+    const size_t num_blocks,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root)
+{
+    return contingent_verify_raw_ex(
+        vk_file, proof_json, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, in_key_hash, in_ciphertext, in_plaintext_root);
+}
+
+bool contingent_verify_raw_ex(
+    const char *vk_file,
+    const char *proof_json,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const char *in_key_hash,
+    const uint8_t *in_ciphertext,
+    const uint8_t *in_plaintext_root)
+{
+    ethsnarks::stats_call stats("verify");
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, circuit);
+    if (verifier == nullptr)
+        return false;
+
+    const bool result = contingent_verifier_verify_raw(
+        verifier, proof_json, in_key_hash, in_ciphertext, in_plaintext_root);
+
+    contingent_verifier_close(verifier);
+
+    return result;
+}
+
+size_t contingent_verify_batch(
+    const char *vk_file,
+    const size_t num_blocks,
+    const contingent_verify_job_t *jobs,
+    const size_t num_jobs,
+    bool *out_results)
+{
+    return contingent_verify_batch_ex(
+        vk_file, num_blocks, CONTINGENT_CIRCUIT_DEFAULT, jobs, num_jobs, out_results);
+}
+
+size_t contingent_verify_batch_ex(
+    const char *vk_file,
+    const size_t num_blocks,
+    const unsigned int circuit,
+    const contingent_verify_job_t *jobs,
+    const size_t num_jobs,
+    bool *out_results)
+{
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, circuit);
+    if (verifier == nullptr)
+    {
+        for (size_t i = 0; i < num_jobs; i++)
+            out_results[i] = false;
+        return num_jobs;
+    }
+
+    const size_t num_failed = contingent_verifier_verify_batch(
+        verifier, jobs, num_jobs, out_results);
+
+    contingent_verifier_close(verifier);
+
+    return num_failed;
+}
+
+size_t contingent_size_class(const size_t num_blocks)
+{
+    return ethsnarks::size_class_of(num_blocks);
+}
+
+/**
+* Keys of one size class, loaded or generated on first use
+*/
+struct contingent_registry_entry
+{
+    std::mutex mutex;
+    contingent_prover_t *prover = nullptr;
+    contingent_verifier_t *verifier = nullptr;
+};
+
+/**
+* Key pairs for the power-of-two size classes of a padded circuit variant,
+* kept in a directory as contingent.<class>.<circuit>.pk.map and .vk.json
+*/
+struct contingent_registry
+{
+    const std::string keys_dir;
+    const unsigned int circuit;
+
+    std::mutex mutex;
+    std::map<size_t, std::unique_ptr<contingent_registry_entry>> entries;
+
+    contingent_registry(const char *in_keys_dir, const unsigned int in_circuit)
+        : keys_dir(in_keys_dir), circuit(in_circuit | CONTINGENT_CIRCUIT_PADDED)
+    {
+    }
+
+    ~contingent_registry()
+    {
+        for (auto &it : entries)
+        {
+            contingent_prover_close(it.second->prover);
+            contingent_verifier_close(it.second->verifier);
+        }
+    }
+
+    std::string key_file(const size_t size_class, const char *suffix) const
+    {
+        return keys_dir + "/contingent." + std::to_string(size_class) + "." + std::to_string(circuit) + suffix;
+    }
+
+    /**
+    * Generate the keys of the class holding `num_data_blocks` unless both
+    * are in the directory already. They are written under temporary names
+    * and renamed into place, so an interrupted run leaves no partial keys,
+    * and an incomplete pair is never overwritten.
+    */
+    bool genkeys(const size_t num_data_blocks)
+    {
+        const size_t size_class = ethsnarks::size_class_of(num_data_blocks);
+        const std::string pk_file = key_file(size_class, ".pk.map");
+        const std::string vk_file = key_file(size_class, ".vk.json");
+
+        // Held while generating, so a class isn't generated twice at once
+        contingent_registry_entry *entry = get_entry(size_class);
+        std::lock_guard<std::mutex> lock(entry->mutex);
+
+        const bool have_pk = (bool)std::ifstream(pk_file);
+        const bool have_vk = (bool)std::ifstream(vk_file);
+        if (have_pk && have_vk)
+            return true;
+        if (have_pk || have_vk)
+        {
+            std::cerr << "Error: only one of " << pk_file << " and " << vk_file << " exists, not replacing it" << std::endl;
+            return false;
+        }
+
+        const std::string tmp_pk_file = key_file(size_class, ".tmp.pk.map");
+        const std::string tmp_vk_file = key_file(size_class, ".tmp.vk.json");
+        std::cerr << "Generating keys for " << size_class << " blocks in " << keys_dir << std::endl;
+        if (0 != contingent_genkeys_ex(size_class, circuit, tmp_pk_file.c_str(), tmp_vk_file.c_str()))
+        {
+            std::remove(tmp_pk_file.c_str());
+            std::remove(tmp_vk_file.c_str());
+            return false;
+        }
+
+        // The verification key last, a buyer only ever needs that one
+        if (0 != std::rename(tmp_pk_file.c_str(), pk_file.c_str()) || 0 != std::rename(tmp_vk_file.c_str(), vk_file.c_str()))
+        {
+            std::cerr << "Error: cannot move the keys into " << keys_dir << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+    * Entry of the class holding `num_data_blocks`, with its prover or its
+    * verifier loaded from the directory. Keys are never generated here, a
+    * verifier only needs the verification key. Other classes can be used
+    * while one is being loaded.
+    */
+    contingent_registry_entry *open(const size_t num_data_blocks, const bool need_prover)
+    {
+        const size_t size_class = ethsnarks::size_class_of(num_data_blocks);
+        contingent_registry_entry *entry = get_entry(size_class);
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (need_prover ? entry->prover != nullptr : entry->verifier != nullptr)
+            return entry;
+
+        if (need_prover)
+        {
+            const std::string pk_file = key_file(size_class, ".pk.map");
+            if (!std::ifstream(pk_file))
+            {
+                std::cerr << "Error: no proving key " << pk_file << ", generate it with contingent_registry_genkeys() or contingent_cli keys" << std::endl;
+                return nullptr;
+            }
+            entry->prover = contingent_prover_open_ex(pk_file.c_str(), size_class, circuit);
+            return entry->prover ? entry : nullptr;
+        }
+
+        const std::string vk_file = key_file(size_class, ".vk.json");
+        entry->verifier = contingent_verifier_open_ex(vk_file.c_str(), size_class, circuit);
+        return entry->verifier ? entry : nullptr;
+    }
+
+    contingent_registry_entry *get_entry(const size_t size_class)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &slot = entries[size_class];
+        if (!slot)
+            slot.reset(new contingent_registry_entry);
+        return slot.get();
+    }
+};
+
+contingent_registry_t *contingent_registry_open(
+    const char *keys_dir,
+    const unsigned int circuit)
+{
+    init_library();
+    return new contingent_registry(keys_dir, circuit);
+}
+
+contingent_prover_t *contingent_registry_prover(
+    contingent_registry_t *registry,
+    const size_t num_data_blocks)
+{
+    contingent_registry_entry *entry = registry->open(num_data_blocks, true);
+    return entry ? entry->prover : nullptr;
+}
+
+int contingent_registry_genkeys(
+    contingent_registry_t *registry,
+    const size_t num_data_blocks)
+{
+    return registry->genkeys(num_data_blocks) ? 0 : 1;
+}
+
+contingent_verifier_t *contingent_registry_verifier(
+    contingent_registry_t *registry,
+    const size_t num_data_blocks)
+{
+    contingent_registry_entry *entry = registry->open(num_data_blocks, false);
+    return entry ? entry->verifier : nullptr;
+}
+
+void contingent_registry_close(contingent_registry_t *registry)
+{
+    delete registry;
 }
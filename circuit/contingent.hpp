@@ -2,7 +2,14 @@
 #define CONTINGENT_HPP_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using std::cerr;
 using std::cout;
@@ -18,6 +25,8 @@ using std::endl;
 
 #include <libsnark/gadgetlib1/gadgets/basic_gadgets.hpp>
 
+#include "contingent_merkle.hpp"
+
 using ethsnarks::FieldT;
 using ethsnarks::ppT;
 using ethsnarks::ProofT;
@@ -26,6 +35,24 @@ using ethsnarks::PrimaryInputT;
 using ethsnarks::ProtoboardT;
 using libsnark::generate_boolean_r1cs_constraint;
 
+// Circuit variants, a combination of these flags is given as the `circuit`
+// argument of the *_ex functions. Keys only work with the variant they were
+// generated for.
+#define CONTINGENT_CIRCUIT_DEFAULT 0
+// Commit to the key with MiMC instead of SHA256, the key hash is then a
+// 32 byte big-endian field element
+#define CONTINGENT_CIRCUIT_MIMC_KEY 1
+// Expose the SHA256 key hash as two field elements holding 128 bits each,
+// instead of 256 single bit public inputs
+#define CONTINGENT_CIRCUIT_PACKED_KEY_HASH 2
+// Replace the ciphertext blocks in the public inputs with their MiMC Merkle
+// root, the verifier computes it from the ciphertext itself
+#define CONTINGENT_CIRCUIT_CIPHERTEXT_HASH 4
+// Take the number of data blocks as an extra public input, the blocks past it
+// are padding: their plaintext and ciphertext are zero. Shorter files can then
+// be proven with the keys of a larger size class, see contingent_size_class()
+#define CONTINGENT_CIRCUIT_PADDED 8
+
 namespace ethsnarks
 {
 
@@ -113,6 +140,168 @@ public:
     }
 };
 
+/**
+* Number of public inputs used for the key hash by a circuit variant
+*/
+inline size_t key_hash_num_inputs(const unsigned int circuit)
+{
+    if (circuit & CONTINGENT_CIRCUIT_MIMC_KEY)
+        return 1;
+    if (circuit & CONTINGENT_CIRCUIT_PACKED_KEY_HASH)
+        return 2;
+    return 256;
+}
+
+/**
+* Number of public inputs used for the ciphertext by a circuit variant
+*/
+inline size_t ciphertext_num_inputs(const size_t num_blocks, const unsigned int circuit)
+{
+    return (circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH) ? 1 : num_blocks;
+}
+
+/**
+* Number of public inputs used for the number of data blocks by a circuit variant
+*/
+inline size_t length_num_inputs(const unsigned int circuit)
+{
+    return (circuit & CONTINGENT_CIRCUIT_PADDED) ? 1 : 0;
+}
+
+/**
+* Total number of public inputs: key hash, ciphertext, plaintext root and the
+* number of data blocks
+*/
+inline size_t contingent_num_inputs(const size_t num_blocks, const unsigned int circuit)
+{
+    return key_hash_num_inputs(circuit) + ciphertext_num_inputs(num_blocks, circuit) + 1 + length_num_inputs(circuit);
+}
+
+/**
+* Smallest size class, a power of two, which holds `num_blocks`
+*/
+inline size_t size_class_of(const size_t num_blocks)
+{
+    size_t size_class = 1;
+    while (size_class < num_blocks)
+        size_class <<= 1;
+    return size_class;
+}
+
+/**
+* Circuit variant from its option names combined with '+', e.g.
+* sha256-packed+ciphertext-hash, as taken by `contingent_cli --circuit`
+*/
+inline bool parse_circuit(const std::string &names, unsigned int &out_circuit)
+{
+    out_circuit = CONTINGENT_CIRCUIT_DEFAULT;
+    std::stringstream names_stream(names);
+    std::string name;
+    while (std::getline(names_stream, name, '+'))
+    {
+        if (name == "sha256")
+            continue;
+        else if (name == "sha256-packed")
+            out_circuit |= CONTINGENT_CIRCUIT_PACKED_KEY_HASH;
+        else if (name == "mimc")
+            out_circuit |= CONTINGENT_CIRCUIT_MIMC_KEY;
+        else if (name == "ciphertext-hash")
+            out_circuit |= CONTINGENT_CIRCUIT_CIPHERTEXT_HASH;
+        else if (name == "padded")
+            out_circuit |= CONTINGENT_CIRCUIT_PADDED;
+        else
+            return false;
+    }
+    return true;
+}
+
+/**
+* Inverse of bytes_to_bv(), MSB first within each byte
+*/
+inline std::vector<uint8_t> bv_to_bytes_msb(const libff::bit_vector &in_bits)
+{
+    std::vector<uint8_t> out((in_bits.size() + 7) / 8, 0);
+    for (size_t i = 0; i < in_bits.size(); i++)
+    {
+        if (in_bits[i])
+            out[i / 8] |= (1 << (7 - (i % 8)));
+    }
+    return out;
+}
+
+/**
+* 32 byte big-endian encoding of a field element, the same as a Solidity
+* uint256 or bytes32
+*/
+inline std::vector<uint8_t> field_to_bytes_be(const FieldT &value)
+{
+    const auto b = value.as_bigint();
+    std::vector<uint8_t> out(32, 0);
+    for (size_t i = 0; i < 256; i++)
+    {
+        if (b.test_bit(i))
+            out[31 - (i / 8)] |= (1 << (i % 8));
+    }
+    return out;
+}
+
+/**
+* Decode a 32 byte big-endian field element, fails if it's not below the
+* field modulus
+*/
+inline bool field_from_bytes_be(const uint8_t *in_bytes, FieldT &out_value)
+{
+    libff::bigint<FieldT::num_limbs> b;
+    for (size_t i = 0; i < 256; i++)
+    {
+        if (in_bytes[31 - (i / 8)] & (1 << (i % 8)))
+            b.data[i / GMP_NUMB_BITS] |= (mp_limb_t(1) << (i % GMP_NUMB_BITS));
+    }
+
+    if (mpn_cmp(b.data, FieldT::mod.data, FieldT::num_limbs) >= 0)
+        return false;
+
+    out_value = FieldT(b);
+    return true;
+}
+
+/**
+* Public inputs for the 32 byte key hash given to the C API: 256 bits for
+* SHA256, two big-endian 16 byte halves when packed, or one big-endian field
+* element for the MiMC commitment
+*/
+inline bool key_hash_to_inputs(const unsigned int circuit, const uint8_t *in_key_hash, std::vector<FieldT> &out_inputs)
+{
+    out_inputs.clear();
+
+    if (circuit & CONTINGENT_CIRCUIT_MIMC_KEY)
+    {
+        FieldT value;
+        if (!field_from_bytes_be(in_key_hash, value))
+            return false;
+        out_inputs.emplace_back(value);
+        return true;
+    }
+
+    if (circuit & CONTINGENT_CIRCUIT_PACKED_KEY_HASH)
+    {
+        for (size_t half = 0; half < 2; half++)
+        {
+            uint8_t padded[32] = {0};
+            ::memcpy(padded + 16, in_key_hash + (half * 16), 16);
+            FieldT value;
+            field_from_bytes_be(padded, value);
+            out_inputs.emplace_back(value);
+        }
+        return true;
+    }
+
+    const libff::bit_vector bits = bytes_to_bv(in_key_hash, 32);
+    for (const bool bit : bits)
+        out_inputs.emplace_back(bit ? FieldT::one() : FieldT::zero());
+    return true;
+}
+
 /**
 * This class implements the following circuit:
 *
@@ -131,22 +320,53 @@ public:
 *  - `plaintext` (secret): verify correct encryption and bind the data
 *
 * We verify encryption instead of decryption for fewer constraints.
-* 
+*
+* With CONTINGENT_CIRCUIT_MIMC_KEY the key hash is a single field element,
+* key_hash == mimc_hash([key], 1), which replaces the key unpacking and the
+* SHA256 gadget with a single MiMC permutation.
+*
+* With CONTINGENT_CIRCUIT_PACKED_KEY_HASH the SHA256 digest is compared
+* against two public field elements, each the packing of 128 digest bits,
+* MSB first. The digest bits are already boolean, so this takes one linear
+* constraint per element instead of 256 public inputs.
+*
+* With CONTINGENT_CIRCUIT_CIPHERTEXT_HASH the ciphertext is not a public
+* input, `ciphertext` is replaced by a single ciphertext_root and
+*
+*   assert ciphertext_root == mimc_merkle_root(mimc_enc(key, plaintext))
+*
+* so the verifier's work and the size of its key don't depend on the
+* number of blocks.
+*
+* With CONTINGENT_CIRCUIT_PADDED the number of data blocks `length` is an
+* additional public input and only the first `length` blocks hold the file,
+* using private flags `is_data[i] == (i < length)`:
+*
+*   assert is_data is boolean, decreasing and sum(is_data) == length
+*   assert plaintext[i] == 0 where !is_data[i]
+*   assert ciphertext[i] == (is_data[i] ? mimc_enc(key, plaintext)[i] : 0)
+*
+* So the plaintext root and ciphertext are those of the file zero-padded to
+* `num_blocks`, with the padding's ciphertext zeroed out so the verifier
+* doesn't need the key to reconstruct it.
 */
 class contingent_gadget : public GadgetT
 {
 public:
     typedef packing_gadget PackT;
     typedef sha256_many HashT;
+    typedef MiMC_hash_gadget CommitT;
     typedef MiMC_encrypt_gadget EncrT;
     typedef MiMC_merkle_root_gadget RootT;
 
     const size_t m_num_blocks;
+    const unsigned int m_circuit;
 
     // public inputs
     const VariableArrayT m_in_key_hash;
     const VariableArrayT m_in_ciphertext;
     const VariableT m_in_plaintext_root;
+    const VariableArrayT m_in_length;
 
     // private inputs
     const VariableT m_in_key;
@@ -154,25 +374,34 @@ public:
 
     // intermediate values
     const VariableArrayT m_key_bits;
+    const VariableArrayT m_is_data;
+    const VariableArrayT m_masked_ciphertext;
 
-    // logic gadgets
-    PackT m_key_pack_gadget;
-    HashT m_key_hash_gadget;
+    // logic gadgets, either the SHA256 or the MiMC key hash is used
+    const std::unique_ptr<PackT> m_key_pack_gadget;
+    const std::unique_ptr<HashT> m_key_hash_gadget;
+    const std::unique_ptr<CommitT> m_key_commit_gadget;
     EncrT m_encrypt_gadget;
+    const size_t m_merkle_vars_begin;
     RootT m_merkle_root_gadget;
+    const size_t m_merkle_vars_end;
+    const std::unique_ptr<RootT> m_ciphertext_root_gadget;
 
     contingent_gadget(
         ProtoboardT &in_pb,
         const size_t num_blocks,
-        const std::string &annotation_prefix)
+        const std::string &annotation_prefix,
+        const unsigned int circuit = CONTINGENT_CIRCUIT_DEFAULT)
         : GadgetT(in_pb, annotation_prefix),
 
           m_num_blocks(num_blocks),
+          m_circuit(circuit),
 
           // public inputs
-          m_in_key_hash(make_var_array(in_pb, 256, FMT(annotation_prefix, ".in_key_hash"))),
-          m_in_ciphertext(make_var_array(in_pb, num_blocks, FMT(annotation_prefix, ".in_ciphertext"))),
+          m_in_key_hash(make_var_array(in_pb, key_hash_num_inputs(circuit), FMT(annotation_prefix, ".in_key_hash"))),
+          m_in_ciphertext(make_var_array(in_pb, ciphertext_num_inputs(num_blocks, circuit), FMT(annotation_prefix, ".in_ciphertext"))),
           m_in_plaintext_root(make_variable(in_pb, FMT(annotation_prefix, ".in_plaintext_root"))),
+          m_in_length(make_var_array(in_pb, length_num_inputs(circuit), FMT(annotation_prefix, ".in_length"))),
 
           // secret inputs
           m_in_key(make_variable(in_pb, FMT(annotation_prefix, ".in_key"))),
@@ -182,56 +411,146 @@ public:
           // since key is an element in the alt_bn128 field, it's around 253~254 bits
           // for compatibility with Ethereum and other programs, we will use 256 bits / 32 bytes
           // to express it in LSB-first format, and the last few bits are always zeros.
-          m_key_bits(make_var_array(in_pb, 256, FMT(annotation_prefix, ".key_bits"))),
+          m_key_bits(make_var_array(in_pb, is_mimc_key() ? 0 : 256, FMT(annotation_prefix, ".key_bits"))),
+
+          // is_data[i] == (i < length), and the ciphertext with the padding
+          // zeroed out, for its root
+          m_is_data(make_var_array(in_pb, is_padded() ? num_blocks : 0, FMT(annotation_prefix, ".is_data"))),
+          m_masked_ciphertext(make_var_array(in_pb, (is_padded() && is_ciphertext_hash()) ? num_blocks : 0, FMT(annotation_prefix, ".masked_ciphertext"))),
 
           // to ensure that the prover correctly unpacked the key into bit array, we need
           // a packing gadget to reconstruct the key from the bit array variables with
           // constraints to verify this process, also we need to ensure all the values
           // in the bit array are either 0 or 1.
-          m_key_pack_gadget(in_pb, m_key_bits, m_in_key, FMT(annotation_prefix, ".key_pack_gadget")),
+          m_key_pack_gadget(is_mimc_key() ? nullptr : new PackT(in_pb, m_key_bits, m_in_key, FMT(annotation_prefix, ".key_pack_gadget"))),
 
           // key_hash = sha265(key)
-          m_key_hash_gadget(in_pb, m_key_bits, FMT(annotation_prefix, ".key_hash_gadget")),
+          m_key_hash_gadget(is_mimc_key() ? nullptr : new HashT(in_pb, m_key_bits, FMT(annotation_prefix, ".key_hash_gadget"))),
+
+          // key_hash = mimc_hash([key], 1), the IV is the constant one variable
+          m_key_commit_gadget(is_mimc_key() ? new CommitT(in_pb, VariableT(0), VariableArrayT(1, m_in_key), FMT(annotation_prefix, ".key_commit_gadget")) : nullptr),
 
           // ciphertext = mimc_enc(key, plaintext)
           m_encrypt_gadget(in_pb, m_in_key, m_in_plaintext, FMT(annotation_prefix, ".mimc_encrypt_gadget")),
 
-          // plaintext_root = mimc_merkle_root(plaintext)
-          m_merkle_root_gadget(in_pb, m_in_plaintext, FMT(annotation_prefix, ".merkle_root_gadget"))
+          // plaintext_root = mimc_merkle_root(plaintext), its variables are
+          // the indices [m_merkle_vars_begin, m_merkle_vars_end)
+          m_merkle_vars_begin(in_pb.num_variables() + 1),
+          m_merkle_root_gadget(in_pb, m_in_plaintext, FMT(annotation_prefix, ".merkle_root_gadget")),
+          m_merkle_vars_end(in_pb.num_variables() + 1),
+
+          // ciphertext_root = mimc_merkle_root(ciphertext)
+          m_ciphertext_root_gadget(is_ciphertext_hash() ? new RootT(in_pb, is_padded() ? m_masked_ciphertext : m_encrypt_gadget.result(), FMT(annotation_prefix, ".ciphertext_root_gadget")) : nullptr)
 
     {
         assert(m_num_blocks > 0);
 
-        // public inputs are m_in_key_hash, in_ciphertext, and in_plaintext_root
-        this->pb.set_input_sizes(256 + m_num_blocks + 1);
+        // public inputs are m_in_key_hash, in_ciphertext, in_plaintext_root and in_length
+        this->pb.set_input_sizes(contingent_num_inputs(m_num_blocks, m_circuit));
+    }
+
+    bool is_mimc_key() const
+    {
+        return (m_circuit & CONTINGENT_CIRCUIT_MIMC_KEY) != 0;
+    }
+
+    bool is_ciphertext_hash() const
+    {
+        return (m_circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH) != 0;
+    }
+
+    bool is_padded() const
+    {
+        return (m_circuit & CONTINGENT_CIRCUIT_PADDED) != 0;
     }
 
     void generate_r1cs_constraints()
     {
-        m_key_pack_gadget.generate_r1cs_constraints(true);
-        m_key_hash_gadget.generate_r1cs_constraints();
+        if (is_mimc_key())
+        {
+            m_key_commit_gadget->generate_r1cs_constraints();
+
+            // assert key_hash == mimc_hash([key], 1)
+            this->pb.add_r1cs_constraint(
+                ConstraintT(m_key_commit_gadget->result(), FieldT::one(), m_in_key_hash[0]),
+                "key_hash == MiMC(key)");
+        }
+        else
+        {
+            m_key_pack_gadget->generate_r1cs_constraints(true);
+            m_key_hash_gadget->generate_r1cs_constraints();
+
+            // assert key_hash == sha265(key)
+            const HashT::DigestT &digest = m_key_hash_gadget->result();
+            if (m_circuit & CONTINGENT_CIRCUIT_PACKED_KEY_HASH)
+            {
+                // compare each 128 bit half against its packed input
+                assert(digest.bits.size() == 128 * m_in_key_hash.size());
+                for (size_t half = 0; half < m_in_key_hash.size(); half++)
+                {
+                    FieldT twoi = FieldT::one(); // will hold 2^i entering each iteration
+                    std::vector<LinearTermT> terms;
+                    for (size_t j = 128; j-- > 0;)
+                    {
+                        terms.emplace_back(digest.bits[(half * 128) + j], twoi);
+                        twoi += twoi;
+                    }
+                    this->pb.add_r1cs_constraint(
+                        ConstraintT(libsnark::linear_combination<FieldT>(terms), FieldT::one(), m_in_key_hash[half]),
+                        "key_hash == pack(SHA256(key))");
+                }
+            }
+            else
+            {
+                // we have to compare them bit by bit
+                assert(digest.bits.size() == m_in_key_hash.size());
+                for (size_t i = 0; i < digest.bits.size(); i++)
+                {
+                    this->pb.add_r1cs_constraint(
+                        ConstraintT(digest.bits[i], FieldT::one(), m_in_key_hash[i]),
+                        "key_hash == SHA256(key)");
+                }
+            }
+        }
+
         m_encrypt_gadget.generate_r1cs_constraints();
         m_merkle_root_gadget.generate_r1cs_constraints();
 
-        // assert key_hash == sha265(key)
-        // we have to compare them bit by bit
-        const HashT::DigestT &digest = m_key_hash_gadget.result();
-        assert(digest.bits.size() == m_in_key_hash.size());
-        for (size_t i = 0; i < digest.bits.size(); i++)
+        if (is_padded())
+            generate_padding_constraints();
+
+        if (is_ciphertext_hash())
         {
+            m_ciphertext_root_gadget->generate_r1cs_constraints();
+
+            // assert ciphertext_root == mimc_merkle_root(mimc_enc(key, plaintext))
             this->pb.add_r1cs_constraint(
-                ConstraintT(digest.bits[i], FieldT::one(), m_in_key_hash[i]),
-                "key_hash == SHA256(key)");
+                ConstraintT(m_in_ciphertext[0], FieldT::one(), m_ciphertext_root_gadget->result()),
+                "ciphertext_root == mimc_merkle_root(mimc_enc(key, plaintext))");
         }
-
-        // assert ciphertext == mimc_enc(key, plaintext)
-        // we have to compare them block by block
-        const VariableArrayT &out_ciphertext = m_encrypt_gadget.result();
-        for (size_t i = 0; i < m_in_ciphertext.size(); i++)
+        else
         {
-            this->pb.add_r1cs_constraint(
-                ConstraintT(m_in_ciphertext[i], FieldT::one(), out_ciphertext[i]),
-                "ciphertext == mimc_enc(key, plaintext)");
+            // assert ciphertext == mimc_enc(key, plaintext)
+            // we have to compare them block by block
+            const VariableArrayT &out_ciphertext = m_encrypt_gadget.result();
+            for (size_t i = 0; i < m_in_ciphertext.size(); i++)
+            {
+                if (is_padded())
+                {
+                    // assert ciphertext[i] == (is_data[i] ? out_ciphertext[i] : 0)
+                    this->pb.add_r1cs_constraint(
+                        ConstraintT(out_ciphertext[i] - m_in_ciphertext[i], m_is_data[i], FieldT::zero()),
+                        "is_data[i] -> ciphertext[i] == mimc_enc(key, plaintext)[i]");
+                    this->pb.add_r1cs_constraint(
+                        ConstraintT(m_in_ciphertext[i], FieldT::one() - m_is_data[i], FieldT::zero()),
+                        "!is_data[i] -> ciphertext[i] == 0");
+                    continue;
+                }
+
+                this->pb.add_r1cs_constraint(
+                    ConstraintT(m_in_ciphertext[i], FieldT::one(), out_ciphertext[i]),
+                    "ciphertext == mimc_enc(key, plaintext)");
+            }
         }
 
         // assert plaintext_root == mimc_merkle_root(plaintext)
@@ -241,29 +560,194 @@ public:
     }
 
     void generate_r1cs_witness(
-        const libff::bit_vector &in_key_hash, // 256 bits array
-        const std::vector<FieldT> &in_ciphertext,
+        const std::vector<FieldT> &in_key_hash, // see key_hash_to_inputs()
+        const std::vector<FieldT> &in_ciphertext, // blocks, or their root with CONTINGENT_CIRCUIT_CIPHERTEXT_HASH
         const FieldT &in_plaintext_root,
         const FieldT &in_key,
         const std::vector<FieldT> &in_plaintext)
     {
-        assert(in_ciphertext.size() == m_num_blocks);
+        generate_r1cs_witness(in_key_hash, in_ciphertext, in_plaintext_root, in_key, in_plaintext, m_num_blocks);
+    }
+
+    /**
+    * With CONTINGENT_CIRCUIT_PADDED, `in_plaintext` is zero-padded to
+    * m_num_blocks and the file is its first `in_length` blocks
+    *
+    * `in_merkle_witness`, from merkle_witness(), is filled in instead of
+    * computing the Merkle tree of the plaintext again
+    */
+    void generate_r1cs_witness(
+        const std::vector<FieldT> &in_key_hash,
+        const std::vector<FieldT> &in_ciphertext,
+        const FieldT &in_plaintext_root,
+        const FieldT &in_key,
+        const std::vector<FieldT> &in_plaintext,
+        const size_t in_length,
+        const std::vector<FieldT> *in_merkle_witness = nullptr)
+    {
+        assert(in_key_hash.size() == m_in_key_hash.size());
+        assert(in_ciphertext.size() == m_in_ciphertext.size());
         assert(in_plaintext.size() == m_num_blocks);
 
-        m_in_key_hash.fill_with_bits(this->pb, in_key_hash);
-        for (size_t i = 0; i < m_num_blocks; i++)
+        m_in_key_hash.fill_with_field_elements(this->pb, in_key_hash);
+        for (size_t i = 0; i < m_in_ciphertext.size(); i++)
             this->pb.val(m_in_ciphertext[i]) = in_ciphertext[i];
         this->pb.val(m_in_plaintext_root) = in_plaintext_root;
+        if (is_padded())
+        {
+            assert(in_length <= m_num_blocks);
+            this->pb.val(m_in_length[0]) = FieldT(in_length);
+            for (size_t i = 0; i < m_num_blocks; i++)
+                this->pb.val(m_is_data[i]) = (i < in_length) ? FieldT::one() : FieldT::zero();
+        }
 
         this->pb.val(m_in_key) = in_key;
         for (size_t i = 0; i < m_num_blocks; i++)
             this->pb.val(m_in_plaintext[i]) = in_plaintext[i];
 
-        m_key_pack_gadget.generate_r1cs_witness_from_packed();
-        m_key_hash_gadget.generate_r1cs_witness();
-        m_encrypt_gadget.generate_r1cs_witness();
+        if (in_merkle_witness != nullptr)
+        {
+            assert(in_merkle_witness->size() == m_merkle_vars_end - m_merkle_vars_begin);
+            for (size_t i = m_merkle_vars_begin; i < m_merkle_vars_end; i++)
+                this->pb.val(VariableT(i)) = (*in_merkle_witness)[i - m_merkle_vars_begin];
+        }
+
+        // The key hash, the encryption and the Merkle tree only depend on the
+        // inputs filled in above and write to disjoint variables, so for
+        // larger files they are computed concurrently
+        if (m_num_blocks < PARALLEL_WITNESS_MIN_BLOCKS)
+        {
+            generate_key_hash_witness();
+            generate_ciphertext_witness();
+            if (in_merkle_witness == nullptr)
+                m_merkle_root_gadget.generate_r1cs_witness();
+            return;
+        }
+
+        std::thread key_hash_thread([this]() { generate_key_hash_witness(); });
+        std::thread merkle_root_thread;
+        if (in_merkle_witness == nullptr)
+            merkle_root_thread = std::thread([this]() { generate_merkle_witness(); });
+        generate_ciphertext_witness();
+        key_hash_thread.join();
+        if (merkle_root_thread.joinable())
+            merkle_root_thread.join();
+    }
+
+    /**
+    * Fill in the plaintext and its Merkle tree only, the part of the witness
+    * which doesn't depend on the key. Returns the values of the Merkle
+    * tree's variables, for generate_r1cs_witness().
+    */
+    std::vector<FieldT> merkle_witness(const std::vector<FieldT> &in_plaintext)
+    {
+        assert(in_plaintext.size() == m_num_blocks);
+        for (size_t i = 0; i < m_num_blocks; i++)
+            this->pb.val(m_in_plaintext[i]) = in_plaintext[i];
+        generate_merkle_witness();
+
+        std::vector<FieldT> values;
+        values.reserve(m_merkle_vars_end - m_merkle_vars_begin);
+        for (size_t i = m_merkle_vars_begin; i < m_merkle_vars_end; i++)
+            values.emplace_back(this->pb.val(VariableT(i)));
+        return values;
+    }
+
+    /**
+    * The key hash computed from the key by the last witness, in the 32 byte
+    * form taken by the C API
+    */
+    std::vector<uint8_t> key_hash_result() const
+    {
+        if (is_mimc_key())
+            return field_to_bytes_be(this->pb.val(m_key_commit_gadget->result()));
+        return bv_to_bytes_msb(m_key_hash_gadget->result().get_digest());
+    }
+
+    // Below this the cost of starting threads outweighs the witness itself
+    static const size_t PARALLEL_WITNESS_MIN_BLOCKS = 64;
+
+private:
+    /**
+    * The Merkle tree of the plaintext, for larger files with its subtrees
+    * computed concurrently, see contingent_merkle.hpp
+    */
+    void generate_merkle_witness()
+    {
+        if (m_num_blocks >= PARALLEL_WITNESS_MIN_BLOCKS)
+        {
+            const auto plan = merkle_witness_plan_for(m_num_blocks);
+            if (plan->num_subtrees > 1)
+            {
+                const auto values = merkle_witness_with_plan(*plan, m_in_plaintext.get_vals(this->pb));
+                assert(values.size() == m_merkle_vars_end - m_merkle_vars_begin);
+                for (size_t i = m_merkle_vars_begin; i < m_merkle_vars_end; i++)
+                    this->pb.val(VariableT(i)) = values[i - m_merkle_vars_begin];
+                return;
+            }
+        }
         m_merkle_root_gadget.generate_r1cs_witness();
     }
+
+    void generate_key_hash_witness()
+    {
+        if (is_mimc_key())
+        {
+            m_key_commit_gadget->generate_r1cs_witness();
+            return;
+        }
+        m_key_pack_gadget->generate_r1cs_witness_from_packed();
+        m_key_hash_gadget->generate_r1cs_witness();
+    }
+
+    void generate_padding_constraints()
+    {
+        libsnark::linear_combination<FieldT> num_data_blocks;
+        for (size_t i = 0; i < m_num_blocks; i++)
+        {
+            generate_boolean_r1cs_constraint<FieldT>(this->pb, m_is_data[i], FMT(annotation_prefix, ".is_data_%zu", i));
+            num_data_blocks = num_data_blocks + m_is_data[i];
+
+            // the data blocks come first, is_data[i + 1] -> is_data[i]
+            if (i + 1 < m_num_blocks)
+            {
+                this->pb.add_r1cs_constraint(
+                    ConstraintT(m_is_data[i + 1], FieldT::one() - m_is_data[i], FieldT::zero()),
+                    "is_data[i + 1] -> is_data[i]");
+            }
+
+            // assert plaintext[i] == 0 where !is_data[i]
+            this->pb.add_r1cs_constraint(
+                ConstraintT(m_in_plaintext[i], FieldT::one() - m_is_data[i], FieldT::zero()),
+                "!is_data[i] -> plaintext[i] == 0");
+
+            // masked_ciphertext[i] == is_data[i] * mimc_enc(key, plaintext)[i]
+            if (is_ciphertext_hash())
+            {
+                this->pb.add_r1cs_constraint(
+                    ConstraintT(m_encrypt_gadget.result()[i], m_is_data[i], m_masked_ciphertext[i]),
+                    "masked_ciphertext[i] == is_data[i] * mimc_enc(key, plaintext)[i]");
+            }
+        }
+
+        // assert sum(is_data) == length
+        this->pb.add_r1cs_constraint(
+            ConstraintT(num_data_blocks, FieldT::one(), m_in_length[0]),
+            "sum(is_data) == length");
+    }
+
+    void generate_ciphertext_witness()
+    {
+        m_encrypt_gadget.generate_r1cs_witness();
+        if (is_padded() && is_ciphertext_hash())
+        {
+            const VariableArrayT &out_ciphertext = m_encrypt_gadget.result();
+            for (size_t i = 0; i < m_num_blocks; i++)
+                this->pb.val(m_masked_ciphertext[i]) = this->pb.val(m_is_data[i]) * this->pb.val(out_ciphertext[i]);
+        }
+        if (is_ciphertext_hash())
+            m_ciphertext_root_gadget->generate_r1cs_witness();
+    }
 };
 
 } // namespace ethsnarks
@@ -273,11 +757,75 @@ extern "C"
 {
 #endif
 
+// Size of a proof in the binary encoding, see contingent_encoding.hpp
+#define CONTINGENT_PROOF_BINARY_SIZE 134
+
+    // Opaque handle which keeps a loaded proving key in memory, so many
+    // proofs can be made without deserializing the key every time
+    typedef struct contingent_prover contingent_prover_t;
+
+    // Opaque handle which keeps a parsed and pre-processed verification key
+    // in memory, so many proofs can be verified without reading the key
+    typedef struct contingent_verifier contingent_verifier_t;
+
+    // Opaque handle which keeps the plaintext dependent part of a proof, so
+    // one file can be proven for many keys, see contingent_prover_prepare()
+    typedef struct contingent_prepared contingent_prepared_t;
+
+    // Opaque handle which keeps the provers and verifiers of the size classes
+    // of a padded circuit variant, see contingent_registry_open()
+    typedef struct contingent_registry contingent_registry_t;
+
+    // One proof in a batch, same arguments as contingent_prove()
+    typedef struct contingent_prove_job
+    {
+        const char *key_hash;
+        const char **ciphertext;
+        const char *plaintext_root;
+        const char *key;
+        const char **plaintext;
+    } contingent_prove_job_t;
+
+    // One proof in a batch, same arguments as contingent_verify()
+    typedef struct contingent_verify_job
+    {
+        const char *proof_json;
+        const char *key_hash;
+        const char **ciphertext;
+        const char *plaintext_root;
+    } contingent_verify_job_t;
+
     int contingent_genkeys(
         const size_t num_blocks,
         const char *pk_file,
         const char *vk_file);
 
+    // Same as contingent_genkeys(), for a circuit variant (CONTINGENT_CIRCUIT_*)
+    int contingent_genkeys_ex(
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *pk_file,
+        const char *vk_file);
+
+    // Progress of a long running call: `done` of `total` items of `stage`
+    // are finished
+    typedef void (*contingent_progress_fn)(const char *stage, uint64_t done, uint64_t total, void *arg);
+
+    // Generate a key pair with the proving key in the sectioned layout, which
+    // is copied into memory on load, on `num_threads` threads (0 for the
+    // default budget). The proving key is written section by section as
+    // it's computed, so only a slice of it is ever in memory. `progress` may
+    // be NULL. contingent_genkeys_ex() does the same for a `pk_file` ending
+    // with .map.
+    int contingent_genkeys_mapped(
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *pk_file,
+        const char *vk_file,
+        const size_t num_threads,
+        contingent_progress_fn progress,
+        void *progress_arg);
+
     char *contingent_prove(
         const char *pk_file,
         const size_t num_blocks,
@@ -287,6 +835,288 @@ extern "C"
         const char *in_key,
         const char **in_plaintext);
 
+    // Same as contingent_prove() for a circuit variant, the key must be
+    // for the same variant
+    char *contingent_prove_ex(
+        const char *pk_file,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext);
+
+    // Same as contingent_prove(), with the field elements as 32 byte
+    // little-endian buffers, see contingent_prover_prove_raw()
+    char *contingent_prove_raw(
+        const char *pk_file,
+        const size_t num_blocks,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root,
+        const uint8_t *in_key,
+        const uint8_t *in_plaintext);
+
+    char *contingent_prove_raw_ex(
+        const char *pk_file,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root,
+        const uint8_t *in_key,
+        const uint8_t *in_plaintext);
+
+    contingent_prover_t *contingent_prover_open(
+        const char *pk_file,
+        const size_t num_blocks);
+
+    contingent_prover_t *contingent_prover_open_ex(
+        const char *pk_file,
+        const size_t num_blocks,
+        const unsigned int circuit);
+
+    // Proof as a JSON document, NULL on failure. Like every proof returned
+    // by the functions below, it must be released with contingent_free().
+    char *contingent_prover_prove(
+        contingent_prover_t *prover,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext);
+
+    // Same as contingent_prover_prove(), with the FFTs and
+    // multi-exponentiations limited to `num_threads` threads for this proof
+    // only, 0 uses the prover's budget
+    char *contingent_prover_prove_ex(
+        contingent_prover_t *prover,
+        const size_t num_threads,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext);
+
+    // Same as contingent_prover_prove(), with the field elements as 32 byte
+    // little-endian buffers: `in_ciphertext` and `in_plaintext` hold
+    // num_blocks * 32 bytes. Values which aren't reduced modulo the field
+    // order are refused.
+    char *contingent_prover_prove_raw(
+        contingent_prover_t *prover,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root,
+        const uint8_t *in_key,
+        const uint8_t *in_plaintext);
+
+    // Prove a file of `num_data_blocks`, at most the prover's number of
+    // blocks, with a CONTINGENT_CIRCUIT_PADDED key. The ciphertext and
+    // plaintext arrays hold `num_data_blocks` values, they are zero-padded
+    // and the plaintext root is that of the padded plaintext.
+    char *contingent_prover_prove_padded(
+        contingent_prover_t *prover,
+        const size_t num_data_blocks,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext);
+
+    // Threads every proof of this prover may use, 0 for one per core. With
+    // `first_core` >= 0 the OpenMP workers are pinned to the cores after
+    // first_core, which is left to the unpinned calling thread, and get the
+    // caller's affinity back after each proof. Batch workers split the
+    // budget and get adjacent cores. Concurrent provers with disjoint
+    // budgets don't oversubscribe the host.
+    void contingent_prover_set_threads(
+        contingent_prover_t *prover,
+        const size_t num_threads,
+        const int first_core);
+
+    // Default thread budget for contingent_genkeys(), the one-shot prove
+    // functions and provers opened afterwards, same arguments as
+    // contingent_prover_set_threads(). Not thread safe, call it at startup.
+    void contingent_set_threads(
+        const size_t num_threads,
+        const int first_core);
+
+    // Compute the witness of the plaintext's Merkle tree, and its terms of
+    // the prover's multi-exponentiations, once for proofs of the same file
+    // under different keys. The plaintext holds `num_data_blocks`, fewer
+    // than the prover's blocks only with CONTINGENT_CIRCUIT_PADDED. Only
+    // valid with the prover it was made with, NULL on failure.
+    contingent_prepared_t *contingent_prover_prepare(
+        contingent_prover_t *prover,
+        const size_t num_data_blocks,
+        const char **in_plaintext);
+
+    // Plaintext root of a prepared plaintext as a decimal string, must be
+    // released with contingent_free()
+    char *contingent_prepared_plaintext_root(
+        const contingent_prepared_t *prepared);
+
+    // Same as contingent_prover_prove() with the plaintext and its root
+    // taken from `prepared`, the ciphertext holds its number of blocks
+    char *contingent_prover_prove_prepared(
+        contingent_prover_t *prover,
+        const contingent_prepared_t *prepared,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_key);
+
+    void contingent_prepared_close(
+        contingent_prepared_t *prepared);
+
+    // Every proof is checked natively first: the key hash, the encryption of
+    // each block and the plaintext root. With `full_check` the witness is
+    // also checked against every constraint before proving, which takes as
+    // long as generating it and is on by default.
+    void contingent_prover_set_full_check(
+        contingent_prover_t *prover,
+        const bool full_check);
+
+    // Default of contingent_prover_set_full_check() for the one-shot prove
+    // functions and provers opened afterwards. Not thread safe, call it at
+    // startup.
+    void contingent_set_full_check(
+        const bool full_check);
+
+    // Provers opened afterwards, including by the one-shot prove functions,
+    // keep the constraint system in a compact form instead of libsnark's and
+    // build the witness on a protoboard of their own for each proof. This
+    // cuts the memory held per proving key at the cost of laying out the
+    // circuit again for every proof. Not thread safe, call it at startup.
+    void contingent_set_lean_proving(
+        const bool lean);
+
+    // Same as contingent_prover_prove(), but writes the proof in the binary
+    // encoding to `out_proof`, which must hold CONTINGENT_PROOF_BINARY_SIZE
+    // bytes. Returns the number of bytes written, or 0 on failure.
+    size_t contingent_prover_prove_binary(
+        contingent_prover_t *prover,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext,
+        uint8_t *out_proof,
+        const size_t out_size);
+
+    void contingent_prover_close(
+        contingent_prover_t *prover);
+
+    size_t contingent_prove_binary(
+        const char *pk_file,
+        const size_t num_blocks,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext,
+        uint8_t *out_proof,
+        const size_t out_size);
+
+    size_t contingent_prove_binary_ex(
+        const char *pk_file,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root,
+        const char *in_key,
+        const char **in_plaintext,
+        uint8_t *out_proof,
+        const size_t out_size);
+
+    // Prove many jobs of the same size on `num_threads` workers (0 uses
+    // every core), sharing one proving key and circuit template. For each
+    // job either `out_proofs[i]` or `out_errors[i]` is set, both must be
+    // released with contingent_free(). Returns the number of failed jobs.
+    size_t contingent_prover_prove_batch(
+        contingent_prover_t *prover,
+        const contingent_prove_job_t *jobs,
+        const size_t num_jobs,
+        const size_t num_threads,
+        char **out_proofs,
+        char **out_errors);
+
+    size_t contingent_prove_batch(
+        const char *pk_file,
+        const size_t num_blocks,
+        const contingent_prove_job_t *jobs,
+        const size_t num_jobs,
+        const size_t num_threads,
+        char **out_proofs,
+        char **out_errors);
+
+    // Prove a large file as `num_chunks` segments of the prover's number of
+    // blocks each, in parallel. `in_ciphertext` and `in_plaintext` hold all
+    // num_chunks * num_blocks blocks. Every segment proof is made against
+    // the same key hash and the Merkle root of its own plaintext blocks,
+    // which is returned as a decimal string in `out_sub_roots[i]`. Both the
+    // number of chunks and the number of blocks per chunk must be powers of
+    // two, so the root of the sub-roots is the root of the whole file.
+    // All outputs must be released with contingent_free(). Returns the
+    // number of failed segments.
+    size_t contingent_prover_prove_chunked(
+        contingent_prover_t *prover,
+        const size_t num_chunks,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_key,
+        const char **in_plaintext,
+        const size_t num_threads,
+        char **out_proofs,
+        char **out_sub_roots,
+        char **out_errors);
+
+    // Release a string returned by the library
+    void contingent_free(
+        char *ptr);
+
+    // Statistics of the last prove, verify, genkeys or open call made on the
+    // calling thread, as a JSON document: wall time of the call and of each
+    // of its phases (key_load, inputs, witness, check, fft and multiexp when
+    // proving, parse, inputs and pairing when verifying), constraint,
+    // variable and input counts, key load time and peak RSS. The CPU time,
+    // net heap growth and bytes allocated are process-wide, prefixed with
+    // process_, and left out when another call overlapped this one. Must be
+    // released with contingent_free(), NULL if no call was made yet. Batch
+    // calls only report the calling thread's own work.
+    char *contingent_last_stats(void);
+
+    // Why the last prove call made on the calling thread failed, e.g. which
+    // native check rejected its arguments. Must be released with
+    // contingent_free(), NULL if the call didn't fail.
+    char *contingent_last_error(void);
+
+// Results of contingent_decrypt_file()
+#define CONTINGENT_DECRYPT_OK 0
+#define CONTINGENT_DECRYPT_BAD_KEY 1
+#define CONTINGENT_DECRYPT_BAD_ROOT 2
+#define CONTINGENT_DECRYPT_IO_ERROR 3
+
+    // Buyer side once the key is revealed: check the key against the key
+    // hash of the circuit variant, decrypt `num_blocks` blocks of
+    // `ciphertext_file` (32 byte little-endian field elements, as written by
+    // `contingent_cli encrypt`) and write the first `size` bytes of the
+    // plaintext to `out_file`. The ciphertext is streamed and decrypted on
+    // `num_threads` threads (0 uses every core). When the Merkle root of the
+    // plaintext isn't `in_plaintext_root` the output is removed and
+    // CONTINGENT_DECRYPT_BAD_ROOT returned.
+    int contingent_decrypt_file(
+        const char *ciphertext_file,
+        const char *out_file,
+        const size_t num_blocks,
+        const uint64_t size,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const char *in_key,
+        const char *in_plaintext_root,
+        const size_t num_threads);
+
     bool contingent_verify(
         const char *vk_file,
         const char *proof_json,
@@ -295,6 +1125,182 @@ extern "C"
         const char **in_ciphertext,
         const char *in_plaintext_root);
 
+    // Same as contingent_verify() for a circuit variant, a key for another
+    // variant is rejected
+    bool contingent_verify_ex(
+        const char *vk_file,
+        const char *proof_json,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    // Same as contingent_verify(), with the field elements as 32 byte
+    // little-endian buffers
+    bool contingent_verify_raw(
+        const char *vk_file,
+        const char *proof_json,
+        const size_t num_blocks,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root);
+
+    bool contingent_verify_raw_ex(
+        const char *vk_file,
+        const char *proof_json,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root);
+
+    bool contingent_verify_binary(
+        const char *vk_file,
+        const uint8_t *proof_data,
+        const size_t proof_size,
+        const size_t num_blocks,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    bool contingent_verify_binary_ex(
+        const char *vk_file,
+        const uint8_t *proof_data,
+        const size_t proof_size,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    // Verify many proofs of the same size with a single multi-pairing
+    // check, falling back to verifying each proof on its own when the
+    // batch fails. `out_results[i]` is set for every job, returns the
+    // number of failed proofs.
+    size_t contingent_verify_batch(
+        const char *vk_file,
+        const size_t num_blocks,
+        const contingent_verify_job_t *jobs,
+        const size_t num_jobs,
+        bool *out_results);
+
+    size_t contingent_verify_batch_ex(
+        const char *vk_file,
+        const size_t num_blocks,
+        const unsigned int circuit,
+        const contingent_verify_job_t *jobs,
+        const size_t num_jobs,
+        bool *out_results);
+
+    contingent_verifier_t *contingent_verifier_open(
+        const char *vk_file);
+
+    // Open a verifier for a circuit variant. `num_blocks` may be 0 to take it
+    // from the size of the key, except with CONTINGENT_CIRCUIT_CIPHERTEXT_HASH
+    // where the key doesn't depend on it.
+    contingent_verifier_t *contingent_verifier_open_ex(
+        const char *vk_file,
+        const size_t num_blocks,
+        const unsigned int circuit);
+
+    // Number of blocks the verification key was generated for
+    size_t contingent_verifier_num_blocks(
+        const contingent_verifier_t *verifier);
+
+    bool contingent_verifier_verify(
+        const contingent_verifier_t *verifier,
+        const char *proof_json,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    // Same as contingent_verifier_verify(), with the field elements as 32
+    // byte little-endian buffers, see contingent_prover_prove_raw()
+    bool contingent_verifier_verify_raw(
+        const contingent_verifier_t *verifier,
+        const char *proof_json,
+        const char *in_key_hash,
+        const uint8_t *in_ciphertext,
+        const uint8_t *in_plaintext_root);
+
+    // Verify a proof of contingent_prover_prove_padded(), `in_ciphertext`
+    // holds `num_data_blocks` values
+    bool contingent_verifier_verify_padded(
+        const contingent_verifier_t *verifier,
+        const size_t num_data_blocks,
+        const char *proof_json,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    bool contingent_verifier_verify_binary(
+        const contingent_verifier_t *verifier,
+        const uint8_t *proof_data,
+        const size_t proof_size,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    size_t contingent_verifier_verify_batch(
+        const contingent_verifier_t *verifier,
+        const contingent_verify_job_t *jobs,
+        const size_t num_jobs,
+        bool *out_results);
+
+    // Verify the set of segment proofs made by
+    // contingent_prover_prove_chunked(): every proof must be valid for its
+    // slice of the ciphertext and its sub-root, and the Merkle root of the
+    // sub-roots must be `in_plaintext_root`.
+    bool contingent_verifier_verify_chunked(
+        const contingent_verifier_t *verifier,
+        const size_t num_chunks,
+        const char **proof_jsons,
+        const char **sub_roots,
+        const char *in_key_hash,
+        const char **in_ciphertext,
+        const char *in_plaintext_root);
+
+    void contingent_verifier_close(
+        contingent_verifier_t *verifier);
+
+    // Number of blocks of the size class for a file of `num_blocks`, the
+    // next power of two
+    size_t contingent_size_class(
+        const size_t num_blocks);
+
+    // Open a registry of keys in `keys_dir` for the size classes of a circuit
+    // variant, CONTINGENT_CIRCUIT_PADDED is implied. Nothing is loaded until
+    // a class is first used.
+    contingent_registry_t *contingent_registry_open(
+        const char *keys_dir,
+        const unsigned int circuit);
+
+    // Generate the keys of the size class holding `num_data_blocks` with
+    // contingent_genkeys_ex(), unless they are in the directory already.
+    // This is the trusted setup of the class, run it on the prover's side
+    // only and hand out the verification key. Returns 0 on success.
+    int contingent_registry_genkeys(
+        contingent_registry_t *registry,
+        const size_t num_data_blocks);
+
+    // Prover and verifier of the size class holding `num_data_blocks`,
+    // loaded from the directory on first use, keys are never generated
+    // here. A verifier only needs the class's verification key. They stay
+    // in memory and are owned by the registry, use them with
+    // contingent_prover_prove_padded() and contingent_verifier_verify_padded().
+    // Returns NULL on failure.
+    contingent_prover_t *contingent_registry_prover(
+        contingent_registry_t *registry,
+        const size_t num_data_blocks);
+
+    contingent_verifier_t *contingent_registry_verifier(
+        contingent_registry_t *registry,
+        const size_t num_data_blocks);
+
+    void contingent_registry_close(
+        contingent_registry_t *registry);
+
 #ifdef __cplusplus
 } // extern "C" {
 #endif
@@ -0,0 +1,885 @@
+/*
+Copyright 2019 to the Miximus Authors
+
+This file is part of Miximus.
+
+Miximus is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Miximus is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Miximus.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <string>
+#include <iostream>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "contingent.cpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock ClockT;
+
+static double elapsed_ms(const ClockT::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(ClockT::now() - start).count();
+}
+
+/**
+* Random secret inputs, and the public inputs derived from them
+*/
+struct bench_inputs
+{
+    std::string key_hash;
+    std::vector<std::string> ciphertext;
+    std::string plaintext_root;
+    std::string key;
+    std::vector<std::string> plaintext;
+
+    std::vector<const char *> ciphertext_ptrs;
+    std::vector<const char *> plaintext_ptrs;
+
+    bench_inputs(ethsnarks::contingent_circuit &circuit)
+    {
+        const FieldT arg_key = FieldT::random_element();
+        std::vector<FieldT> arg_plaintext;
+        for (size_t i = 0; i < circuit.num_blocks; i++)
+            arg_plaintext.emplace_back(FieldT::random_element());
+
+        std::vector<uint8_t> arg_key_hash;
+        std::vector<FieldT> arg_ciphertext;
+        FieldT arg_plaintext_root;
+
+        auto inst = circuit.acquire();
+        inst->derive_public_inputs(arg_key, arg_plaintext, arg_key_hash, arg_ciphertext, arg_plaintext_root);
+        circuit.release(std::move(inst));
+
+        key_hash.assign(arg_key_hash.begin(), arg_key_hash.end());
+        plaintext_root = ethsnarks::field_to_decimal(arg_plaintext_root);
+        key = ethsnarks::field_to_decimal(arg_key);
+        for (size_t i = 0; i < circuit.num_blocks; i++)
+        {
+            ciphertext.emplace_back(ethsnarks::field_to_decimal(arg_ciphertext[i]));
+            plaintext.emplace_back(ethsnarks::field_to_decimal(arg_plaintext[i]));
+        }
+        for (size_t i = 0; i < circuit.num_blocks; i++)
+        {
+            ciphertext_ptrs.emplace_back(ciphertext[i].c_str());
+            plaintext_ptrs.emplace_back(plaintext[i].c_str());
+        }
+    }
+};
+
+/**
+* Per-proof cost before circuit templates: build the R1CS and the gadget
+* for every proof, then use the stock libsnark prover
+*/
+static char *prove_uncached(const ProvingKeyT &proving_key, const size_t num_blocks, const bench_inputs &in)
+{
+    std::vector<FieldT> arg_key_hash;
+    ethsnarks::key_hash_to_inputs(CONTINGENT_CIRCUIT_DEFAULT, (const uint8_t *)in.key_hash.data(), arg_key_hash);
+    std::vector<FieldT> arg_ciphertext;
+    std::vector<FieldT> arg_plaintext;
+    for (size_t i = 0; i < num_blocks; i++)
+    {
+        arg_ciphertext.emplace_back(in.ciphertext_ptrs[i]);
+        arg_plaintext.emplace_back(in.plaintext_ptrs[i]);
+    }
+
+    ProtoboardT pb;
+    ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget");
+    gadget.generate_r1cs_constraints();
+    gadget.generate_r1cs_witness(
+        arg_key_hash, arg_ciphertext, FieldT(in.plaintext_root.c_str()), FieldT(in.key.c_str()), arg_plaintext);
+
+    if (!pb.is_satisfied())
+        return nullptr;
+
+    auto proof = libsnark::r1cs_gg_ppzksnark_zok_prover<ethsnarks::ppT>(proving_key, pb.primary_input(), pb.auxiliary_input());
+    return ::strdup(proof_to_json(proof).c_str());
+}
+
+static int bench_prove(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << prog_name << " prove <pk.raw> <vk.json> <num_blocks> [num_proofs]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<pk.raw>         Proving key, generated if it doesn't exist" << endl;
+        cerr << "\t<vk.json>        Verification key, generated if it doesn't exist" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks" << endl;
+        cerr << "\t[num_proofs]     Proofs to make with each method (default 5)" << endl;
+        return 1;
+    }
+
+    const char *pk_file = argv[1];
+    const char *vk_file = argv[2];
+    const size_t num_blocks = std::stoi(argv[3]);
+    const size_t num_proofs = argc > 4 ? std::stoi(argv[4]) : 5;
+
+    if (num_proofs < 1)
+    {
+        cerr << "Error: num_proofs must be at least 1" << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    if (!std::ifstream(pk_file) || !std::ifstream(vk_file))
+    {
+        cerr << "Generating keys for " << num_blocks << " blocks" << endl;
+        if (0 != contingent_genkeys(num_blocks, pk_file, vk_file))
+        {
+            cerr << "Error: failed to generate proving and verifying keys" << endl;
+            return 1;
+        }
+    }
+
+    auto start = ClockT::now();
+    auto circuit = ethsnarks::contingent_circuit::get(num_blocks);
+    const double template_ms = elapsed_ms(start);
+    const bench_inputs inputs(*circuit);
+
+    contingent_prover_t *prover = contingent_prover_open(pk_file, num_blocks);
+    if (prover == nullptr)
+        return 1;
+
+    double uncached_ms = 0;
+    for (size_t i = 0; i < num_proofs; i++)
+    {
+        start = ClockT::now();
+        char *json = prove_uncached(prover->proving_key, num_blocks, inputs);
+        uncached_ms += elapsed_ms(start);
+        if (json == nullptr)
+        {
+            cerr << "Error: uncached proof failed" << endl;
+            return 1;
+        }
+        ::free(json);
+    }
+
+    double cached_ms = 0;
+    for (size_t i = 0; i < num_proofs; i++)
+    {
+        start = ClockT::now();
+        char *json = contingent_prover_prove(
+            prover,
+            inputs.key_hash.data(),
+            (const char **)inputs.ciphertext_ptrs.data(),
+            inputs.plaintext_root.c_str(),
+            inputs.key.c_str(),
+            (const char **)inputs.plaintext_ptrs.data());
+        cached_ms += elapsed_ms(start);
+        if (json == nullptr)
+        {
+            cerr << "Error: cached proof failed" << endl;
+            return 1;
+        }
+        ::free(json);
+    }
+
+    contingent_prover_close(prover);
+
+    uncached_ms /= num_proofs;
+    cached_ms /= num_proofs;
+
+    cout << "num_blocks:          " << num_blocks << endl;
+    cout << "constraints:         " << circuit->num_constraints << endl;
+    cout << "template build (ms): " << template_ms << endl;
+    cout << "uncached prove (ms): " << uncached_ms << endl;
+    cout << "cached prove (ms):   " << cached_ms << endl;
+    cout << "speedup:             " << (uncached_ms / cached_ms) << "x" << endl;
+
+    return 0;
+}
+
+/**
+* Constraint count and prove time of each circuit variant
+*/
+static int bench_variants(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << prog_name << " variants <keys-prefix> <num_blocks> [num_proofs]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<keys-prefix>    Keys are <keys-prefix>.<variant>.pk.raw and .vk.json, generated if they don't exist" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks" << endl;
+        cerr << "\t[num_proofs]     Proofs to make with each variant (default 5)" << endl;
+        return 1;
+    }
+
+    const std::string keys_prefix = argv[1];
+    const size_t num_blocks = std::stoi(argv[2]);
+    const size_t num_proofs = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    if (num_proofs < 1)
+    {
+        cerr << "Error: num_proofs must be at least 1" << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    const std::vector<std::pair<std::string, unsigned int>> variants = {
+        {"sha256", CONTINGENT_CIRCUIT_DEFAULT},
+        {"sha256-packed", CONTINGENT_CIRCUIT_PACKED_KEY_HASH},
+        {"sha256-packed+ciphertext-hash", CONTINGENT_CIRCUIT_PACKED_KEY_HASH | CONTINGENT_CIRCUIT_CIPHERTEXT_HASH},
+        {"mimc", CONTINGENT_CIRCUIT_MIMC_KEY},
+    };
+
+    cout << "num_blocks: " << num_blocks << endl;
+    cout << "variant\tconstraints\tvk points\tprove (ms)\tverify (ms)" << endl;
+
+    for (const auto &variant : variants)
+    {
+        const std::string pk_file = keys_prefix + "." + variant.first + ".pk.raw";
+        const std::string vk_file = keys_prefix + "." + variant.first + ".vk.json";
+
+        if (!std::ifstream(pk_file) || !std::ifstream(vk_file))
+        {
+            cerr << "Generating " << variant.first << " keys for " << num_blocks << " blocks" << endl;
+            if (0 != contingent_genkeys_ex(num_blocks, variant.second, pk_file.c_str(), vk_file.c_str()))
+            {
+                cerr << "Error: failed to generate proving and verifying keys" << endl;
+                return 1;
+            }
+        }
+
+        auto circuit = ethsnarks::contingent_circuit::get(num_blocks, variant.second);
+        const bench_inputs inputs(*circuit);
+
+        contingent_prover_t *prover = contingent_prover_open_ex(pk_file.c_str(), num_blocks, variant.second);
+        contingent_verifier_t *verifier = contingent_verifier_open_ex(vk_file.c_str(), num_blocks, variant.second);
+        if (prover == nullptr || verifier == nullptr)
+            return 1;
+
+        double prove_ms = 0;
+        double verify_ms = 0;
+        for (size_t i = 0; i < num_proofs; i++)
+        {
+            auto start = ClockT::now();
+            char *json = contingent_prover_prove(
+                prover,
+                inputs.key_hash.data(),
+                (const char **)inputs.ciphertext_ptrs.data(),
+                inputs.plaintext_root.c_str(),
+                inputs.key.c_str(),
+                (const char **)inputs.plaintext_ptrs.data());
+            prove_ms += elapsed_ms(start);
+            if (json == nullptr)
+            {
+                cerr << "Error: " << variant.first << " proof failed" << endl;
+                return 1;
+            }
+
+            start = ClockT::now();
+            const bool ok = contingent_verifier_verify(
+                verifier,
+                json,
+                inputs.key_hash.data(),
+                (const char **)inputs.ciphertext_ptrs.data(),
+                inputs.plaintext_root.c_str());
+            verify_ms += elapsed_ms(start);
+            ::free(json);
+            if (!ok)
+            {
+                cerr << "Error: " << variant.first << " proof doesn't verify" << endl;
+                return 1;
+            }
+        }
+
+        contingent_prover_close(prover);
+        contingent_verifier_close(verifier);
+
+        cout << variant.first << "\t" << circuit->num_constraints << "\t"
+             << (circuit->num_inputs + 1) << "\t"
+             << (prove_ms / num_proofs) << "\t" << (verify_ms / num_proofs) << endl;
+    }
+
+    return 0;
+}
+
+/**
+* Prove time against the number of prover threads, for several sizes
+*/
+static int bench_threads(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << prog_name << " threads <keys-prefix> <num_blocks,...> [max_threads] [num_proofs]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<keys-prefix>    Keys are <keys-prefix>.<num_blocks>.pk.raw and .vk.json, generated if they don't exist" << endl;
+        cerr << "\t<num_blocks,...> Comma separated numbers of data blocks" << endl;
+        cerr << "\t[max_threads]    Largest thread count, counts double up to it (default one per core)" << endl;
+        cerr << "\t[num_proofs]     Proofs to make for each thread count (default 3)" << endl;
+        return 1;
+    }
+
+    const std::string keys_prefix = argv[1];
+    std::vector<size_t> sizes;
+    std::stringstream sizes_stream(argv[2]);
+    std::string size;
+    while (std::getline(sizes_stream, size, ','))
+        sizes.emplace_back(std::stoi(size));
+    const size_t max_threads = argc > 3 ? std::stoi(argv[3]) : ethsnarks::resolve_num_threads(0);
+    const size_t num_proofs = argc > 4 ? std::stoi(argv[4]) : 3;
+
+    if (num_proofs < 1)
+    {
+        cerr << "Error: num_proofs must be at least 1" << endl;
+        return 1;
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t n = 1; n < max_threads; n *= 2)
+        thread_counts.emplace_back(n);
+    thread_counts.emplace_back(max_threads);
+
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    // One row per measurement, ready to be plotted, e.g. with gnuplot:
+    //   plot for [b in "32 128"] "out.tsv" using 2:($1==b ? $3 : 1/0) title b
+    cout << "num_blocks\tthreads\tprove (ms)\tspeedup" << endl;
+
+    for (const size_t num_blocks : sizes)
+    {
+        const std::string pk_file = keys_prefix + "." + std::to_string(num_blocks) + ".pk.raw";
+        const std::string vk_file = keys_prefix + "." + std::to_string(num_blocks) + ".vk.json";
+
+        if (!std::ifstream(pk_file) || !std::ifstream(vk_file))
+        {
+            cerr << "Generating keys for " << num_blocks << " blocks" << endl;
+            if (0 != contingent_genkeys(num_blocks, pk_file.c_str(), vk_file.c_str()))
+            {
+                cerr << "Error: failed to generate proving and verifying keys" << endl;
+                return 1;
+            }
+        }
+
+        auto circuit = ethsnarks::contingent_circuit::get(num_blocks);
+        const bench_inputs inputs(*circuit);
+
+        contingent_prover_t *prover = contingent_prover_open(pk_file.c_str(), num_blocks);
+        if (prover == nullptr)
+            return 1;
+
+        double single_ms = 0;
+        for (const size_t num_threads : thread_counts)
+        {
+            double prove_ms = 0;
+            for (size_t i = 0; i < num_proofs; i++)
+            {
+                const auto start = ClockT::now();
+                char *json = contingent_prover_prove_ex(
+                    prover,
+                    num_threads,
+                    inputs.key_hash.data(),
+                    (const char **)inputs.ciphertext_ptrs.data(),
+                    inputs.plaintext_root.c_str(),
+                    inputs.key.c_str(),
+                    (const char **)inputs.plaintext_ptrs.data());
+                prove_ms += elapsed_ms(start);
+                if (json == nullptr)
+                {
+                    cerr << "Error: proof failed" << endl;
+                    return 1;
+                }
+                ::free(json);
+            }
+            prove_ms /= num_proofs;
+            if (num_threads == 1)
+                single_ms = prove_ms;
+
+            cout << num_blocks << "\t" << num_threads << "\t" << prove_ms << "\t" << (single_ms / prove_ms) << endl;
+        }
+
+        contingent_prover_close(prover);
+    }
+
+    return 0;
+}
+
+/**
+* Result of running a step in a child process, its time and the peak RSS of
+* the child alone
+*/
+struct child_result
+{
+    bool ok;
+    double ms;
+    long peak_rss_kb;
+};
+
+/**
+* Run `fn` in a forked child, which starts from the memory of this process,
+* so nothing large may be allocated here before. `fn` fills in `out_value`,
+* a plain struct sent back through a pipe, and returns false on failure.
+* Returns the peak RSS of the child alone, negative when it failed.
+*/
+template <typename T, typename Fn>
+static long run_in_child_with(const Fn &fn, T &out_value)
+{
+    int fds[2];
+    if (0 != ::pipe(fds))
+        return -1;
+
+    const pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        bool ok = false;
+        try
+        {
+            ok = fn(out_value);
+        }
+        catch (const std::exception &ex)
+        {
+            cerr << "Error: " << ex.what() << endl;
+        }
+        const bool written = sizeof(out_value) == ::write(fds[1], &out_value, sizeof(out_value));
+        ::_exit(written && ok ? 0 : 1);
+    }
+
+    ::close(fds[1]);
+    const bool read_ok = sizeof(out_value) == ::read(fds[0], &out_value, sizeof(out_value));
+    ::close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if (pid != ::wait4(pid, &status, 0, &usage))
+        return -1;
+
+    if (!read_ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return usage.ru_maxrss;
+}
+
+/**
+* run_in_child_with() for a step which returns its time in milliseconds, or
+* a negative value on failure
+*/
+template <typename Fn>
+static child_result run_in_child(const Fn &fn)
+{
+    child_result result = {false, 0, 0};
+    const long peak_rss_kb = run_in_child_with([&](double &out_ms) {
+        out_ms = fn();
+        return out_ms >= 0;
+    }, result.ms);
+    result.ok = peak_rss_kb >= 0;
+    result.peak_rss_kb = result.ok ? peak_rss_kb : 0;
+    return result;
+}
+
+/**
+* Time of each phase against the number of blocks, for regression tracking
+*/
+struct sweep_result
+{
+    size_t num_blocks;
+    size_t num_constraints;
+    size_t num_variables;
+    double constraints_ms;
+    double witness_ms;
+    double keygen_ms;
+    double key_load_ms;
+    double prove_ms;
+    double verify_ms;
+    long peak_rss_kb;
+};
+
+static void write_sweep_json(std::ostream &out, const std::vector<sweep_result> &results)
+{
+    out << "{\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const sweep_result &r = results[i];
+        out << (i ? "," : "") << "\n    {"
+            << "\"num_blocks\": " << r.num_blocks << ", "
+            << "\"constraints\": " << r.num_constraints << ", "
+            << "\"variables\": " << r.num_variables << ", "
+            << "\"constraints_ms\": " << r.constraints_ms << ", "
+            << "\"witness_ms\": " << r.witness_ms << ", "
+            << "\"keygen_ms\": " << r.keygen_ms << ", "
+            << "\"key_load_ms\": " << r.key_load_ms << ", "
+            << "\"prove_ms\": " << r.prove_ms << ", "
+            << "\"verify_ms\": " << r.verify_ms << ", "
+            << "\"peak_rss_kb\": " << r.peak_rss_kb << "}";
+    }
+    out << "\n  ]\n}" << endl;
+}
+
+static int bench_sweep(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << prog_name << " sweep <keys-prefix> <min_blocks> <max_blocks> [num_proofs] [results.json]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<keys-prefix>    Keys are written to <keys-prefix>.<num_blocks>.pk.raw and .vk.json" << endl;
+        cerr << "\t<min_blocks>     Smallest number of data blocks" << endl;
+        cerr << "\t<max_blocks>     Largest number of data blocks, sizes double from min_blocks" << endl;
+        cerr << "\t[num_proofs]     Proofs to make and verify for each size (default 3)" << endl;
+        cerr << "\t[results.json]   Write the results here as JSON" << endl;
+        return 1;
+    }
+
+    const std::string keys_prefix = argv[1];
+    const size_t min_blocks = std::stoi(argv[2]);
+    const size_t max_blocks = std::stoi(argv[3]);
+    const size_t num_proofs = argc > 4 ? std::stoi(argv[4]) : 3;
+    const char *json_file = argc > 5 ? argv[5] : nullptr;
+
+    if (min_blocks < 1 || max_blocks < min_blocks)
+    {
+        cerr << "Invalid range of blocks: " << min_blocks << " to " << max_blocks << endl;
+        return 1;
+    }
+
+    if (num_proofs < 1)
+    {
+        cerr << "Error: num_proofs must be at least 1" << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    std::vector<sweep_result> results;
+    cout << "num_blocks\tconstraints\tconstraints (ms)\twitness (ms)\tkeygen (ms)\tkey load (ms)\tprove (ms)\tverify (ms)\tpeak rss (kB)" << endl;
+
+    for (size_t num_blocks = min_blocks; num_blocks <= max_blocks; num_blocks *= 2)
+    {
+        const std::string pk_file = keys_prefix + "." + std::to_string(num_blocks) + ".pk.raw";
+        const std::string vk_file = keys_prefix + "." + std::to_string(num_blocks) + ".vk.json";
+
+        // Each size runs in its own child, so the peak RSS is that size's
+        // alone rather than the largest one so far
+        sweep_result r;
+        const long peak_rss_kb = run_in_child_with([&](sweep_result &out) {
+            out.num_blocks = num_blocks;
+
+            auto start = ClockT::now();
+            {
+                ProtoboardT pb;
+                ethsnarks::contingent_gadget gadget(pb, num_blocks, "contingent_gadget");
+                gadget.generate_r1cs_constraints();
+                out.num_constraints = pb.num_constraints();
+                out.num_variables = pb.num_variables();
+            }
+            out.constraints_ms = elapsed_ms(start);
+
+            auto circuit = ethsnarks::contingent_circuit::get(num_blocks);
+            const bench_inputs inputs(*circuit);
+
+            std::vector<FieldT> plaintext;
+            for (size_t i = 0; i < num_blocks; i++)
+                plaintext.emplace_back(inputs.plaintext_ptrs[i]);
+            std::vector<uint8_t> key_hash;
+            std::vector<FieldT> ciphertext;
+            FieldT plaintext_root;
+            auto inst = circuit->acquire();
+            start = ClockT::now();
+            inst->derive_public_inputs(FieldT(inputs.key.c_str()), plaintext, key_hash, ciphertext, plaintext_root);
+            out.witness_ms = elapsed_ms(start);
+            circuit->release(std::move(inst));
+
+            start = ClockT::now();
+            if (0 != contingent_genkeys(num_blocks, pk_file.c_str(), vk_file.c_str()))
+            {
+                cerr << "Error: failed to generate proving and verifying keys" << endl;
+                return false;
+            }
+            out.keygen_ms = elapsed_ms(start);
+
+            start = ClockT::now();
+            contingent_prover_t *prover = contingent_prover_open(pk_file.c_str(), num_blocks);
+            out.key_load_ms = elapsed_ms(start);
+            contingent_verifier_t *verifier = contingent_verifier_open(vk_file.c_str());
+            if (prover == nullptr || verifier == nullptr)
+                return false;
+
+            out.prove_ms = 0;
+            out.verify_ms = 0;
+            for (size_t i = 0; i < num_proofs; i++)
+            {
+                start = ClockT::now();
+                char *json = contingent_prover_prove(
+                    prover,
+                    inputs.key_hash.data(),
+                    (const char **)inputs.ciphertext_ptrs.data(),
+                    inputs.plaintext_root.c_str(),
+                    inputs.key.c_str(),
+                    (const char **)inputs.plaintext_ptrs.data());
+                out.prove_ms += elapsed_ms(start);
+                if (json == nullptr)
+                {
+                    cerr << "Error: proof failed" << endl;
+                    return false;
+                }
+
+                start = ClockT::now();
+                const bool ok = contingent_verifier_verify(
+                    verifier,
+                    json,
+                    inputs.key_hash.data(),
+                    (const char **)inputs.ciphertext_ptrs.data(),
+                    inputs.plaintext_root.c_str());
+                out.verify_ms += elapsed_ms(start);
+                ::free(json);
+                if (!ok)
+                {
+                    cerr << "Error: proof doesn't verify" << endl;
+                    return false;
+                }
+            }
+            out.prove_ms /= num_proofs;
+            out.verify_ms /= num_proofs;
+
+            contingent_prover_close(prover);
+            contingent_verifier_close(verifier);
+            return true;
+        }, r);
+
+        if (peak_rss_kb < 0)
+        {
+            cerr << "Error: sweep of " << num_blocks << " blocks failed" << endl;
+            return 1;
+        }
+        r.peak_rss_kb = peak_rss_kb;
+        results.emplace_back(r);
+
+        cout << r.num_blocks << "\t" << r.num_constraints << "\t" << r.constraints_ms << "\t"
+             << r.witness_ms << "\t" << r.keygen_ms << "\t" << r.key_load_ms << "\t"
+             << r.prove_ms << "\t" << r.verify_ms << "\t" << r.peak_rss_kb << endl;
+    }
+
+    if (json_file != nullptr)
+    {
+        std::ofstream json_out(json_file);
+        if (!json_out)
+        {
+            cerr << "Error: cannot write " << json_file << endl;
+            return 1;
+        }
+        write_sweep_json(json_out, results);
+    }
+
+    return 0;
+}
+
+/**
+* Peak memory of opening a prover and making one proof against the number of
+* blocks, with the default and the lean proving mode
+*/
+struct memory_result
+{
+    size_t num_blocks;
+    long default_peak_rss_kb;
+    long lean_peak_rss_kb;
+    double default_prove_ms;
+    double lean_prove_ms;
+};
+
+static void write_memory_json(std::ostream &out, const std::vector<memory_result> &results)
+{
+    out << "{\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const memory_result &r = results[i];
+        out << (i ? "," : "") << "\n    {"
+            << "\"num_blocks\": " << r.num_blocks << ", "
+            << "\"default_peak_rss_kb\": " << r.default_peak_rss_kb << ", "
+            << "\"lean_peak_rss_kb\": " << r.lean_peak_rss_kb << ", "
+            << "\"default_prove_ms\": " << r.default_prove_ms << ", "
+            << "\"lean_prove_ms\": " << r.lean_prove_ms << "}";
+    }
+    out << "\n  ]\n}" << endl;
+}
+
+static int bench_memory(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << prog_name << " memory <keys-prefix> <min_blocks> <max_blocks> [results.json]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<keys-prefix>    Keys are <keys-prefix>.<num_blocks>.pk.map and .vk.json, generated if they don't exist" << endl;
+        cerr << "\t<min_blocks>     Smallest number of data blocks" << endl;
+        cerr << "\t<max_blocks>     Largest number of data blocks, sizes double from min_blocks" << endl;
+        cerr << "\t[results.json]   Write the results here as JSON" << endl;
+        return 1;
+    }
+
+    const std::string keys_prefix = argv[1];
+    const size_t min_blocks = std::stoi(argv[2]);
+    const size_t max_blocks = std::stoi(argv[3]);
+    const char *json_file = argc > 4 ? argv[4] : nullptr;
+
+    if (min_blocks < 1 || max_blocks < min_blocks)
+    {
+        cerr << "Invalid range of blocks: " << min_blocks << " to " << max_blocks << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+    libff::inhibit_profiling_info = true;
+    libff::inhibit_profiling_counters = true;
+
+    // Every key generation and proof runs in a child of its own, so each
+    // peak is that of one mode and size only
+    std::vector<memory_result> results;
+    cout << "num_blocks\tdefault peak rss (kB)\tlean peak rss (kB)\tdefault prove (ms)\tlean prove (ms)" << endl;
+
+    for (size_t num_blocks = min_blocks; num_blocks <= max_blocks; num_blocks *= 2)
+    {
+        const std::string pk_file = keys_prefix + "." + std::to_string(num_blocks) + ".pk.map";
+        const std::string vk_file = keys_prefix + "." + std::to_string(num_blocks) + ".vk.json";
+
+        if (!std::ifstream(pk_file) || !std::ifstream(vk_file))
+        {
+            cerr << "Generating keys for " << num_blocks << " blocks" << endl;
+            const child_result keygen = run_in_child([&]() -> double {
+                return contingent_genkeys(num_blocks, pk_file.c_str(), vk_file.c_str()) == 0 ? 0 : -1;
+            });
+            if (!keygen.ok)
+            {
+                cerr << "Error: failed to generate proving and verifying keys" << endl;
+                return 1;
+            }
+        }
+
+        // Inputs from the native functions, laying out the circuit here
+        // would count towards the peak of both children
+        const FieldT key = FieldT::random_element();
+        std::vector<FieldT> plaintext;
+        for (size_t i = 0; i < num_blocks; i++)
+            plaintext.emplace_back(FieldT::random_element());
+        const std::vector<uint8_t> key_hash = ethsnarks::contingent_key_hash(key, CONTINGENT_CIRCUIT_DEFAULT);
+        const std::vector<FieldT> ciphertext = ethsnarks::mimc_encrypt(key, plaintext);
+        const std::string plaintext_root = ethsnarks::field_to_decimal(ethsnarks::mimc_merkle_root(plaintext));
+        const std::string key_decimal = ethsnarks::field_to_decimal(key);
+
+        std::vector<std::string> ciphertext_decimal, plaintext_decimal;
+        for (size_t i = 0; i < num_blocks; i++)
+        {
+            ciphertext_decimal.emplace_back(ethsnarks::field_to_decimal(ciphertext[i]));
+            plaintext_decimal.emplace_back(ethsnarks::field_to_decimal(plaintext[i]));
+        }
+        std::vector<const char *> ciphertext_ptrs, plaintext_ptrs;
+        for (size_t i = 0; i < num_blocks; i++)
+        {
+            ciphertext_ptrs.emplace_back(ciphertext_decimal[i].c_str());
+            plaintext_ptrs.emplace_back(plaintext_decimal[i].c_str());
+        }
+
+        auto prove_once = [&](const bool lean) -> double {
+            contingent_set_lean_proving(lean);
+            contingent_prover_t *prover = contingent_prover_open(pk_file.c_str(), num_blocks);
+            if (prover == nullptr)
+                return -1;
+
+            const auto start = ClockT::now();
+            char *json = contingent_prover_prove(
+                prover,
+                (const char *)key_hash.data(),
+                ciphertext_ptrs.data(),
+                plaintext_root.c_str(),
+                key_decimal.c_str(),
+                plaintext_ptrs.data());
+            const double ms = elapsed_ms(start);
+            contingent_prover_close(prover);
+            if (json == nullptr)
+                return -1;
+            ::free(json);
+            return ms;
+        };
+
+        const child_result full = run_in_child([&]() { return prove_once(false); });
+        const child_result lean = run_in_child([&]() { return prove_once(true); });
+        if (!full.ok || !lean.ok)
+        {
+            cerr << "Error: proof failed" << endl;
+            return 1;
+        }
+
+        const memory_result r = {num_blocks, full.peak_rss_kb, lean.peak_rss_kb, full.ms, lean.ms};
+        results.emplace_back(r);
+
+        cout << r.num_blocks << "\t" << r.default_peak_rss_kb << "\t" << r.lean_peak_rss_kb << "\t"
+             << r.default_prove_ms << "\t" << r.lean_prove_ms << endl;
+    }
+
+    if (json_file != nullptr)
+    {
+        std::ofstream json_out(json_file);
+        if (!json_out)
+        {
+            cerr << "Error: cannot write " << json_file << endl;
+            return 1;
+        }
+        write_memory_json(json_out, results);
+    }
+
+    return 0;
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <prove|variants|threads|sweep|memory> [...]" << endl;
+        return 1;
+    }
+
+    const std::string arg_cmd(argv[1]);
+
+    if (arg_cmd == "prove")
+    {
+        return bench_prove(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "variants")
+    {
+        return bench_variants(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "threads")
+    {
+        return bench_threads(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "sweep")
+    {
+        return bench_sweep(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "memory")
+    {
+        return bench_memory(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+
+    cerr << "Error: unknown benchmark " << arg_cmd << endl;
+    return 2;
+}
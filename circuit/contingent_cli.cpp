@@ -21,8 +21,10 @@ along with Miximus.  If not, see <https://www.gnu.org/licenses/>.
 #include <cstring>
 #include <iostream> // cerr
 #include <fstream>  // ofstream
+#include <memory>
 
 #include "contingent.cpp"
+#include "contingent_serve.hpp"
 #include "stubs.hpp"
 #include "utils.hpp" // hex_to_bytes
 
@@ -32,9 +34,16 @@ using std::endl;
 using std::ofstream;
 
 using ethsnarks::contingent_gadget;
+using ethsnarks::parse_circuit;
 using ethsnarks::stub_main_genkeys;
 using ethsnarks::stub_main_verify;
 
+// Circuit variant selected with --circuit, see CONTINGENT_CIRCUIT_*
+static unsigned int g_circuit = CONTINGENT_CIRCUIT_DEFAULT;
+
+// Print the statistics of the last API call to stderr, set with --stats
+static bool g_stats = false;
+
 int char2int(char input)
 {
     if (input >= '0' && input <= '9')
@@ -57,11 +66,25 @@ void hex2bin(const char *src, char *target)
     }
 }
 
+/**
+* Progress of key generation on stderr, one line per section
+*/
+static void print_progress(const char *stage, uint64_t done, uint64_t total, void *)
+{
+    cerr << "\r" << stage << ": " << done << "/" << total << " (" << (total ? (100 * done / total) : 100) << "%)";
+    if (done == total)
+        cerr << endl;
+}
+
 int main_genkeys(const char *prog_name, int argc, const char **argv)
 {
     if (argc < 3)
     {
         cerr << "Usage: " << prog_name << " " << argv[0] << " <pk.raw> <vk.json> <num_blocks>" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<pk.raw>         Write proving key here, in the sectioned layout (copied into memory on load) if it ends with .map" << endl;
+        cerr << "\t<vk.json>        Write verification key here" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks" << endl;
         return 1;
     }
 
@@ -69,7 +92,10 @@ int main_genkeys(const char *prog_name, int argc, const char **argv)
     const char *vk_file = argv[2];
     size_t num_blocks = std::stoi(argv[3]);
 
-    if (0 != contingent_genkeys(num_blocks, pk_file, vk_file))
+    const int result = has_suffix(pk_file, ".map")
+        ? contingent_genkeys_mapped(num_blocks, g_circuit, pk_file, vk_file, 0, print_progress, nullptr)
+        : contingent_genkeys_ex(num_blocks, g_circuit, pk_file, vk_file);
+    if (0 != result)
     {
         cerr << "Error: failed to generate proving and verifying keys" << endl;
         return 1;
@@ -78,21 +104,661 @@ int main_genkeys(const char *prog_name, int argc, const char **argv)
     return 0;
 }
 
+/**
+* Generate the keys of the size classes for the given file sizes, the ones
+* already in the directory are only checked to load
+*/
+static int main_keys(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << prog_name << " " << argv[0] << " <keys-dir> <num_blocks>..." << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<keys-dir>       Directory of the size class keys, see contingent_registry_open()" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks of a file, its size class is the next power of two" << endl;
+        return 1;
+    }
+
+    contingent_registry_t *registry = contingent_registry_open(argv[1], g_circuit);
+    int result = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        const size_t num_blocks = std::stoul(argv[i]);
+        if (0 != contingent_registry_genkeys(registry, num_blocks)
+         || contingent_registry_prover(registry, num_blocks) == nullptr
+         || contingent_registry_verifier(registry, num_blocks) == nullptr)
+        {
+            cerr << "Error: no keys for " << num_blocks << " blocks" << endl;
+            result = 1;
+            continue;
+        }
+        cout << num_blocks << " blocks: size class " << contingent_size_class(num_blocks) << endl;
+    }
+    contingent_registry_close(registry);
+
+    return result;
+}
+
+/**
+* Bytes of an inputs file, mapped, or read from stdin when the path is "-"
+*/
+struct input_bytes
+{
+    std::unique_ptr<ethsnarks::mapped_file> mapping;
+    std::string buffer;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
+
+static bool read_input_bytes(const char *path, input_bytes &out)
+{
+    if (std::string(path) == "-")
+    {
+        std::stringstream stream;
+        stream << std::cin.rdbuf();
+        out.buffer = stream.str();
+        out.data = (const uint8_t *)out.buffer.data();
+        out.size = out.buffer.size();
+        return true;
+    }
+
+    try
+    {
+        out.mapping.reset(new ethsnarks::mapped_file(path));
+    }
+    catch (const std::exception &ex)
+    {
+        cerr << "Error: " << ex.what() << endl;
+        return false;
+    }
+    out.data = out.mapping->data;
+    out.size = out.mapping->size;
+    return true;
+}
+
+/**
+* Number of blocks of a binary inputs file holding `num_fixed` single
+* fields and `num_per_block` fields per block, 0 if its size doesn't match
+*/
+static size_t binary_inputs_num_blocks(const input_bytes &input, const size_t num_fixed, const size_t num_per_block)
+{
+    const size_t fixed_size = 32 * num_fixed;
+    const size_t block_size = 32 * num_per_block;
+    if (input.size <= fixed_size || (input.size - fixed_size) % block_size != 0)
+    {
+        cerr << "Error: " << input.size << " bytes of inputs isn't " << fixed_size << " plus a multiple of " << block_size << endl;
+        return 0;
+    }
+    return (input.size - fixed_size) / block_size;
+}
+
+static bool read_proof_file(const char *proof_file, std::string &out_data)
+{
+    std::ifstream proof_input(proof_file, std::ios::binary);
+    if (!proof_input)
+    {
+        cerr << "Error: cannot open " << proof_file << endl;
+        return false;
+    }
+    std::stringstream proof_stream;
+    proof_stream << proof_input.rdbuf();
+    out_data = proof_stream.str();
+    return true;
+}
+
+static int prove_to_file(
+    const char *pk_file,
+    const char *proof_filename,
+    size_t num_blocks,
+    unsigned int circuit,
+    const char *key_hash,
+    const char **ciphertext,
+    const char *plaintext_root,
+    const char *key,
+    const char **plaintext)
+{
+    contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, circuit);
+    if (prover == nullptr)
+        return 1;
+    std::unique_ptr<contingent_prover_t, void (*)(contingent_prover_t *)> prover_guard(prover, contingent_prover_close);
+
+    ofstream fh;
+    if (has_suffix(proof_filename, ".bin"))
+    {
+        uint8_t proof[CONTINGENT_PROOF_BINARY_SIZE];
+        const size_t proof_size = contingent_prover_prove_binary(
+            prover,
+            key_hash,
+            ciphertext,
+            plaintext_root,
+            key,
+            plaintext,
+            proof,
+            sizeof(proof));
+
+        if (proof_size == 0)
+            return 1;
+
+        fh.open(proof_filename, std::ios::binary);
+        fh.write((const char *)proof, proof_size);
+    }
+    else
+    {
+        auto json = contingent_prover_prove(
+            prover,
+            key_hash,
+            ciphertext,
+            plaintext_root,
+            key,
+            plaintext);
+
+        if (json == nullptr)
+            return 1;
+
+        fh.open(proof_filename, std::ios::binary);
+        fh << json;
+        ::free(json);
+    }
+    fh.flush();
+    fh.close();
+
+    return 0;
+}
+
+static int verify_file(
+    const char *vk_file,
+    const char *proof_file,
+    size_t num_blocks,
+    unsigned int circuit,
+    const char *key_hash,
+    const char **ciphertext,
+    const char *plaintext_root)
+{
+    std::string proof_data;
+    if (!read_proof_file(proof_file, proof_data))
+        return 2;
+
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, circuit);
+    if (verifier == nullptr)
+        return 1;
+    std::unique_ptr<contingent_verifier_t, void (*)(contingent_verifier_t *)> verifier_guard(verifier, contingent_verifier_close);
+
+    bool result;
+    if (ethsnarks::is_binary_encoding((const uint8_t *)proof_data.data(), proof_data.size(), ethsnarks::BINARY_KIND_PROOF))
+    {
+        result = contingent_verifier_verify_binary(
+            verifier,
+            (const uint8_t *)proof_data.data(),
+            proof_data.size(),
+            key_hash,
+            ciphertext,
+            plaintext_root);
+    }
+    else
+    {
+        result = contingent_verifier_verify(
+            verifier,
+            proof_data.c_str(),
+            key_hash,
+            ciphertext,
+            plaintext_root);
+    }
+
+    if (result)
+        cout << "Verification Passed!" << endl;
+    else
+        cerr << "Verification Failed!" << endl;
+
+    return 0;
+}
+
+/**
+* Public and secret inputs of a file written by `encrypt`, as the decimal
+* strings taken by the C API
+*/
+struct encrypted_inputs
+{
+    ethsnarks::encrypted_file_info info;
+    std::vector<std::string> ciphertext;
+    std::vector<std::string> plaintext;
+    std::string plaintext_root;
+    std::string key;
+
+    std::vector<const char *> ciphertext_ptrs() const { return c_strs(ciphertext); }
+    std::vector<const char *> plaintext_ptrs() const { return c_strs(plaintext); }
+
+    static std::vector<const char *> c_strs(const std::vector<std::string> &values)
+    {
+        std::vector<const char *> ptrs;
+        ptrs.reserve(values.size());
+        for (const auto &value : values)
+            ptrs.emplace_back(value.c_str());
+        return ptrs;
+    }
+};
+
+static bool load_encrypted_inputs(const std::string &prefix, bool with_secrets, encrypted_inputs &out)
+{
+    if (!ethsnarks::read_encrypted_file_info(prefix + ".json", out.info))
+        return false;
+
+    std::ifstream ct_input(out.info.ciphertext_file, std::ios::binary);
+    std::vector<ethsnarks::FieldT> ciphertext;
+    if (!ct_input || !ethsnarks::read_field_elements(ct_input, out.info.num_blocks, ciphertext))
+    {
+        cerr << "Error: cannot read " << out.info.num_blocks << " blocks from " << out.info.ciphertext_file << endl;
+        return false;
+    }
+    for (const auto &block : ciphertext)
+        out.ciphertext.emplace_back(ethsnarks::field_to_decimal(block));
+    out.plaintext_root = ethsnarks::field_to_decimal(out.info.plaintext_root);
+
+    if (!with_secrets)
+        return true;
+
+    ethsnarks::FieldT key;
+    if (!ethsnarks::read_file_key(prefix + ".key.json", key))
+        return false;
+    out.key = ethsnarks::field_to_decimal(key);
+
+    std::ifstream input(out.info.input_file, std::ios::binary);
+    if (!input)
+    {
+        cerr << "Error: cannot open " << out.info.input_file << endl;
+        return false;
+    }
+    std::vector<ethsnarks::FieldT> plaintext;
+    ethsnarks::read_file_blocks(input, out.info.num_blocks, plaintext);
+    for (const auto &block : plaintext)
+        out.plaintext.emplace_back(ethsnarks::field_to_decimal(block));
+
+    return true;
+}
+
+static int main_encrypt(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 3)
+    {
+    arg_error:
+        cerr << "Usage: " << prog_name << " encrypt <input> <prefix> [--key <key>] [--blocks <num_blocks>] [--threads <num_threads>]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<input>          File to encrypt" << endl;
+        cerr << "\t<prefix>         Write <prefix>.json, <prefix>.key.json and <prefix>.ct" << endl;
+        cerr << "\t<key>            MiMC encryption key, random if not given" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks, the next power of two that fits the input by default" << endl;
+        cerr << "\t<num_threads>    Threads to encrypt and hash with, 0 for all cores" << endl;
+        return 1;
+    }
+
+    const std::string input_file(argv[1]);
+    const std::string prefix(argv[2]);
+    const char *arg_key = nullptr;
+    size_t num_blocks = 0;
+    size_t num_threads = 0;
+    for (int i = 3; i < argc; i += 2)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+            goto arg_error;
+        if (option == "--key")
+            arg_key = argv[i + 1];
+        else if (option == "--blocks")
+            num_blocks = std::stoul(argv[i + 1]);
+        else if (option == "--threads")
+            num_threads = std::stoul(argv[i + 1]);
+        else
+            goto arg_error;
+    }
+
+    ppT::init_public_params();
+
+    const auto key = arg_key ? ethsnarks::FieldT(arg_key) : ethsnarks::FieldT::random_element();
+
+    ethsnarks::encrypted_file_info info;
+    if (!ethsnarks::encrypt_file(input_file, prefix, key, num_blocks, g_circuit, num_threads, info))
+        return 1;
+
+    cout << info.size << " bytes -> " << info.num_blocks << " blocks" << endl;
+    cout << "key_hash: " << ethsnarks::bytes_to_hex_string(info.key_hash) << endl;
+    cout << "plaintext_root: " << ethsnarks::field_to_decimal(info.plaintext_root) << endl;
+
+    return 0;
+}
+
+static int main_prove_encrypted(const char *prog_name, int argc, const char **argv)
+{
+    if (argc != 5)
+    {
+        cerr << "Usage: " << prog_name << " prove <pk.raw> <proof.json> --encrypted <prefix>" << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+
+    encrypted_inputs inputs;
+    if (!load_encrypted_inputs(argv[4], true, inputs))
+        return 1;
+
+    const auto ciphertext = inputs.ciphertext_ptrs();
+    const auto plaintext = inputs.plaintext_ptrs();
+    return prove_to_file(
+        argv[1], argv[2], inputs.info.num_blocks, inputs.info.circuit,
+        (const char *)inputs.info.key_hash.data(), ciphertext.data(),
+        inputs.plaintext_root.c_str(), inputs.key.c_str(), plaintext.data());
+}
+
+static int main_verify_encrypted(const char *prog_name, int argc, const char **argv)
+{
+    if (argc != 5)
+    {
+        cerr << "Usage: " << prog_name << " verify <vk.json> <proof.json> --encrypted <prefix>" << endl;
+        return 1;
+    }
+
+    ppT::init_public_params();
+
+    encrypted_inputs inputs;
+    if (!load_encrypted_inputs(argv[4], false, inputs))
+        return 1;
+
+    const auto ciphertext = inputs.ciphertext_ptrs();
+    return verify_file(
+        argv[1], argv[2], inputs.info.num_blocks, inputs.info.circuit,
+        (const char *)inputs.info.key_hash.data(), ciphertext.data(),
+        inputs.plaintext_root.c_str());
+}
+
+/**
+* prove with a binary inputs file: the key hash, ciphertext, plaintext root,
+* key and plaintext in the order of the command line arguments. The key hash
+* is its 32 bytes as given in hex on the command line (the SHA256 digest, or
+* the big-endian MiMC commitment, see key_hash_to_inputs()), every other
+* field element is 32 little-endian bytes.
+*/
+static int main_prove_inputs(const char *pk_file, const char *proof_filename, const char *inputs_file)
+{
+    ppT::init_public_params();
+
+    input_bytes input;
+    if (!read_input_bytes(inputs_file, input))
+        return 1;
+    const size_t num_blocks = binary_inputs_num_blocks(input, 3, 2);
+    if (num_blocks == 0)
+        return 1;
+
+    contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, g_circuit);
+    if (prover == nullptr)
+        return 1;
+    std::unique_ptr<contingent_prover_t, void (*)(contingent_prover_t *)> prover_guard(prover, contingent_prover_close);
+
+    const uint8_t *key_hash = input.data;
+    const uint8_t *ciphertext = key_hash + 32;
+    const uint8_t *plaintext_root = ciphertext + (32 * num_blocks);
+    const uint8_t *key = plaintext_root + 32;
+    const uint8_t *plaintext = key + 32;
+
+    ethsnarks::stats_call stats("prove");
+    ProofT proof;
+    std::string error;
+    if (!prover_prove_raw(prover, num_blocks, (const char *)key_hash, ciphertext, plaintext_root, key, plaintext, prover->budget, proof, error))
+    {
+        cerr << error << endl;
+        return 1;
+    }
+
+    ofstream fh(proof_filename, std::ios::binary);
+    if (has_suffix(proof_filename, ".bin"))
+    {
+        const auto encoded = ethsnarks::encode_proof(proof);
+        fh.write((const char *)encoded.data(), encoded.size());
+    }
+    else
+    {
+        fh << proof_to_json(proof);
+    }
+    return fh.good() ? 0 : 1;
+}
+
+/**
+* verify with a binary inputs file: the key hash, ciphertext and plaintext
+* root, laid out as for main_prove_inputs()
+*/
+static int main_verify_inputs(const char *vk_file, const char *proof_file, const char *inputs_file)
+{
+    ppT::init_public_params();
+
+    std::string proof_data;
+    if (!read_proof_file(proof_file, proof_data))
+        return 2;
+
+    input_bytes input;
+    if (!read_input_bytes(inputs_file, input))
+        return 1;
+    const size_t num_blocks = binary_inputs_num_blocks(input, 2, 1);
+    if (num_blocks == 0)
+        return 1;
+
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, g_circuit);
+    if (verifier == nullptr)
+        return 1;
+    std::unique_ptr<contingent_verifier_t, void (*)(contingent_verifier_t *)> verifier_guard(verifier, contingent_verifier_close);
+
+    // The raw functions take the proof as JSON
+    if (ethsnarks::is_binary_encoding((const uint8_t *)proof_data.data(), proof_data.size(), ethsnarks::BINARY_KIND_PROOF))
+    {
+        ProofT proof;
+        if (!ethsnarks::decode_proof((const uint8_t *)proof_data.data(), proof_data.size(), proof))
+        {
+            cerr << "Error: invalid binary proof" << endl;
+            return 1;
+        }
+        proof_data = proof_to_json(proof);
+    }
+
+    const uint8_t *key_hash = input.data;
+    const uint8_t *ciphertext = key_hash + 32;
+    const uint8_t *plaintext_root = ciphertext + (32 * num_blocks);
+    if (contingent_verifier_verify_raw(verifier, proof_data.c_str(), (const char *)key_hash, ciphertext, plaintext_root))
+        cout << "Verification Passed!" << endl;
+    else
+        cerr << "Verification Failed!" << endl;
+
+    return 0;
+}
+
+/**
+* Inputs given as a JSON document, the field elements as decimal strings:
+*
+*   {"key_hash": "<hex>", "ciphertext": [...], "plaintext_root": "...",
+*    "key": "...", "plaintext": [...]}
+*
+* The key and plaintext are only read when proving.
+*/
+struct json_inputs
+{
+    std::vector<uint8_t> key_hash;
+    std::vector<std::string> ciphertext;
+    std::string plaintext_root;
+    std::string key;
+    std::vector<std::string> plaintext;
+};
+
+static bool read_json_inputs(const char *inputs_file, const bool with_secrets, json_inputs &out)
+{
+    input_bytes input;
+    if (!read_input_bytes(inputs_file, input))
+        return false;
+
+    try
+    {
+        std::stringstream stream(std::string((const char *)input.data, input.size));
+        ethsnarks::PropertyTreeT tree;
+        read_json(stream, tree);
+
+        if (!ethsnarks::hex_string_to_bytes(tree.get<std::string>("key_hash"), out.key_hash) || out.key_hash.size() != 32)
+        {
+            cerr << "Error: invalid key hash" << endl;
+            return false;
+        }
+        for (const auto &item : tree.get_child("ciphertext"))
+            out.ciphertext.emplace_back(item.second.data());
+        out.plaintext_root = tree.get<std::string>("plaintext_root");
+
+        if (with_secrets)
+        {
+            out.key = tree.get<std::string>("key");
+            for (const auto &item : tree.get_child("plaintext"))
+                out.plaintext.emplace_back(item.second.data());
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        cerr << "Error: cannot read inputs from " << inputs_file << ": " << ex.what() << endl;
+        return false;
+    }
+
+    if (out.ciphertext.empty() || (with_secrets && out.plaintext.size() != out.ciphertext.size()))
+    {
+        cerr << "Error: expected as many plaintext as ciphertext blocks" << endl;
+        return false;
+    }
+    return true;
+}
+
+static int main_prove_json_inputs(const char *pk_file, const char *proof_filename, const char *inputs_file)
+{
+    ppT::init_public_params();
+
+    json_inputs inputs;
+    if (!read_json_inputs(inputs_file, true, inputs))
+        return 1;
+
+    const auto ciphertext = encrypted_inputs::c_strs(inputs.ciphertext);
+    const auto plaintext = encrypted_inputs::c_strs(inputs.plaintext);
+    return prove_to_file(
+        pk_file, proof_filename, ciphertext.size(), g_circuit,
+        (const char *)inputs.key_hash.data(), ciphertext.data(),
+        inputs.plaintext_root.c_str(), inputs.key.c_str(), plaintext.data());
+}
+
+static int main_verify_json_inputs(const char *vk_file, const char *proof_file, const char *inputs_file)
+{
+    ppT::init_public_params();
+
+    json_inputs inputs;
+    if (!read_json_inputs(inputs_file, false, inputs))
+        return 1;
+
+    const auto ciphertext = encrypted_inputs::c_strs(inputs.ciphertext);
+    return verify_file(
+        vk_file, proof_file, ciphertext.size(), g_circuit,
+        (const char *)inputs.key_hash.data(), ciphertext.data(),
+        inputs.plaintext_root.c_str());
+}
+
+static int main_decrypt(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+    arg_error:
+        cerr << "Usage: " << prog_name << " decrypt <prefix> <key> <output> [--key-hash <key-hash>] [--threads <num_threads>]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<prefix>         Public inputs and ciphertext written by encrypt" << endl;
+        cerr << "\t<key>            MiMC encryption key revealed by the seller" << endl;
+        cerr << "\t<output>         Write the plaintext here" << endl;
+        cerr << "\t<key-hash>       Hash lock to check the key against, the one in <prefix>.json by default (hex string)" << endl;
+        cerr << "\t<num_threads>    Threads to decrypt and hash with, 0 for all cores" << endl;
+        return 1;
+    }
+
+    const std::string prefix(argv[1]);
+    const char *arg_key = argv[2];
+    const char *out_file = argv[3];
+    const char *arg_key_hash = nullptr;
+    size_t num_threads = 0;
+    for (int i = 4; i < argc; i += 2)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+            goto arg_error;
+        if (option == "--key-hash")
+            arg_key_hash = argv[i + 1];
+        else if (option == "--threads")
+            num_threads = std::stoul(argv[i + 1]);
+        else
+            goto arg_error;
+    }
+
+    ppT::init_public_params();
+
+    ethsnarks::encrypted_file_info info;
+    if (!ethsnarks::read_encrypted_file_info(prefix + ".json", info))
+        return 1;
+
+    if (arg_key_hash != nullptr && !ethsnarks::hex_string_to_bytes(arg_key_hash, info.key_hash))
+    {
+        cerr << "Invalid key hash" << endl;
+        return 1;
+    }
+    if (info.key_hash.size() != 32)
+    {
+        cerr << "Invalid key hash length" << endl;
+        return 1;
+    }
+
+    const int result = contingent_decrypt_file(
+        info.ciphertext_file.c_str(),
+        out_file,
+        info.num_blocks,
+        info.size,
+        info.circuit,
+        (const char *)info.key_hash.data(),
+        arg_key,
+        ethsnarks::field_to_decimal(info.plaintext_root).c_str(),
+        num_threads);
+
+    switch (result)
+    {
+    case CONTINGENT_DECRYPT_OK:
+        cout << "Decrypted " << info.size << " bytes to " << out_file << endl;
+        return 0;
+    case CONTINGENT_DECRYPT_BAD_KEY:
+        cerr << "Error: the key doesn't match the key hash" << endl;
+        return 1;
+    case CONTINGENT_DECRYPT_BAD_ROOT:
+        cerr << "Error: the plaintext doesn't match the plaintext root" << endl;
+        return 1;
+    default:
+        return 2;
+    }
+}
+
 static int main_prove(const char *prog_name, int argc, const char **argv)
 {
+    if (argc > 3 && std::string(argv[3]) == "--encrypted")
+        return main_prove_encrypted(prog_name, argc, argv);
+    if (argc == 5 && std::string(argv[3]) == "--inputs")
+        return main_prove_inputs(argv[1], argv[2], argv[4]);
+    if (argc == 5 && std::string(argv[3]) == "--inputs-json")
+        return main_prove_json_inputs(argv[1], argv[2], argv[4]);
+
     if (argc < 4)
     {
     arg_error:
         cerr << "Usage: " << prog_name << " prove <pk.raw> <proof.json> <num_blocks> <public:key-hash> <public:ciphertext...> <public:plaintext-root> <secret:key> <secret:plaintext...>" << endl;
+        cerr << "       " << prog_name << " prove <pk.raw> <proof.json> --encrypted <prefix>" << endl;
+        cerr << "       " << prog_name << " prove <pk.raw> <proof.json> <--inputs|--inputs-json> <inputs|->" << endl;
         cerr << "Args: " << endl;
         cerr << "\t<pk.raw>         Path to proving key" << endl;
-        cerr << "\t<proof.json>     Write proof to this file" << endl;
+        cerr << "\t<proof.json>     Write proof to this file, binary encoding if it ends with .bin" << endl;
         cerr << "\t<num_blocks>     Number of data blocks" << endl;
-        cerr << "\t<key-hash>       SHA256 key hash (hex string)" << endl;
+        cerr << "\t<key-hash>       SHA256 or MiMC key hash, depending on --circuit (hex string)" << endl;
         cerr << "\t<ciphertext...>  Encrypted data blocks" << endl;
         cerr << "\t<plaintext-root> MiMC Merkle-Tree root hash" << endl;
         cerr << "\t<key>            MiMC encryption key" << endl;
         cerr << "\t<plaintext...>   Padded plaintext data blocks" << endl;
+        cerr << "\t<prefix>         Inputs written by encrypt, the original file is read for the plaintext" << endl;
+        cerr << "\t<inputs>         The arguments from <key-hash> on, the key hash as its 32 bytes and the rest as 32 byte little-endian field elements, or JSON, - for stdin" << endl;
         return 1;
     }
 
@@ -131,54 +797,39 @@ static int main_prove(const char *prog_name, int argc, const char **argv)
     for (size_t i = 0; i < num_blocks; i++)
         arg_plaintext.emplace_back(*argv++);
 
-    auto json = contingent_prove(
-        pk_file,
-        num_blocks,
-        arg_key_hash,
-        arg_ciphertext.data(),
-        arg_plaintext_root,
-        arg_key,
-        arg_plaintext.data());
-
-    ofstream fh;
-    fh.open(proof_filename, std::ios::binary);
-    fh << json;
-    fh.flush();
-    fh.close();
-
-    return 0;
+    return prove_to_file(pk_file, proof_filename, num_blocks, g_circuit, arg_key_hash, arg_ciphertext.data(), arg_plaintext_root, arg_key, arg_plaintext.data());
 }
 
 static int main_verify(const char *prog_name, int argc, const char **argv)
 {
+    if (argc > 3 && std::string(argv[3]) == "--encrypted")
+        return main_verify_encrypted(prog_name, argc, argv);
+    if (argc == 5 && std::string(argv[3]) == "--inputs")
+        return main_verify_inputs(argv[1], argv[2], argv[4]);
+    if (argc == 5 && std::string(argv[3]) == "--inputs-json")
+        return main_verify_json_inputs(argv[1], argv[2], argv[4]);
+
     if (argc < 4)
     {
     arg_error:
         cerr << "Usage: " << prog_name << " verify <vk.json> <proof.json> <num_blocks> <public:key-hash> <public:ciphertext...> <public:plaintext-root>" << endl;
+        cerr << "       " << prog_name << " verify <vk.json> <proof.json> --encrypted <prefix>" << endl;
+        cerr << "       " << prog_name << " verify <vk.json> <proof.json> <--inputs|--inputs-json> <inputs|->" << endl;
         cerr << "Args: " << endl;
         cerr << "\t<vk.json>        Path to verification key" << endl;
         cerr << "\t<proof.json>     Write proof to this file" << endl;
         cerr << "\t<num_blocks>     Number of data blocks" << endl;
-        cerr << "\t<key-hash>       SHA256 key hash (hex string)" << endl;
+        cerr << "\t<key-hash>       SHA256 or MiMC key hash, depending on --circuit (hex string)" << endl;
         cerr << "\t<ciphertext...>  Encrypted data blocks" << endl;
         cerr << "\t<plaintext-root> MiMC Merkle-Tree root hash" << endl;
+        cerr << "\t<prefix>         Public inputs written by encrypt" << endl;
+        cerr << "\t<inputs>         The arguments from <key-hash> on, the key hash as its 32 bytes and the rest as 32 byte little-endian field elements, or JSON, - for stdin" << endl;
         return 1;
     }
 
     argv++;
     const char *vk_file = *argv++;
     const char *proof_file = *argv++;
-
-    // Read proof file
-    std::stringstream proof_stream;
-    std::ifstream proof_input(proof_file);
-    if( ! proof_input ) {
-        std::cerr << "Error: cannot open " << proof_file << std::endl;
-        return 2;
-    }
-    proof_stream << proof_input.rdbuf();
-    proof_input.close();
-
     size_t num_blocks = std::stoi(*argv++);
 
     if (num_blocks < 1)
@@ -205,45 +856,440 @@ static int main_verify(const char *prog_name, int argc, const char **argv)
 
     const char *arg_plaintext_root = *argv++;
 
-    bool result = contingent_verify(
-        vk_file,
-        proof_stream.str().c_str(),
-        num_blocks,
-        arg_key_hash,
-        arg_ciphertext.data(),
-        arg_plaintext_root);
+    return verify_file(vk_file, proof_file, num_blocks, g_circuit, arg_key_hash, arg_ciphertext.data(), arg_plaintext_root);
+}
 
-    if (result)
-        cout << "Verification Passed!" << endl;
+static int main_verify_batch(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << prog_name << " verify-batch <vk.json> <num_blocks> <proofs.txt>" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<vk.json>        Path to verification key" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks" << endl;
+        cerr << "\t<proofs.txt>     List of proofs, one per line as:" << endl;
+        cerr << "\t                 <proof> <key-hash> <ciphertext...> <plaintext-root>" << endl;
+        cerr << "\t                 with each proof in JSON or in the binary encoding" << endl;
+        return 1;
+    }
+
+    const char *vk_file = argv[1];
+    size_t num_blocks = std::stoi(argv[2]);
+    const char *list_file = argv[3];
+
+    if (num_blocks < 1)
+    {
+        cerr << "Invalid number of blocks: " << num_blocks << endl;
+        return 1;
+    }
+
+    // Opened first, binary proofs need the curve parameters to be decoded
+    contingent_verifier_t *verifier = open_verifier_for(vk_file, num_blocks, g_circuit);
+    if (verifier == nullptr)
+        return 1;
+    std::unique_ptr<contingent_verifier_t, void (*)(contingent_verifier_t *)> verifier_guard(verifier, contingent_verifier_close);
+
+    std::ifstream list_input(list_file);
+    if( ! list_input ) {
+        cerr << "Error: cannot open " << list_file << endl;
+        return 2;
+    }
+
+    // Everything the jobs point to must stay alive until verification is done
+    std::vector<std::string> proof_files;
+    std::vector<std::string> proof_jsons;
+    std::vector<std::vector<char>> key_hashes;
+    std::vector<std::vector<std::string>> ciphertexts;
+    std::vector<std::vector<const char *>> ciphertext_ptrs;
+    std::vector<std::string> plaintext_roots;
+
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(list_input, line))
+    {
+        line_no++;
+        std::stringstream line_stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (line_stream >> field)
+            fields.emplace_back(field);
+
+        if (fields.empty())
+            continue;
+
+        if (fields.size() != 3 + num_blocks)
+        {
+            cerr << list_file << ":" << line_no << ": expected " << (3 + num_blocks) << " fields, got " << fields.size() << endl;
+            return 1;
+        }
+
+        // Binary proofs are converted, the batch only takes JSON. One which
+        // doesn't decode is left empty so it's flagged as failed.
+        std::string proof_data;
+        if (!read_proof_file(fields[0].c_str(), proof_data))
+            return 2;
+        if (ethsnarks::is_binary_encoding((const uint8_t *)proof_data.data(), proof_data.size(), ethsnarks::BINARY_KIND_PROOF))
+        {
+            ProofT proof;
+            if (ethsnarks::decode_proof((const uint8_t *)proof_data.data(), proof_data.size(), proof))
+                proof_data = proof_to_json(proof);
+            else
+            {
+                cerr << "Error: invalid binary proof " << fields[0] << endl;
+                proof_data.clear();
+            }
+        }
+
+        if (fields[1].size() != 64)
+        {
+            cerr << list_file << ":" << line_no << ": invalid key hash length" << endl;
+            return 1;
+        }
+        std::vector<char> key_hash(32);
+        hex2bin(fields[1].c_str(), key_hash.data());
+
+        proof_files.emplace_back(fields[0]);
+        proof_jsons.emplace_back(std::move(proof_data));
+        key_hashes.emplace_back(std::move(key_hash));
+        ciphertexts.emplace_back(fields.begin() + 2, fields.begin() + 2 + num_blocks);
+        plaintext_roots.emplace_back(fields.back());
+    }
+
+    std::vector<contingent_verify_job_t> jobs;
+    for (size_t i = 0; i < proof_jsons.size(); i++)
+    {
+        ciphertext_ptrs.emplace_back();
+        for (const auto &block : ciphertexts[i])
+            ciphertext_ptrs.back().emplace_back(block.c_str());
+    }
+    for (size_t i = 0; i < proof_jsons.size(); i++)
+    {
+        contingent_verify_job_t job;
+        job.proof_json = proof_jsons[i].c_str();
+        job.key_hash = key_hashes[i].data();
+        job.ciphertext = ciphertext_ptrs[i].data();
+        job.plaintext_root = plaintext_roots[i].c_str();
+        jobs.emplace_back(job);
+    }
+
+    std::unique_ptr<bool[]> results(new bool[jobs.size()]);
+    size_t num_failed = contingent_verifier_verify_batch(verifier, jobs.data(), jobs.size(), results.get());
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (!results[i])
+            cerr << "Verification Failed: " << proof_files[i] << endl;
+    }
+
+    if (num_failed == 0)
+        cout << "Verification Passed! (" << jobs.size() << " proofs)" << endl;
     else
-        cerr << "Verification Failed!" << endl;
+        cerr << num_failed << " of " << jobs.size() << " proofs failed" << endl;
 
     return 0;
 }
 
-int main(int argc, const char **argv)
+static int main_serve(const char *prog_name, int argc, const char **argv)
 {
-    if (argc < 2)
+    if (argc < 3)
     {
-        cerr << "Usage: " << argv[0] << " <genkeys|prove|verify> [...]" << endl;
+    arg_error:
+        cerr << "Usage: " << prog_name << " serve <socket> <keys.txt> [--workers <n>] [--queue <n>]" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<socket>         Path of the Unix domain socket to listen on" << endl;
+        cerr << "\t<keys.txt>       Keys to load, one size per line as:" << endl;
+        cerr << "\t                 <num_blocks> <pk.raw> <vk.json> [circuit]" << endl;
+        cerr << "\t--workers <n>    Proofs made at the same time, default 1" << endl;
+        cerr << "\t--queue <n>      Jobs waiting for a worker before clients are blocked, default 64" << endl;
         return 1;
     }
 
-    const std::string arg_cmd(argv[1]);
+    const char *socket_path = argv[1];
+    const char *keys_file = argv[2];
+    size_t num_workers = 1;
+    size_t queue_size = 64;
+    for (int i = 3; i < argc; i += 2)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+            goto arg_error;
+        if (option == "--workers")
+            num_workers = std::stoul(argv[i + 1]);
+        else if (option == "--queue")
+            queue_size = std::stoul(argv[i + 1]);
+        else
+            goto arg_error;
+    }
+
+    std::ifstream keys_input(keys_file);
+    if( ! keys_input ) {
+        cerr << "Error: cannot open " << keys_file << endl;
+        return 2;
+    }
+
+    ppT::init_public_params();
+
+    ethsnarks::contingent_server server(num_workers, queue_size, g_circuit);
+
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(keys_input, line))
+    {
+        line_no++;
+        std::stringstream line_stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (line_stream >> field)
+            fields.emplace_back(field);
+
+        if (fields.empty() || fields[0][0] == '#')
+            continue;
+
+        unsigned int circuit = g_circuit;
+        if ((fields.size() != 3 && fields.size() != 4) || (fields.size() == 4 && !parse_circuit(fields[3], circuit)))
+        {
+            cerr << keys_file << ":" << line_no << ": expected <num_blocks> <pk.raw> <vk.json> [circuit]" << endl;
+            return 1;
+        }
+
+        if (!server.add_keys(std::stoul(fields[0]), circuit, fields[1].c_str(), fields[2].c_str()))
+            return 1;
+    }
+
+    return server.run(socket_path);
+}
+
+static int main_pk_map(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << prog_name << " pk-map <pk.raw> <pk.map> <num_blocks>" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<pk.raw>         Proving key written by genkeys" << endl;
+        cerr << "\t<pk.map>         Write it here in the sectioned layout, copied into memory on load" << endl;
+        cerr << "\t<num_blocks>     Number of data blocks" << endl;
+        return 1;
+    }
+
+    const char *in_file = argv[1];
+    const char *out_file = argv[2];
+    size_t num_blocks = std::stoi(argv[3]);
+
+    ppT::init_public_params();
+
+    if (!std::ifstream(in_file))
+    {
+        cerr << "Error: cannot open " << in_file << endl;
+        return 2;
+    }
+
+    const auto proving_key = ethsnarks::load_proving_key(in_file, num_blocks);
+    if (proving_key.constraint_system.num_inputs() != ethsnarks::contingent_num_inputs(num_blocks, g_circuit))
+    {
+        cerr << "Error: " << in_file << " is not a proving key for " << num_blocks << " blocks" << endl;
+        return 1;
+    }
+
+    if (!ethsnarks::write_mapped_pk(proving_key, num_blocks, out_file))
+    {
+        cerr << "Error: cannot write " << out_file << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int main_convert(const char *prog_name, int argc, const char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << prog_name << " convert <input> <output>" << endl;
+        cerr << "Args: " << endl;
+        cerr << "\t<input>          Proof or verification key, JSON or binary" << endl;
+        cerr << "\t<output>         Write it here in the other encoding" << endl;
+        return 1;
+    }
+
+    const char *in_file = argv[1];
+    const char *out_file = argv[2];
+
+    ppT::init_public_params();
+
+    std::stringstream in_stream;
+    std::ifstream in_input(in_file, std::ios::binary);
+    if( ! in_input ) {
+        cerr << "Error: cannot open " << in_file << endl;
+        return 2;
+    }
+    in_stream << in_input.rdbuf();
+    in_input.close();
+
+    const std::string in_data = in_stream.str();
+    const uint8_t *in_bytes = (const uint8_t *)in_data.data();
+
+    std::string out_data;
+    if (ethsnarks::is_binary_encoding(in_bytes, in_data.size(), ethsnarks::BINARY_KIND_PROOF))
+    {
+        ProofT proof;
+        if (!ethsnarks::decode_proof(in_bytes, in_data.size(), proof))
+        {
+            cerr << "Error: invalid binary proof" << endl;
+            return 1;
+        }
+        out_data = proof_to_json(proof);
+    }
+    else if (ethsnarks::is_binary_encoding(in_bytes, in_data.size(), ethsnarks::BINARY_KIND_VK))
+    {
+        ethsnarks::VerificationKeyT vk;
+        if (!ethsnarks::decode_vk(in_bytes, in_data.size(), vk))
+        {
+            cerr << "Error: invalid binary verification key" << endl;
+            return 1;
+        }
+        out_data = ethsnarks::vk2json(vk);
+    }
+    else
+    {
+        // JSON, proofs are told apart from verification keys by their "A" point
+        PropertyTreeT tree;
+        read_json(in_stream, tree);
+
+        std::vector<uint8_t> encoded;
+        if (tree.count("A"))
+        {
+            encoded = ethsnarks::encode_proof(proof_from_tree(tree));
+        }
+        else
+        {
+            std::stringstream vk_stream(in_data);
+            encoded = ethsnarks::encode_vk(ethsnarks::vk_from_json(vk_stream));
+        }
+        out_data.assign(encoded.begin(), encoded.end());
+    }
+
+    ofstream fh;
+    fh.open(out_file, std::ios::binary);
+    fh.write(out_data.data(), out_data.size());
+    fh.flush();
+    fh.close();
 
+    cout << in_data.size() << " bytes -> " << out_data.size() << " bytes" << endl;
+
+    return 0;
+}
+
+static int run_command(const std::string &arg_cmd, int argc, const char **argv)
+{
     if (arg_cmd == "prove")
     {
         return main_prove(argv[0], argc - 1, (const char **)&argv[1]);
     }
+    else if (arg_cmd == "encrypt")
+    {
+        return main_encrypt(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "decrypt")
+    {
+        return main_decrypt(argv[0], argc - 1, (const char **)&argv[1]);
+    }
     else if (arg_cmd == "genkeys")
     {
         return main_genkeys(argv[0], argc - 1, (const char **)&argv[1]);
     }
+    else if (arg_cmd == "keys")
+    {
+        return main_keys(argv[0], argc - 1, (const char **)&argv[1]);
+    }
     else if (arg_cmd == "verify")
     {
         return main_verify(argv[0], argc - 1, (const char **)&argv[1]);
     }
+    else if (arg_cmd == "serve")
+    {
+        return main_serve(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "pk-map")
+    {
+        return main_pk_map(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "convert")
+    {
+        return main_convert(argv[0], argc - 1, (const char **)&argv[1]);
+    }
+    else if (arg_cmd == "verify-batch")
+    {
+        return main_verify_batch(argv[0], argc - 1, (const char **)&argv[1]);
+    }
 
     cerr << "Error: unknown sub-command " << arg_cmd << endl;
     return 2;
 }
+
+int main(int argc, const char **argv)
+{
+    // Global options come before the sub-command
+    while (argc > 2 && ::strncmp(argv[1], "--", 2) == 0)
+    {
+        const std::string option(argv[1]);
+        int shift = 2;
+        if (option == "--stats")
+        {
+            g_stats = true;
+            shift = 1;
+        }
+        else if (option == "--circuit")
+        {
+            if (!parse_circuit(argv[2], g_circuit))
+            {
+                cerr << "Error: unknown circuit variant " << argv[2] << " (sha256, sha256-packed or mimc, optionally +ciphertext-hash and +padded)" << endl;
+                return 1;
+            }
+        }
+        else if (option == "--no-full-check")
+        {
+            contingent_set_full_check(false);
+            shift = 1;
+        }
+        else if (option == "--lean")
+        {
+            contingent_set_lean_proving(true);
+            shift = 1;
+        }
+        else if (option == "--threads")
+        {
+            ethsnarks::default_thread_budget().num_threads = std::stoul(argv[2]);
+        }
+        else if (option == "--pin")
+        {
+            ethsnarks::default_thread_budget().first_core = std::stoi(argv[2]);
+        }
+        else
+        {
+            break;
+        }
+        argv[shift] = argv[0];
+        argv += shift;
+        argc -= shift;
+    }
+
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " [--circuit <sha256|sha256-packed|mimc>[+ciphertext-hash][+padded]] [--threads <n>] [--pin <first-core>] [--stats] [--no-full-check] [--lean] <genkeys|keys|encrypt|decrypt|prove|verify|verify-batch|convert|pk-map|serve> [...]" << endl;
+        return 1;
+    }
+
+    const std::string arg_cmd(argv[1]);
+    const int result = run_command(arg_cmd, argc, argv);
+
+    if (g_stats)
+    {
+        char *stats = contingent_last_stats();
+        if (stats != nullptr)
+        {
+            cerr << stats << endl;
+            contingent_free(stats);
+        }
+    }
+
+    return result;
+}
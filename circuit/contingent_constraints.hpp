@@ -0,0 +1,156 @@
+#ifndef CONTINGENT_CONSTRAINTS_HPP_
+#define CONTINGENT_CONSTRAINTS_HPP_
+
+#include <stdint.h>
+#include <atomic>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "contingent.hpp"
+#include "contingent_parallel.hpp"
+
+/**
+* Compact constraint system for the lean proving mode
+*
+* libsnark keeps every linear combination as its own vector of (index,
+* coefficient) terms, 40 bytes per term plus three heap allocations per
+* constraint. Here all terms are in flat arrays of 32 bit variable indices
+* and 32 bit ids into a table of the distinct coefficients, which for the
+* contingent circuit are few: 1, -1, powers of two and the MiMC round
+* constants. That's 8 bytes per term and 24 per constraint.
+*
+* Linear combinations are evaluated on `1 || primary_input ||
+* auxiliary_input`, so a variable index is its position in the assignment.
+*/
+
+namespace ethsnarks
+{
+
+class compact_constraint_system
+{
+public:
+    size_t primary_input_size = 0;
+    size_t auxiliary_input_size = 0;
+
+    size_t num_constraints() const
+    {
+        return (m_offsets.size() - 1) / 3;
+    }
+
+    size_t num_inputs() const
+    {
+        return primary_input_size;
+    }
+
+    size_t num_variables() const
+    {
+        return primary_input_size + auxiliary_input_size;
+    }
+
+    size_t num_terms() const
+    {
+        return m_indices.size();
+    }
+
+    /**
+    * Append a term to the current linear combination, the a, b and c of a
+    * constraint are added in that order
+    */
+    void add_term(const uint64_t index, const FieldT &coeff)
+    {
+        if (index > UINT32_MAX)
+            throw std::runtime_error("too many variables for the compact constraint system");
+
+        auto it = m_coeff_ids.find(coeff);
+        if (it == m_coeff_ids.end())
+        {
+            it = m_coeff_ids.emplace(coeff, m_coeffs.size()).first;
+            m_coeffs.emplace_back(coeff);
+        }
+        m_indices.emplace_back(index);
+        m_coeff_ids_of_terms.emplace_back(it->second);
+    }
+
+    void end_linear_combination()
+    {
+        m_offsets.emplace_back(m_indices.size());
+    }
+
+    /**
+    * Drop the lookup table used while adding terms, and any spare capacity
+    */
+    void finish()
+    {
+        std::unordered_map<FieldT, uint32_t, field_hash>().swap(m_coeff_ids);
+        m_offsets.shrink_to_fit();
+        m_indices.shrink_to_fit();
+        m_coeff_ids_of_terms.shrink_to_fit();
+    }
+
+    void assign(const libsnark::r1cs_constraint_system<FieldT> &cs)
+    {
+        primary_input_size = cs.primary_input_size;
+        auxiliary_input_size = cs.auxiliary_input_size;
+        for (const auto &constraint : cs.constraints)
+        {
+            for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c})
+            {
+                for (const auto &term : lc->terms)
+                    add_term(term.index, term.coeff);
+                end_linear_combination();
+            }
+        }
+        finish();
+    }
+
+    /**
+    * Value of the a (k = 0), b (k = 1) or c (k = 2) linear combination of
+    * constraint `i`
+    */
+    FieldT evaluate(const size_t i, const size_t k, const std::vector<FieldT> &assignment) const
+    {
+        FieldT result = FieldT::zero();
+        for (uint64_t j = m_offsets[(3 * i) + k]; j < m_offsets[(3 * i) + k + 1]; j++)
+            result += m_coeffs[m_coeff_ids_of_terms[j]] * assignment[m_indices[j]];
+        return result;
+    }
+
+    bool is_satisfied(const std::vector<FieldT> &assignment, const size_t num_threads = 0) const
+    {
+        if (assignment.size() != num_variables() + 1)
+            return false;
+
+        std::atomic<bool> ok(true);
+        parallel_for(0, num_constraints(), num_threads, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi && ok; i++)
+            {
+                if (evaluate(i, 0, assignment) * evaluate(i, 1, assignment) != evaluate(i, 2, assignment))
+                    ok = false;
+            }
+        });
+        return ok;
+    }
+
+private:
+    struct field_hash
+    {
+        size_t operator()(const FieldT &value) const
+        {
+            size_t h = 0;
+            for (size_t i = 0; i < FieldT::num_limbs; i++)
+                h = (h * 0x9E3779B97F4A7C15ULL) ^ value.mont_repr.data[i];
+            return h;
+        }
+    };
+
+    std::vector<uint64_t> m_offsets = {0};
+    std::vector<uint32_t> m_indices;
+    std::vector<uint32_t> m_coeff_ids_of_terms;
+    std::vector<FieldT> m_coeffs;
+    std::unordered_map<FieldT, uint32_t, field_hash> m_coeff_ids;
+};
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef CONTINGENT_ENCODING_HPP_
+#define CONTINGENT_ENCODING_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "contingent.hpp"
+#include "contingent_parallel.hpp"
+#include "contingent_verifier.hpp"
+
+/**
+* Compact binary encoding of proofs and verification keys
+*
+* Every document starts with a 6 byte header:
+*
+*   "ZKCP" | version (1 byte) | kind (1 byte, 'P' proof or 'V' verification key)
+*
+* Curve points are compressed to their x coordinate, as 32 byte big-endian
+* field elements. The two most significant bits of the first byte, which are
+* always zero for alt_bn128, hold the flags:
+*
+*   0x80 - y is odd (for G2, the parity of y.c1, or of y.c0 when y.c1 is zero)
+*   0x40 - point at infinity, the rest of the encoding is zero
+*
+* Only the canonical encoding of a point is accepted: the infinity flag
+* alone, or an x coordinate below the modulus with the parity of y. G2
+* points must be in the prime order subgroup, G1 has a cofactor of 1.
+*
+* G2 points are encoded as x.c1 || x.c0 (the same order as EIP-197), with
+* the flags in the first byte of x.c1.
+*
+* A proof is A (G1) | B (G2) | C (G1), 134 bytes in total.
+*
+* A verification key is alpha (G1) | beta (G2) | gamma (G2) | delta (G2) |
+* number of IC points (4 bytes, little-endian) | IC points (G1)
+*/
+
+namespace ethsnarks
+{
+
+typedef libff::alt_bn128_Fq FqT;
+typedef libff::alt_bn128_Fq2 Fq2T;
+typedef libff::alt_bn128_G1 G1T;
+typedef libff::alt_bn128_G2 G2T;
+
+static const uint8_t BINARY_MAGIC[4] = {'Z', 'K', 'C', 'P'};
+static const uint8_t BINARY_VERSION = 1;
+static const uint8_t BINARY_KIND_PROOF = 'P';
+static const uint8_t BINARY_KIND_VK = 'V';
+
+static const size_t BINARY_HEADER_SIZE = 6;
+static const size_t BINARY_G1_SIZE = 32;
+static const size_t BINARY_G2_SIZE = 64;
+static const size_t BINARY_PROOF_SIZE = BINARY_HEADER_SIZE + BINARY_G1_SIZE + BINARY_G2_SIZE + BINARY_G1_SIZE;
+static_assert(BINARY_PROOF_SIZE == CONTINGENT_PROOF_BINARY_SIZE, "CONTINGENT_PROOF_BINARY_SIZE mismatch");
+
+static const uint8_t BINARY_FLAG_ODD = 0x80;
+static const uint8_t BINARY_FLAG_INFINITY = 0x40;
+
+/**
+* Check the header, returns true if `in_data` is a binary document of `kind`
+*/
+inline bool is_binary_encoding(const uint8_t *in_data, const size_t in_size, const uint8_t kind)
+{
+    return in_size >= BINARY_HEADER_SIZE
+        && 0 == memcmp(in_data, BINARY_MAGIC, sizeof(BINARY_MAGIC))
+        && in_data[4] == BINARY_VERSION
+        && in_data[5] == kind;
+}
+
+inline void encode_header(std::vector<uint8_t> &out, const uint8_t kind)
+{
+    out.insert(out.end(), BINARY_MAGIC, BINARY_MAGIC + sizeof(BINARY_MAGIC));
+    out.push_back(BINARY_VERSION);
+    out.push_back(kind);
+}
+
+inline void encode_Fq(std::vector<uint8_t> &out, const FqT &value)
+{
+    const auto b = value.as_bigint();
+    for (size_t i = 0; i < 32; i++)
+    {
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 8; j++)
+        {
+            if (b.test_bit((31 - i) * 8 + j))
+                byte |= (1 << j);
+        }
+        out.push_back(byte);
+    }
+}
+
+/**
+* Decode a 32 byte big-endian field element, ignoring the flag bits
+*/
+inline bool decode_Fq(const uint8_t *in_data, FqT &out_value)
+{
+    libff::bigint<FqT::num_limbs> b;
+    for (size_t i = 0; i < 32; i++)
+    {
+        uint8_t byte = in_data[i];
+        if (i == 0)
+            byte &= ~(BINARY_FLAG_ODD | BINARY_FLAG_INFINITY);
+
+        for (size_t j = 0; j < 8; j++)
+        {
+            if (byte & (1 << j))
+            {
+                const size_t bit = (31 - i) * 8 + j;
+                b.data[bit / GMP_NUMB_BITS] |= (mp_limb_t(1) << (bit % GMP_NUMB_BITS));
+            }
+        }
+    }
+
+    if (mpn_cmp(b.data, libff::alt_bn128_modulus_q.data, FqT::num_limbs) >= 0)
+        return false;
+
+    out_value = FqT(b);
+    return true;
+}
+
+/**
+* Decode a 32 byte little-endian element of the scalar field, as taken by
+* the *_raw functions of the C API. Values which aren't reduced are refused.
+*/
+inline bool decode_field_le(const uint8_t *in_data, FieldT &out_value)
+{
+    libff::bigint<FieldT::num_limbs> b;
+    for (size_t i = 0; i < 32; i++)
+        b.data[i / sizeof(mp_limb_t)] |= mp_limb_t(in_data[i]) << (8 * (i % sizeof(mp_limb_t)));
+
+    if (mpn_cmp(b.data, FieldT::mod.data, FieldT::num_limbs) >= 0)
+        return false;
+
+    out_value = FieldT(b);
+    return true;
+}
+
+/**
+* Decode `count` consecutive 32 byte little-endian field elements, spread
+* over `num_threads` threads for large buffers
+*/
+inline bool decode_field_elements_le(const uint8_t *in_data, const size_t count, std::vector<FieldT> &out_values, const size_t num_threads = 0)
+{
+    out_values.resize(count);
+    std::atomic<bool> ok(true);
+    parallel_for(0, count, count < 4096 ? 1 : num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            if (!decode_field_le(in_data + (32 * i), out_values[i]))
+                ok = false;
+        }
+    });
+    return ok;
+}
+
+inline bool is_odd(const FqT &value)
+{
+    return value.as_bigint().test_bit(0);
+}
+
+inline bool is_odd(const Fq2T &value)
+{
+    return value.c1.is_zero() ? is_odd(value.c0) : is_odd(value.c1);
+}
+
+/**
+* Square root which fails cleanly for non-residues, libff asserts instead
+*/
+inline bool checked_sqrt(const FqT &value, FqT &out_root)
+{
+    if (!value.is_zero() && (value ^ FqT::euler) != FqT::one())
+        return false;
+    out_root = value.sqrt();
+    return out_root.squared() == value;
+}
+
+inline bool checked_sqrt(const Fq2T &value, Fq2T &out_root)
+{
+    // a is a square in Fq2 iff its norm is a square in Fq
+    const FqT norm = value.c0.squared() - Fq2T::non_residue * value.c1.squared();
+    if (!norm.is_zero() && (norm ^ FqT::euler) != FqT::one())
+        return false;
+    out_root = value.sqrt();
+    return out_root.squared() == value;
+}
+
+/**
+* libff writes the point at infinity with the affine coordinates (0, 1),
+* which aren't on either curve, so a point read back from JSON with them is
+* the point at infinity
+*/
+inline G1T fix_json_infinity(const G1T &point)
+{
+    return (point.X.is_zero() && point.Y == FqT::one()) ? G1T::zero() : point;
+}
+
+inline G2T fix_json_infinity(const G2T &point)
+{
+    return (point.X.is_zero() && point.Y == Fq2T::one()) ? G2T::zero() : point;
+}
+
+/**
+* The point at infinity is the infinity flag followed by zeros, any other
+* bit set along with the flag is refused
+*/
+inline bool decode_infinity(const uint8_t *in_data, const size_t in_size)
+{
+    if (in_data[0] != BINARY_FLAG_INFINITY)
+        return false;
+    for (size_t i = 1; i < in_size; i++)
+    {
+        if (in_data[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+inline void encode_G1(std::vector<uint8_t> &out, const G1T &point)
+{
+    const size_t offset = out.size();
+
+    if (point.is_zero())
+    {
+        out.resize(offset + BINARY_G1_SIZE, 0);
+        out[offset] = BINARY_FLAG_INFINITY;
+        return;
+    }
+
+    G1T affine(point);
+    affine.to_affine_coordinates();
+    encode_Fq(out, affine.X);
+    if (is_odd(affine.Y))
+        out[offset] |= BINARY_FLAG_ODD;
+}
+
+inline bool decode_G1(const uint8_t *in_data, G1T &out_point)
+{
+    if (in_data[0] & BINARY_FLAG_INFINITY)
+    {
+        out_point = G1T::zero();
+        return decode_infinity(in_data, BINARY_G1_SIZE);
+    }
+
+    FqT x, y;
+    if (!decode_Fq(in_data, x))
+        return false;
+
+    // y^2 = x^3 + b
+    if (!checked_sqrt(x.squared() * x + libff::alt_bn128_coeff_b, y))
+        return false;
+
+    if (is_odd(y) != bool(in_data[0] & BINARY_FLAG_ODD))
+        y = -y;
+
+    out_point = G1T(x, y, FqT::one());
+    return out_point.is_well_formed();
+}
+
+inline void encode_G2(std::vector<uint8_t> &out, const G2T &point)
+{
+    const size_t offset = out.size();
+
+    if (point.is_zero())
+    {
+        out.resize(offset + BINARY_G2_SIZE, 0);
+        out[offset] = BINARY_FLAG_INFINITY;
+        return;
+    }
+
+    G2T affine(point);
+    affine.to_affine_coordinates();
+    encode_Fq(out, affine.X.c1);
+    encode_Fq(out, affine.X.c0);
+    if (is_odd(affine.Y))
+        out[offset] |= BINARY_FLAG_ODD;
+}
+
+inline bool decode_G2(const uint8_t *in_data, G2T &out_point)
+{
+    if (in_data[0] & BINARY_FLAG_INFINITY)
+    {
+        out_point = G2T::zero();
+        return decode_infinity(in_data, BINARY_G2_SIZE);
+    }
+
+    Fq2T x, y;
+    if (!decode_Fq(in_data, x.c1) || !decode_Fq(in_data + 32, x.c0))
+        return false;
+
+    // y^2 = x^3 + b/xi
+    if (!checked_sqrt(x.squared() * x + libff::alt_bn128_twist_coeff_b, y))
+        return false;
+
+    if (is_odd(y) != bool(in_data[0] & BINARY_FLAG_ODD))
+        y = -y;
+
+    out_point = G2T(x, y, Fq2T::one());
+    if (!out_point.is_well_formed())
+        return false;
+
+    // The twist has points outside of the subgroup of order r
+    return (libff::alt_bn128_modulus_r * out_point).is_zero();
+}
+
+inline std::vector<uint8_t> encode_proof(const ProofT &proof)
+{
+    std::vector<uint8_t> out;
+    out.reserve(BINARY_PROOF_SIZE);
+    encode_header(out, BINARY_KIND_PROOF);
+    encode_G1(out, proof.g_A);
+    encode_G2(out, proof.g_B);
+    encode_G1(out, proof.g_C);
+    return out;
+}
+
+inline bool decode_proof(const uint8_t *in_data, const size_t in_size, ProofT &out_proof)
+{
+    if (in_size != BINARY_PROOF_SIZE || !is_binary_encoding(in_data, in_size, BINARY_KIND_PROOF))
+        return false;
+
+    const uint8_t *p = in_data + BINARY_HEADER_SIZE;
+    G1T A, C;
+    G2T B;
+    if (!decode_G1(p, A) || !decode_G2(p + BINARY_G1_SIZE, B) || !decode_G1(p + BINARY_G1_SIZE + BINARY_G2_SIZE, C))
+        return false;
+
+    out_proof = ProofT(std::move(A), std::move(B), std::move(C));
+    return true;
+}
+
+inline std::vector<uint8_t> encode_vk(const VerificationKeyT &vk)
+{
+    const auto &rest = vk.gamma_ABC_g1.rest;
+
+    // The IC vector is stored dense, even if the key holds it sparse
+    std::vector<G1T> ic(rest.domain_size(), G1T::zero());
+    for (size_t i = 0; i < rest.indices.size(); i++)
+        ic[rest.indices[i]] = rest.values[i];
+
+    std::vector<uint8_t> out;
+    encode_header(out, BINARY_KIND_VK);
+    encode_G1(out, vk.alpha_g1);
+    encode_G2(out, vk.beta_g2);
+    encode_G2(out, vk.gamma_g2);
+    encode_G2(out, vk.delta_g2);
+
+    const uint32_t num_ic = ic.size() + 1;
+    for (size_t i = 0; i < 4; i++)
+        out.push_back((num_ic >> (8 * i)) & 0xFF);
+
+    encode_G1(out, vk.gamma_ABC_g1.first);
+    for (const auto &point : ic)
+        encode_G1(out, point);
+
+    return out;
+}
+
+inline bool decode_vk(const uint8_t *in_data, const size_t in_size, VerificationKeyT &out_vk)
+{
+    const size_t fixed_size = BINARY_HEADER_SIZE + BINARY_G1_SIZE + (3 * BINARY_G2_SIZE) + 4;
+    if (in_size < fixed_size || !is_binary_encoding(in_data, in_size, BINARY_KIND_VK))
+        return false;
+
+    const uint8_t *p = in_data + BINARY_HEADER_SIZE;
+    if (!decode_G1(p, out_vk.alpha_g1))
+        return false;
+    p += BINARY_G1_SIZE;
+
+    if (!decode_G2(p, out_vk.beta_g2) || !decode_G2(p + BINARY_G2_SIZE, out_vk.gamma_g2) || !decode_G2(p + 2 * BINARY_G2_SIZE, out_vk.delta_g2))
+        return false;
+    p += 3 * BINARY_G2_SIZE;
+
+    const uint32_t num_ic = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+    p += 4;
+    if (num_ic < 1 || in_size != fixed_size + (num_ic * BINARY_G1_SIZE))
+        return false;
+
+    G1T first;
+    if (!decode_G1(p, first))
+        return false;
+    p += BINARY_G1_SIZE;
+
+    std::vector<G1T> rest(num_ic - 1);
+    for (size_t i = 0; i < rest.size(); i++)
+    {
+        if (!decode_G1(p, rest[i]))
+            return false;
+        p += BINARY_G1_SIZE;
+    }
+
+    out_vk.gamma_ABC_g1 = libsnark::accumulation_vector<G1T>(std::move(first), std::move(rest));
+    return true;
+}
+
+} // namespace ethsnarks
+
+#endif
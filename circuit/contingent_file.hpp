@@ -0,0 +1,366 @@
+#ifndef CONTINGENT_FILE_HPP_
+#define CONTINGENT_FILE_HPP_
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "contingent.hpp"
+#include "contingent_native.hpp"
+#include "contingent_prover.hpp"
+
+#include <boost/property_tree/json_parser.hpp>
+
+/**
+* Files written by `contingent_cli encrypt` and read by `decrypt`
+*
+* The input file is split into blocks of 31 bytes, each read as a big-endian
+* integer so it's always below the field modulus, and padded with zero bytes
+* up to `num_blocks` blocks. For a file encrypted to <prefix>:
+*
+*  - <prefix>.json      public description: number of blocks, input size,
+*                       key hash (hex), plaintext root and, for circuits with
+*                       CONTINGENT_CIRCUIT_CIPHERTEXT_HASH, ciphertext root
+*  - <prefix>.key.json  the secret key
+*  - <prefix>.ct        ciphertext, 32 byte little-endian field elements
+*/
+
+namespace ethsnarks
+{
+
+static const size_t FILE_BLOCK_BYTES = 31;
+
+// Blocks encrypted and hashed at a time when streaming a file
+static const size_t FILE_STREAM_BLOCKS = 1 << 14;
+
+struct encrypted_file_info
+{
+    std::string input_file;
+    uint64_t size;
+    size_t num_blocks;
+    unsigned int circuit;
+    std::vector<uint8_t> key_hash;
+    FieldT plaintext_root;
+    FieldT ciphertext_root;
+    std::string ciphertext_file;
+};
+
+inline std::string bytes_to_hex_string(const std::vector<uint8_t> &in_bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (const uint8_t byte : in_bytes)
+    {
+        out.push_back(digits[byte >> 4]);
+        out.push_back(digits[byte & 0xF]);
+    }
+    return out;
+}
+
+inline bool hex_string_to_bytes(const std::string &in_hex, std::vector<uint8_t> &out_bytes)
+{
+    if (in_hex.size() % 2)
+        return false;
+
+    out_bytes.clear();
+    for (size_t i = 0; i < in_hex.size(); i += 2)
+    {
+        const std::string byte = in_hex.substr(i, 2);
+        if (byte.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+            return false;
+        out_bytes.push_back(std::stoi(byte, nullptr, 16));
+    }
+    return true;
+}
+
+/**
+* Number of blocks needed to hold `size` bytes, rounded up to a power of two
+* so the file can be streamed and proven in chunks
+*/
+inline size_t file_num_blocks(const uint64_t size)
+{
+    const size_t min_blocks = std::max<uint64_t>(1, (size + FILE_BLOCK_BYTES - 1) / FILE_BLOCK_BYTES);
+    size_t num_blocks = 1;
+    while (num_blocks < min_blocks)
+        num_blocks *= 2;
+    return num_blocks;
+}
+
+/**
+* Read the next `count` plaintext blocks, past the end of the file the
+* blocks are zero
+*/
+inline void read_file_blocks(std::istream &in, const size_t count, std::vector<FieldT> &out_blocks)
+{
+    std::vector<uint8_t> data(count * FILE_BLOCK_BYTES, 0);
+    if (in)
+        in.read((char *)data.data(), data.size());
+
+    out_blocks.resize(count);
+    uint8_t padded[32] = {0};
+    for (size_t i = 0; i < count; i++)
+    {
+        ::memcpy(padded + 1, data.data() + (i * FILE_BLOCK_BYTES), FILE_BLOCK_BYTES);
+        field_from_bytes_be(padded, out_blocks[i]);
+    }
+}
+
+/**
+* Inverse of read_file_blocks(), writes at most `max_size` bytes and returns
+* the number of bytes written
+*/
+inline uint64_t write_file_blocks(std::ostream &out, const std::vector<FieldT> &blocks, const uint64_t max_size)
+{
+    uint64_t written = 0;
+    for (const auto &block : blocks)
+    {
+        if (written >= max_size)
+            break;
+        const auto bytes = field_to_bytes_be(block);
+        const size_t n = std::min<uint64_t>(FILE_BLOCK_BYTES, max_size - written);
+        out.write((const char *)bytes.data() + 1, n);
+        written += n;
+    }
+    return written;
+}
+
+/**
+* Write 32 byte little-endian field elements
+*/
+inline void write_field_elements(std::ostream &out, const std::vector<FieldT> &values)
+{
+    for (const auto &value : values)
+    {
+        const auto bytes = field_to_bytes_be(value);
+        const std::vector<uint8_t> le_bytes(bytes.rbegin(), bytes.rend());
+        out.write((const char *)le_bytes.data(), le_bytes.size());
+    }
+}
+
+/**
+* Read up to `count` 32 byte little-endian field elements, fails on a short
+* read or a value which isn't below the modulus
+*/
+inline bool read_field_elements(std::istream &in, const size_t count, std::vector<FieldT> &out_values)
+{
+    std::vector<uint8_t> data(count * 32);
+    if (!in.read((char *)data.data(), data.size()))
+        return false;
+
+    out_values.resize(count);
+    uint8_t be_bytes[32];
+    for (size_t i = 0; i < count; i++)
+    {
+        std::reverse_copy(data.data() + (i * 32), data.data() + ((i + 1) * 32), be_bytes);
+        if (!field_from_bytes_be(be_bytes, out_values[i]))
+            return false;
+    }
+    return true;
+}
+
+inline void write_encrypted_file_info(const std::string &path, const encrypted_file_info &info)
+{
+    boost::property_tree::ptree tree;
+    tree.put("input", info.input_file);
+    tree.put("size", info.size);
+    tree.put("num_blocks", info.num_blocks);
+    tree.put("circuit", info.circuit);
+    tree.put("key_hash", bytes_to_hex_string(info.key_hash));
+    tree.put("plaintext_root", field_to_decimal(info.plaintext_root));
+    if (info.circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH)
+        tree.put("ciphertext_root", field_to_decimal(info.ciphertext_root));
+    tree.put("ciphertext", info.ciphertext_file);
+    boost::property_tree::write_json(path, tree);
+}
+
+inline bool read_encrypted_file_info(const std::string &path, encrypted_file_info &out_info)
+{
+    try
+    {
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(path, tree);
+        out_info.input_file = tree.get<std::string>("input");
+        out_info.size = tree.get<uint64_t>("size");
+        out_info.num_blocks = tree.get<size_t>("num_blocks");
+        out_info.circuit = tree.get<unsigned int>("circuit", CONTINGENT_CIRCUIT_DEFAULT);
+        out_info.plaintext_root = FieldT(tree.get<std::string>("plaintext_root").c_str());
+        out_info.ciphertext_root = FieldT(tree.get<std::string>("ciphertext_root", "0").c_str());
+        out_info.ciphertext_file = tree.get<std::string>("ciphertext");
+        return hex_string_to_bytes(tree.get<std::string>("key_hash"), out_info.key_hash) && out_info.key_hash.size() == 32;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: cannot read " << path << ": " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+inline bool read_file_key(const std::string &path, FieldT &out_key)
+{
+    try
+    {
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(path, tree);
+        out_key = FieldT(tree.get<std::string>("key").c_str());
+        return true;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: cannot read " << path << ": " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+/**
+* Root of the whole tree from the roots of equal, power of two sized chunks
+*/
+inline FieldT combine_chunk_roots(const std::vector<FieldT> &roots)
+{
+    return roots.size() == 1 ? roots[0] : mimc_merkle_root(roots);
+}
+
+/**
+* Encrypt `input_file` with `key` and write the files described above
+*
+* The file is read FILE_STREAM_BLOCKS blocks at a time, each chunk is
+* encrypted and hashed on `num_threads` threads and written out before the
+* next one is read, only the chunk roots are kept. When `num_blocks` isn't
+* a power of two the whole file is processed as a single chunk.
+*/
+inline bool encrypt_file(
+    const std::string &input_file,
+    const std::string &prefix,
+    const FieldT &key,
+    const size_t in_num_blocks,
+    const unsigned int circuit,
+    const size_t num_threads,
+    encrypted_file_info &out_info)
+{
+    std::ifstream in(input_file, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        std::cerr << "Error: cannot open " << input_file << std::endl;
+        return false;
+    }
+    const uint64_t size = in.tellg();
+    in.seekg(0);
+
+    const size_t num_blocks = in_num_blocks ? in_num_blocks : file_num_blocks(size);
+    if (num_blocks * FILE_BLOCK_BYTES < size)
+    {
+        std::cerr << "Error: " << input_file << " doesn't fit in " << num_blocks << " blocks" << std::endl;
+        return false;
+    }
+
+    const std::string ciphertext_file = prefix + ".ct";
+    std::ofstream ct_out(ciphertext_file, std::ios::binary);
+    if (!ct_out)
+    {
+        std::cerr << "Error: cannot write " << ciphertext_file << std::endl;
+        return false;
+    }
+
+    const size_t chunk_blocks = is_power_of_two(num_blocks) ? std::min(num_blocks, FILE_STREAM_BLOCKS) : num_blocks;
+    const bool need_ciphertext_root = (circuit & CONTINGENT_CIRCUIT_CIPHERTEXT_HASH) != 0;
+
+    std::vector<FieldT> plaintext_roots;
+    std::vector<FieldT> ciphertext_roots;
+    std::vector<FieldT> plaintext;
+    for (size_t done = 0; done < num_blocks; done += chunk_blocks)
+    {
+        read_file_blocks(in, chunk_blocks, plaintext);
+        const auto ciphertext = mimc_encrypt_parallel(key, plaintext, num_threads);
+        write_field_elements(ct_out, ciphertext);
+
+        plaintext_roots.emplace_back(mimc_merkle_root_parallel(plaintext, num_threads));
+        if (need_ciphertext_root)
+            ciphertext_roots.emplace_back(mimc_merkle_root_parallel(ciphertext, num_threads));
+    }
+
+    if (!ct_out.flush())
+    {
+        std::cerr << "Error: cannot write " << ciphertext_file << std::endl;
+        return false;
+    }
+
+    out_info.input_file = input_file;
+    out_info.size = size;
+    out_info.num_blocks = num_blocks;
+    out_info.circuit = circuit;
+    out_info.key_hash = contingent_key_hash(key, circuit);
+    out_info.plaintext_root = combine_chunk_roots(plaintext_roots);
+    out_info.ciphertext_root = need_ciphertext_root ? combine_chunk_roots(ciphertext_roots) : FieldT::zero();
+    out_info.ciphertext_file = ciphertext_file;
+
+    write_encrypted_file_info(prefix + ".json", out_info);
+
+    boost::property_tree::ptree key_tree;
+    key_tree.put("key", field_to_decimal(key));
+    boost::property_tree::write_json(prefix + ".key.json", key_tree);
+
+    return true;
+}
+
+/**
+* Decrypt `num_blocks` blocks of `ciphertext_file` with `key`, writing the
+* first `size` bytes of the plaintext to `out_file`
+*
+* Like encrypt_file() the ciphertext is streamed FILE_STREAM_BLOCKS blocks at
+* a time and each chunk is decrypted and hashed on `num_threads` threads,
+* the Merkle root of the plaintext is returned in `out_root`.
+*/
+inline bool decrypt_file(
+    const std::string &ciphertext_file,
+    const std::string &out_file,
+    const FieldT &key,
+    const size_t num_blocks,
+    const uint64_t size,
+    const size_t num_threads,
+    FieldT &out_root)
+{
+    std::ifstream ct_in(ciphertext_file, std::ios::binary);
+    if (!ct_in)
+    {
+        std::cerr << "Error: cannot open " << ciphertext_file << std::endl;
+        return false;
+    }
+
+    std::ofstream out(out_file, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Error: cannot write " << out_file << std::endl;
+        return false;
+    }
+
+    const size_t chunk_blocks = is_power_of_two(num_blocks) ? std::min(num_blocks, FILE_STREAM_BLOCKS) : num_blocks;
+
+    std::vector<FieldT> roots;
+    std::vector<FieldT> ciphertext;
+    uint64_t written = 0;
+    for (size_t done = 0; done < num_blocks; done += chunk_blocks)
+    {
+        if (!read_field_elements(ct_in, chunk_blocks, ciphertext))
+        {
+            std::cerr << "Error: cannot read " << num_blocks << " blocks from " << ciphertext_file << std::endl;
+            return false;
+        }
+
+        const auto plaintext = mimc_decrypt_parallel(key, ciphertext, num_threads);
+        written += write_file_blocks(out, plaintext, size - written);
+        roots.emplace_back(mimc_merkle_root_parallel(plaintext, num_threads));
+    }
+
+    if (!out.flush())
+    {
+        std::cerr << "Error: cannot write " << out_file << std::endl;
+        return false;
+    }
+
+    out_root = combine_chunk_roots(roots);
+    return true;
+}
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef CONTINGENT_KEYGEN_HPP_
+#define CONTINGENT_KEYGEN_HPP_
+
+#include <stdint.h>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
+#include <libfqfft/evaluation_domain/get_evaluation_domain.hpp>
+
+#include "contingent_parallel.hpp"
+#include "contingent_pkfile.hpp"
+#include "contingent_stats.hpp"
+
+/**
+* Key generation straight into the mapped proving key layout
+*
+* Follows r1cs_gg_ppzksnark_zok_generator(), but the query vectors are never
+* held in memory as a whole: their scalars are exponentiated a slice at a
+* time on all threads of the budget, and each slice is appended to the file
+* before the next one is computed. What remains in memory is the constraint
+* system, the QAP evaluations at the toxic point (one field element per
+* variable) and the window tables.
+*/
+
+namespace ethsnarks
+{
+
+// Points computed and written at a time
+static const size_t KEYGEN_SLICE = 1 << 16;
+
+// Called after every slice with the name of the section, and how many of its
+// points are done
+typedef std::function<void(const char *stage, uint64_t done, uint64_t total)> keygen_progress_fn;
+
+/**
+* Exponentiate `count` scalars given by `scalar(i)` with a window table, in
+* slices, and append them to the current section of `writer` in affine form
+*/
+template <typename T, typename ScalarFn>
+void write_batch_exp(
+    mapped_pk_writer &writer,
+    const size_t window,
+    const libff::window_table<T> &table,
+    const size_t count,
+    const ScalarFn &scalar,
+    const size_t num_threads,
+    const char *stage,
+    const keygen_progress_fn &progress)
+{
+    const size_t scalar_size = FieldT::size_in_bits();
+    std::vector<T> points;
+    std::vector<mapped_point<T>> stored;
+    for (size_t begin = 0; begin < count; begin += KEYGEN_SLICE)
+    {
+        const size_t end = std::min(count, begin + KEYGEN_SLICE);
+        points.resize(end - begin);
+        parallel_for(begin, end, num_threads, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++)
+                points[i - begin] = libff::windowed_exp(scalar_size, window, table, scalar(i));
+        });
+        libff::batch_to_special<T>(points);
+        stored.clear();
+        for (const auto &point : points)
+            stored.emplace_back(to_mapped_point(point));
+        writer.append(stored.data(), stored.size());
+        if (progress)
+            progress(stage, end, count);
+    }
+}
+
+/**
+* Generate a key pair for `cs`, writing the proving key to `pk_file` in the
+* sectioned layout. Returns false if the file can't be written.
+*/
+inline bool generate_mapped_keys(
+    ConstraintSystemT cs,
+    const size_t num_blocks,
+    const char *pk_file,
+    VerificationKeyT &out_vk,
+    const size_t num_threads,
+    const keygen_progress_fn &progress)
+{
+    std::unique_ptr<stats_phase> phase(new stats_phase("qap"));
+
+    cs.swap_AB_if_beneficial();
+
+    const FieldT t = FieldT::random_element();
+    const FieldT alpha = FieldT::random_element();
+    const FieldT beta = FieldT::random_element();
+    const FieldT gamma = FieldT::random_element();
+    const FieldT delta = FieldT::random_element();
+    const FieldT gamma_inverse = gamma.inverse();
+    const FieldT delta_inverse = delta.inverse();
+
+    const size_t num_inputs = cs.num_inputs();
+    const size_t num_variables = cs.num_variables();
+    const size_t num_constraints = cs.num_constraints();
+
+    // QAP polynomials evaluated at t, as r1cs_to_qap_instance_map_with_evaluation()
+    // does but without the powers of t, A, B and C are summed concurrently
+    const auto domain = libfqfft::get_evaluation_domain<FieldT>(num_constraints + num_inputs + 1);
+    const FieldT Zt = domain->compute_vanishing_polynomial(t);
+    std::vector<FieldT> At(num_variables + 1, FieldT::zero());
+    std::vector<FieldT> Bt(num_variables + 1, FieldT::zero());
+    std::vector<FieldT> Kt(num_variables + 1, FieldT::zero());
+    {
+        const std::vector<FieldT> u = domain->evaluate_all_lagrange_polynomials(t);
+
+        // input_i * 0 = 0, for the soundness of the input consistency
+        for (size_t i = 0; i <= num_inputs; i++)
+            At[i] = u[num_constraints + i];
+
+        auto evaluate = [&](std::vector<FieldT> &out, libsnark::linear_combination<FieldT> libsnark::r1cs_constraint<FieldT>::*lc) {
+            for (size_t i = 0; i < num_constraints; i++)
+            {
+                for (const auto &term : (cs.constraints[i].*lc).terms)
+                    out[term.index] += u[i] * term.coeff;
+            }
+        };
+        std::thread b_thread(evaluate, std::ref(Bt), &libsnark::r1cs_constraint<FieldT>::b);
+        std::thread c_thread(evaluate, std::ref(Kt), &libsnark::r1cs_constraint<FieldT>::c);
+        evaluate(At, &libsnark::r1cs_constraint<FieldT>::a);
+        b_thread.join();
+        c_thread.join();
+    }
+
+    // Kt = (beta * At + alpha * Bt + Ct) / gamma for the inputs, / delta for the rest
+    parallel_for(0, num_variables + 1, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            Kt[i] = (beta * At[i] + alpha * Bt[i] + Kt[i]) * (i <= num_inputs ? gamma_inverse : delta_inverse);
+    });
+
+    std::vector<uint64_t> b_indices;
+    size_t non_zero_At = 0;
+    for (size_t i = 0; i <= num_variables; i++)
+    {
+        if (!At[i].is_zero())
+            non_zero_At++;
+        if (!Bt[i].is_zero())
+            b_indices.push_back(i);
+    }
+
+    // Window tables sized for the whole key, as the libsnark generator does
+    phase.reset(new stats_phase("tables"));
+    const size_t scalar_size = FieldT::size_in_bits();
+    const libff::G1<ppT> g1_generator = libff::G1<ppT>::random_element();
+    const libff::G2<ppT> g2_generator = libff::G2<ppT>::random_element();
+    const size_t g1_window = libff::get_exp_window_size<libff::G1<ppT>>(non_zero_At + b_indices.size() + num_variables);
+    const size_t g2_window = libff::get_exp_window_size<libff::G2<ppT>>(b_indices.size());
+    const libff::window_table<libff::G1<ppT>> g1_table = libff::get_window_table(scalar_size, g1_window, g1_generator);
+    const libff::window_table<libff::G2<ppT>> g2_table = libff::get_window_table(scalar_size, g2_window, g2_generator);
+
+    const libff::G1<ppT> alpha_g1 = alpha * g1_generator;
+    const libff::G1<ppT> beta_g1 = beta * g1_generator;
+    const libff::G2<ppT> beta_g2 = beta * g2_generator;
+    const libff::G1<ppT> delta_g1 = delta * g1_generator;
+    const libff::G2<ppT> delta_g2 = delta * g2_generator;
+
+    // Groth's H is of degree d - 2, so the last two powers of t are dropped
+    const size_t h_count = domain->m - 1;
+
+    std::vector<mapped_pk_writer::section_size> sizes = {
+        {sizeof(mapped_g1), 3},
+        {sizeof(mapped_g2), 2},
+        {sizeof(mapped_g1), num_variables + 1},
+        {sizeof(uint64_t), b_indices.size()},
+        {sizeof(mapped_commitment), b_indices.size()},
+        {sizeof(mapped_g1), h_count},
+        {sizeof(mapped_g1), num_variables - num_inputs},
+    };
+    constraint_system_section_sizes(cs, sizes);
+
+    mapped_pk_writer writer(pk_file, make_mapped_pk_header(cs, num_blocks, num_variables + 1), sizes);
+    if (!writer.good())
+        return false;
+
+    const std::vector<libff::G1<ppT>> g1_constants = {alpha_g1, beta_g1, delta_g1};
+    const std::vector<libff::G2<ppT>> g2_constants = {beta_g2, delta_g2};
+    append_points(writer, g1_constants.data(), g1_constants.size());
+    append_points(writer, g2_constants.data(), g2_constants.size());
+
+    phase.reset(new stats_phase("A_query"));
+    write_batch_exp(writer, g1_window, g1_table, At.size(), [&](size_t i) -> const FieldT & { return At[i]; }, num_threads, "A_query", progress);
+    std::vector<FieldT>().swap(At);
+
+    // B_query only holds the non-zero entries, each in both groups
+    phase.reset(new stats_phase("B_query"));
+    writer.append(b_indices.data(), b_indices.size());
+    {
+        std::vector<mapped_commitment> points;
+        std::vector<libff::G2<ppT>> g_points;
+        std::vector<libff::G1<ppT>> h_points;
+        for (size_t begin = 0; begin < b_indices.size(); begin += KEYGEN_SLICE)
+        {
+            const size_t end = std::min(b_indices.size(), begin + KEYGEN_SLICE);
+            g_points.resize(end - begin);
+            h_points.resize(end - begin);
+            parallel_for(begin, end, num_threads, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; i++)
+                {
+                    const FieldT &scalar = Bt[b_indices[i]];
+                    g_points[i - begin] = libff::windowed_exp(scalar_size, g2_window, g2_table, scalar);
+                    h_points[i - begin] = libff::windowed_exp(scalar_size, g1_window, g1_table, scalar);
+                }
+            });
+            libff::batch_to_special<libff::G2<ppT>>(g_points);
+            libff::batch_to_special<libff::G1<ppT>>(h_points);
+            points.clear();
+            for (size_t i = 0; i < g_points.size(); i++)
+                points.push_back({to_mapped_point(g_points[i]), to_mapped_point(h_points[i])});
+            writer.append(points.data(), points.size());
+            if (progress)
+                progress("B_query", end, b_indices.size());
+        }
+    }
+    std::vector<FieldT>().swap(Bt);
+    std::vector<uint64_t>().swap(b_indices);
+
+    // H_query[i] = t^i * Z(t) / delta, each slice starts from its own power of t
+    phase.reset(new stats_phase("H_query"));
+    {
+        const FieldT h_coeff = Zt * delta_inverse;
+        std::vector<FieldT> Ht;
+        for (size_t begin = 0; begin < h_count; begin += KEYGEN_SLICE)
+        {
+            const size_t end = std::min(h_count, begin + KEYGEN_SLICE);
+            Ht.resize(end - begin);
+            parallel_for(begin, end, num_threads, [&](size_t lo, size_t hi) {
+                FieldT ti = h_coeff * (t ^ lo);
+                for (size_t i = lo; i < hi; i++)
+                {
+                    Ht[i - begin] = ti;
+                    ti *= t;
+                }
+            });
+            write_batch_exp(writer, g1_window, g1_table, Ht.size(), [&](size_t i) -> const FieldT & { return Ht[i]; }, num_threads, nullptr, nullptr);
+            if (progress)
+                progress("H_query", end, h_count);
+        }
+    }
+
+    phase.reset(new stats_phase("L_query"));
+    write_batch_exp(writer, g1_window, g1_table, num_variables - num_inputs, [&](size_t i) -> const FieldT & { return Kt[num_inputs + 1 + i]; }, num_threads, "L_query", progress);
+
+    phase.reset(new stats_phase("constraints_write"));
+    write_constraint_system_sections(writer, cs);
+    if (!writer.finish())
+        return false;
+
+    // Verification key, its size only depends on the number of inputs
+    phase.reset(new stats_phase("vk"));
+    std::vector<libff::G1<ppT>> gamma_ABC_rest;
+    gamma_ABC_rest.reserve(num_inputs);
+    for (size_t i = 1; i <= num_inputs; i++)
+        gamma_ABC_rest.emplace_back(libff::windowed_exp(scalar_size, g1_window, g1_table, Kt[i]));
+    libff::G1<ppT> gamma_ABC_first = Kt[0] * g1_generator;
+
+    out_vk.alpha_g1 = alpha_g1;
+    out_vk.beta_g2 = beta_g2;
+    out_vk.gamma_g2 = gamma * g2_generator;
+    out_vk.delta_g2 = delta_g2;
+    out_vk.gamma_ABC_g1 = libsnark::accumulation_vector<libff::G1<ppT>>(std::move(gamma_ABC_first), std::move(gamma_ABC_rest));
+    return true;
+}
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef CONTINGENT_MERKLE_HPP_
+#define CONTINGENT_MERKLE_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+#include "gadgets/mimc.hpp"
+
+#include "contingent_parallel.hpp"
+
+/**
+* Witness of MiMC_merkle_root_gadget with its levels split between threads
+*
+* The gadget hashes the whole tree one node after the other. For a power of
+* two number of leaves the tree is made of equal, power of two subtrees and
+* a top tree over their roots, so the subtrees are computed concurrently,
+* each on a scratch protoboard, then the top tree.
+*
+* The gadget doesn't expose which of its variables belong to which node, so
+* a plan mapping every variable of the whole tree to the one of a subtree or
+* of the top tree holding the same value is worked out once per number of
+* leaves, from a witness for random leaves. The plan is then checked against
+* the gadget's own witness for other random leaves, and not used if they
+* differ.
+*/
+
+namespace ethsnarks
+{
+
+/**
+* Values of the variables a MiMC_merkle_root_gadget over `leaves` allocates,
+* in order, and optionally its root
+*/
+inline std::vector<FieldT> merkle_gadget_witness(const std::vector<FieldT> &leaves, FieldT *out_root = nullptr)
+{
+    ProtoboardT pb;
+    const VariableArrayT in_leaves = make_var_array(pb, leaves.size(), "leaves");
+    const size_t begin = pb.num_variables() + 1;
+    MiMC_merkle_root_gadget gadget(pb, in_leaves, "merkle_root_gadget");
+    const size_t end = pb.num_variables() + 1;
+
+    in_leaves.fill_with_field_elements(pb, leaves);
+    gadget.generate_r1cs_witness();
+    if (out_root != nullptr)
+        *out_root = pb.val(gadget.result());
+
+    std::vector<FieldT> values;
+    values.reserve(end - begin);
+    for (size_t i = begin; i < end; i++)
+        values.emplace_back(pb.val(VariableT(i)));
+    return values;
+}
+
+/**
+* Witnesses of the `num_subtrees` subtrees of `leaves`, computed
+* concurrently, followed by the one of the top tree over their roots
+*/
+inline std::vector<std::vector<FieldT>> merkle_subtree_witnesses(const size_t num_subtrees, const std::vector<FieldT> &leaves)
+{
+    const size_t subtree_size = leaves.size() / num_subtrees;
+    std::vector<std::vector<FieldT>> witnesses(num_subtrees + 1);
+    std::vector<FieldT> roots(num_subtrees);
+    parallel_for(0, num_subtrees, num_subtrees, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            const auto begin = leaves.begin() + (i * subtree_size);
+            witnesses[i] = merkle_gadget_witness(std::vector<FieldT>(begin, begin + subtree_size), &roots[i]);
+        }
+    });
+    witnesses.back() = merkle_gadget_witness(roots);
+    return witnesses;
+}
+
+/**
+* Where each variable of the whole tree is found in merkle_subtree_witnesses()
+*/
+struct merkle_witness_plan
+{
+    // 1 when the tree isn't split, the gadget's own witness is used then
+    size_t num_subtrees = 1;
+
+    // For every variable of the tree, the witness holding it, num_subtrees
+    // being the top tree, and its offset there
+    std::vector<std::pair<uint32_t, uint32_t>> sources;
+};
+
+/**
+* Witness of the whole tree over `leaves` assembled from its subtrees
+*/
+inline std::vector<FieldT> merkle_witness_with_plan(const merkle_witness_plan &plan, const std::vector<FieldT> &leaves)
+{
+    const auto witnesses = merkle_subtree_witnesses(plan.num_subtrees, leaves);
+
+    std::vector<FieldT> values;
+    values.reserve(plan.sources.size());
+    for (const auto &source : plan.sources)
+        values.emplace_back(witnesses[source.first][source.second]);
+    return values;
+}
+
+/**
+* Split a tree of `num_leaves` into at most `max_subtrees` subtrees of at
+* least two leaves each, see the top of this file
+*/
+inline merkle_witness_plan make_merkle_witness_plan(const size_t num_leaves, const size_t max_subtrees)
+{
+    size_t num_subtrees = 1;
+    if (num_leaves != 0 && (num_leaves & (num_leaves - 1)) == 0)
+    {
+        while ((num_subtrees * 2) <= max_subtrees && (num_leaves / (num_subtrees * 2)) >= 2)
+            num_subtrees *= 2;
+    }
+    if (num_subtrees == 1)
+        return merkle_witness_plan();
+
+    auto random_leaves = [num_leaves]() {
+        std::vector<FieldT> leaves(num_leaves);
+        for (auto &leaf : leaves)
+            leaf = FieldT::random_element();
+        return leaves;
+    };
+
+    // Every variable depending on the leaves holds a value of its own, the
+    // lowest limb is only used to look them up
+    const auto leaves = random_leaves();
+    const auto whole = merkle_gadget_witness(leaves);
+    const auto witnesses = merkle_subtree_witnesses(num_subtrees, leaves);
+
+    std::unordered_multimap<uint64_t, std::pair<uint32_t, uint32_t>> by_value;
+    for (size_t i = 0; i < witnesses.size(); i++)
+    {
+        for (size_t j = 0; j < witnesses[i].size(); j++)
+            by_value.emplace(witnesses[i][j].as_bigint().data[0], std::make_pair(uint32_t(i), uint32_t(j)));
+    }
+
+    merkle_witness_plan plan;
+    plan.num_subtrees = num_subtrees;
+    plan.sources.reserve(whole.size());
+    for (const auto &value : whole)
+    {
+        const auto range = by_value.equal_range(value.as_bigint().data[0]);
+        auto it = range.first;
+        while (it != range.second && witnesses[it->second.first][it->second.second] != value)
+            it++;
+        if (it == range.second)
+            return merkle_witness_plan();
+        plan.sources.emplace_back(it->second);
+    }
+
+    const auto check_leaves = random_leaves();
+    if (merkle_witness_with_plan(plan, check_leaves) != merkle_gadget_witness(check_leaves))
+        return merkle_witness_plan();
+
+    return plan;
+}
+
+/**
+* The plan for `num_leaves`, worked out on first use for one subtree per
+* core
+*/
+inline std::shared_ptr<const merkle_witness_plan> merkle_witness_plan_for(const size_t num_leaves)
+{
+    static std::mutex mutex;
+    static std::map<size_t, std::shared_ptr<const merkle_witness_plan>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &plan = plans[num_leaves];
+    if (!plan)
+        plan = std::make_shared<merkle_witness_plan>(make_merkle_witness_plan(num_leaves, resolve_num_threads(0)));
+    return plan;
+}
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef CONTINGENT_NATIVE_HPP_
+#define CONTINGENT_NATIVE_HPP_
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "contingent.hpp"
+#include "contingent_parallel.hpp"
+
+/**
+* Out-of-circuit evaluation of the contingent primitives
+*
+* These run the witness generation of the same gadgets used by
+* contingent_gadget on a scratch protoboard, without generating any
+* constraints, so the results are guaranteed to match what the circuit
+* computes.
+*/
+
+namespace ethsnarks
+{
+
+inline bool is_power_of_two(const size_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+/**
+* plaintext_root = mimc_merkle_root(leaves)
+*
+* The tree is a plain binary tree over the leaves, so for a power of two
+* number of leaves the root of the roots of equal sized, power of two
+* subtrees is the root of the whole tree.
+*/
+inline FieldT mimc_merkle_root(const std::vector<FieldT> &leaves)
+{
+    ProtoboardT pb;
+    const VariableArrayT in_leaves = make_var_array(pb, leaves.size(), "leaves");
+    MiMC_merkle_root_gadget gadget(pb, in_leaves, "merkle_root_gadget");
+
+    in_leaves.fill_with_field_elements(pb, leaves);
+    gadget.generate_r1cs_witness();
+
+    return pb.val(gadget.result());
+}
+
+/**
+* ciphertext = mimc_enc(key, plaintext)
+*/
+inline std::vector<FieldT> mimc_encrypt(const FieldT &key, const std::vector<FieldT> &plaintext)
+{
+    ProtoboardT pb;
+    const VariableT in_key = make_variable(pb, "key");
+    const VariableArrayT in_plaintext = make_var_array(pb, plaintext.size(), "plaintext");
+    MiMC_encrypt_gadget gadget(pb, in_key, in_plaintext, "mimc_encrypt_gadget");
+
+    pb.val(in_key) = key;
+    in_plaintext.fill_with_field_elements(pb, plaintext);
+    gadget.generate_r1cs_witness();
+
+    return gadget.result().get_vals(pb);
+}
+
+/**
+* Exponent of the inverse of x -> x^7, i.e. 1/7 mod (p - 1), which exists
+* because gcd(7, p - 1) = 1 for the alt_bn128 scalar field
+*/
+inline const libff::bigint<FieldT::num_limbs> &mimc_inverse_exponent()
+{
+    static const libff::bigint<FieldT::num_limbs> exponent = [] {
+        mpz_t order, e;
+        mpz_init(order);
+        mpz_init_set_ui(e, 7);
+        FieldT::mod.to_mpz(order);
+        mpz_sub_ui(order, order, 1);
+        mpz_invert(e, e, order);
+        const libff::bigint<FieldT::num_limbs> result(e);
+        mpz_clear(e);
+        mpz_clear(order);
+        return result;
+    }();
+    return exponent;
+}
+
+/**
+* plaintext = mimc_dec(key, ciphertext)
+*
+* MiMC_encrypt_gadget applies the keyed MiMCe7 permutation to every block:
+* each round is x = (x + key + C[i])^7 and the key is added to the result.
+* There is no gadget for the inverse, so the rounds are undone natively with
+* the same round constants, taking 7th roots.
+*/
+inline std::vector<FieldT> mimc_decrypt(const FieldT &key, const std::vector<FieldT> &ciphertext)
+{
+    static const std::vector<FieldT> round_constants = MiMCe7_gadget::constants_assign();
+    const auto &exponent = mimc_inverse_exponent();
+
+    std::vector<FieldT> plaintext;
+    plaintext.reserve(ciphertext.size());
+    for (const auto &block : ciphertext)
+    {
+        FieldT x = block - key;
+        for (auto it = round_constants.rbegin(); it != round_constants.rend(); it++)
+            x = (x ^ exponent) - key - *it;
+        plaintext.emplace_back(x);
+    }
+    return plaintext;
+}
+
+/**
+* key_hash as checked by contingent_gadget, in the 32 byte form taken by
+* the C API: SHA256 of the key as 32 little-endian bytes, or the big-endian
+* MiMC commitment with CONTINGENT_CIRCUIT_MIMC_KEY
+*/
+inline std::vector<uint8_t> contingent_key_hash(const FieldT &key, const unsigned int circuit)
+{
+    ProtoboardT pb;
+    const VariableT in_key = make_variable(pb, "key");
+    pb.val(in_key) = key;
+
+    if (circuit & CONTINGENT_CIRCUIT_MIMC_KEY)
+    {
+        contingent_gadget::CommitT gadget(pb, VariableT(0), VariableArrayT(1, in_key), "key_commit_gadget");
+        gadget.generate_r1cs_witness();
+        return field_to_bytes_be(pb.val(gadget.result()));
+    }
+
+    const VariableArrayT key_bits = make_var_array(pb, 256, "key_bits");
+    contingent_gadget::PackT pack_gadget(pb, key_bits, in_key, "key_pack_gadget");
+    contingent_gadget::HashT hash_gadget(pb, key_bits, "key_hash_gadget");
+    pack_gadget.generate_r1cs_witness_from_packed();
+    hash_gadget.generate_r1cs_witness();
+    return bv_to_bytes_msb(hash_gadget.result().get_digest());
+}
+
+/**
+* mimc_encrypt() with the blocks split between `num_threads` threads, every
+* block is encrypted on its own
+*/
+inline std::vector<FieldT> mimc_encrypt_parallel(const FieldT &key, const std::vector<FieldT> &plaintext, const size_t num_threads)
+{
+    std::vector<FieldT> ciphertext(plaintext.size());
+    parallel_for(0, plaintext.size(), num_threads, [&](size_t lo, size_t hi) {
+        const auto range = mimc_encrypt(key, std::vector<FieldT>(plaintext.begin() + lo, plaintext.begin() + hi));
+        std::copy(range.begin(), range.end(), ciphertext.begin() + lo);
+    });
+    return ciphertext;
+}
+
+/**
+* mimc_decrypt() with the blocks split between `num_threads` threads
+*/
+inline std::vector<FieldT> mimc_decrypt_parallel(const FieldT &key, const std::vector<FieldT> &ciphertext, const size_t num_threads)
+{
+    std::vector<FieldT> plaintext(ciphertext.size());
+    parallel_for(0, ciphertext.size(), num_threads, [&](size_t lo, size_t hi) {
+        const auto range = mimc_decrypt(key, std::vector<FieldT>(ciphertext.begin() + lo, ciphertext.begin() + hi));
+        std::copy(range.begin(), range.end(), plaintext.begin() + lo);
+    });
+    return plaintext;
+}
+
+/**
+* mimc_merkle_root() with equal power of two subtrees computed concurrently,
+* then the root of their roots. Falls back to one thread when the number of
+* leaves isn't a power of two.
+*/
+inline FieldT mimc_merkle_root_parallel(const std::vector<FieldT> &leaves, const size_t num_threads)
+{
+    const size_t max_subtrees = resolve_num_threads(num_threads);
+    size_t num_subtrees = 1;
+    if (is_power_of_two(leaves.size()))
+    {
+        while ((num_subtrees * 2) <= max_subtrees && (leaves.size() / (num_subtrees * 2)) >= 2)
+            num_subtrees *= 2;
+    }
+
+    if (num_subtrees == 1)
+        return mimc_merkle_root(leaves);
+
+    const size_t subtree_size = leaves.size() / num_subtrees;
+    std::vector<FieldT> roots(num_subtrees);
+    parallel_for(0, num_subtrees, num_subtrees, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            const auto begin = leaves.begin() + (i * subtree_size);
+            roots[i] = mimc_merkle_root(std::vector<FieldT>(begin, begin + subtree_size));
+        }
+    });
+
+    return mimc_merkle_root(roots);
+}
+
+/**
+* Check the arguments of a proof natively before its witness is generated:
+* the key hash, the encryption of each of the `ciphertext` blocks and the
+* plaintext root, the plaintext being zero-padded to the circuit's blocks.
+* It takes milliseconds where evaluating the constraints takes seconds, and
+* `out_error` says which check, or which block, failed.
+*
+* The plaintext root isn't checked without `check_root`, for a caller which
+* compares it with the Merkle tree of its witness instead, or a root which
+* was computed from the plaintext in the first place.
+*/
+inline bool precheck_contingent(
+    const unsigned int circuit,
+    const uint8_t *in_key_hash,
+    const std::vector<FieldT> &ciphertext,
+    const FieldT &plaintext_root,
+    const FieldT &key,
+    const std::vector<FieldT> &plaintext,
+    const size_t num_threads,
+    std::string &out_error,
+    const bool check_root = true)
+{
+    const auto key_hash = contingent_key_hash(key, circuit);
+    if (0 != ::memcmp(key_hash.data(), in_key_hash, key_hash.size()))
+    {
+        out_error = "Key hash is not the hash of the key";
+        return false;
+    }
+
+    const auto expected = mimc_encrypt_parallel(key, std::vector<FieldT>(plaintext.begin(), plaintext.begin() + ciphertext.size()), num_threads);
+    for (size_t i = 0; i < ciphertext.size(); i++)
+    {
+        if (expected[i] != ciphertext[i])
+        {
+            out_error = "Ciphertext block " + std::to_string(i) + " is not the encryption of plaintext block " + std::to_string(i);
+            return false;
+        }
+    }
+
+    if (check_root && mimc_merkle_root_parallel(plaintext, num_threads) != plaintext_root)
+    {
+        out_error = "Plaintext root is not the Merkle root of the plaintext";
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace ethsnarks
+
+#endif
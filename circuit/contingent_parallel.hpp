@@ -0,0 +1,210 @@
+#ifndef CONTINGENT_PARALLEL_HPP_
+#define CONTINGENT_PARALLEL_HPP_
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ethsnarks
+{
+
+/**
+* Number of worker threads to use when the caller asked for `num_threads`,
+* 0 means one per core
+*/
+inline size_t resolve_num_threads(const size_t num_threads)
+{
+    if (num_threads != 0)
+        return num_threads;
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+* Split [begin, end) into at most `num_threads` contiguous ranges and call
+* `func(range_begin, range_end)` for each of them concurrently. The calling
+* thread processes the first range itself.
+*/
+template <typename FuncT>
+void parallel_for(const size_t begin, const size_t end, const size_t num_threads, FuncT func)
+{
+    if (end <= begin)
+        return;
+
+    const size_t count = end - begin;
+    const size_t num_ranges = std::min(resolve_num_threads(num_threads), count);
+    const size_t range_size = (count + num_ranges - 1) / num_ranges;
+
+    std::vector<std::thread> workers;
+    for (size_t lo = begin + range_size; lo < end; lo += range_size)
+    {
+        const size_t hi = std::min(end, lo + range_size);
+        workers.emplace_back([=, &func]() { func(lo, hi); });
+    }
+
+    func(begin, std::min(end, begin + range_size));
+
+    for (auto &t : workers)
+        t.join();
+}
+
+/**
+* How many threads the FFTs and multi-exponentiations of a proof or key
+* generation may use, and optionally the cores they are pinned to
+*/
+struct thread_budget
+{
+    // 0 keeps the OpenMP default, normally one per core
+    size_t num_threads;
+
+    // Pin the worker threads to cores first_core + 1 .. first_core +
+    // num_threads - 1, negative to leave them unpinned. The calling thread
+    // itself is never pinned.
+    int first_core;
+
+    thread_budget(size_t in_num_threads = 0, int in_first_core = -1)
+        : num_threads(in_num_threads), first_core(in_first_core)
+    {
+    }
+};
+
+/**
+* Budget used when none is given: by genkeys, the one-shot functions and
+* newly opened provers. Set it before starting any other work.
+*/
+inline thread_budget &default_thread_budget()
+{
+    static thread_budget budget;
+    return budget;
+}
+
+/**
+* Pin the calling thread to `core`, returns false when that isn't supported
+*/
+inline bool pin_current_thread(const int core)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+/**
+* CPU affinity of the calling thread, restored with set_current_affinity()
+*/
+struct thread_affinity
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+#endif
+    bool valid = false;
+};
+
+inline thread_affinity get_current_affinity()
+{
+    thread_affinity affinity;
+#ifdef __linux__
+    CPU_ZERO(&affinity.cpus);
+    affinity.valid = (0 == pthread_getaffinity_np(pthread_self(), sizeof(affinity.cpus), &affinity.cpus));
+#endif
+    return affinity;
+}
+
+inline void set_current_affinity(const thread_affinity &affinity)
+{
+#ifdef __linux__
+    if (affinity.valid)
+        pthread_setaffinity_np(pthread_self(), sizeof(affinity.cpus), &affinity.cpus);
+#else
+    (void)affinity;
+#endif
+}
+
+/**
+* Applies a thread_budget to the OpenMP parallel regions started by the
+* calling thread until it goes out of scope. The OpenMP thread count is a
+* per-thread setting, so provers running on different threads each keep
+* their own budget instead of all using every core.
+*
+* Only the workers of the OpenMP team are pinned, never the calling thread
+* (OpenMP thread 0), and they get the caller's affinity back when the
+* scope ends.
+*/
+class thread_budget_scope
+{
+public:
+    thread_budget_scope(const thread_budget &budget)
+        : m_pinned(false)
+    {
+#ifdef MULTICORE
+        m_previous = omp_get_max_threads();
+        m_num_threads = budget.num_threads ? budget.num_threads : m_previous;
+        omp_set_num_threads(m_num_threads);
+
+        // The same team of threads is reused by the following parallel
+        // regions of this thread, pin each of its workers once
+        if (budget.first_core >= 0 && m_num_threads > 1)
+        {
+            m_affinity = get_current_affinity();
+            m_pinned = true;
+#pragma omp parallel num_threads(m_num_threads)
+            {
+                if (omp_get_thread_num() != 0)
+                    pin_current_thread(budget.first_core + omp_get_thread_num());
+            }
+        }
+#else
+        (void)budget;
+        m_num_threads = 1;
+#endif
+    }
+
+    ~thread_budget_scope()
+    {
+#ifdef MULTICORE
+        if (m_pinned)
+        {
+#pragma omp parallel num_threads(m_num_threads)
+            {
+                if (omp_get_thread_num() != 0)
+                    set_current_affinity(m_affinity);
+            }
+        }
+        omp_set_num_threads(m_previous);
+#endif
+    }
+
+    // Number of threads parallel regions will use
+    size_t num_threads() const
+    {
+        return m_num_threads;
+    }
+
+private:
+    thread_budget_scope(const thread_budget_scope &) = delete;
+    thread_budget_scope &operator=(const thread_budget_scope &) = delete;
+
+    size_t m_num_threads;
+    bool m_pinned;
+#ifdef MULTICORE
+    int m_previous;
+    thread_affinity m_affinity;
+#endif
+};
+
+} // namespace ethsnarks
+
+#endif
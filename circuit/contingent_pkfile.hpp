@@ -0,0 +1,755 @@
+#ifndef CONTINGENT_PKFILE_HPP_
+#define CONTINGENT_PKFILE_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "contingent.hpp"
+#include "contingent_parallel.hpp"
+#include "contingent_prover.hpp"
+
+/**
+* Sectioned proving key layout
+*
+* The file starts with a fixed size header followed by a table of sections,
+* every section is aligned to a page boundary and holds a flat array of
+* fixed size elements:
+*
+*   header | section table | section 0 | section 1 | ...
+*
+* Field elements are stored exactly as libff keeps them in memory (Montgomery
+* form limbs). Curve points are stored by their affine X and Y only, two
+* thirds of libff's projective form, the point at infinity as (0, 0). The
+* file is read through a mapping, but every section is copied out of it into
+* a proving key of the process' own rather than parsed, points get Z = 1,
+* the special form mixed addition takes. Nothing is read in place or shared
+* between processes loading the same file. The header records the limb size
+* of the host which wrote the file, and loading fails if it differs.
+*
+* The constraint system is stored as well, as flat arrays of term indices
+* and coefficients with an offset table per linear combination, so the
+* prover doesn't have to regenerate it.
+*
+* Each section carries a checksum over 1 MiB chunks, which is verified while
+* the chunks are copied out in parallel.
+*/
+
+namespace ethsnarks
+{
+
+static const char MAPPED_PK_MAGIC[8] = {'Z', 'K', 'C', 'P', 'P', 'K', 'E', 'Y'};
+static const uint32_t MAPPED_PK_VERSION = 1;
+static const size_t MAPPED_PK_ALIGN = 4096;
+static const size_t MAPPED_PK_CHUNK = 1 << 20;
+
+// Points converted to the affine form and written at a time
+static const size_t MAPPED_PK_SLICE = 1 << 16;
+
+enum mapped_pk_section_id
+{
+    PK_SECTION_G1_CONSTANTS = 1, // alpha_g1, beta_g1, delta_g1
+    PK_SECTION_G2_CONSTANTS,     // beta_g2, delta_g2
+    PK_SECTION_A_QUERY,
+    PK_SECTION_B_QUERY_INDICES,
+    PK_SECTION_B_QUERY_VALUES,
+    PK_SECTION_H_QUERY,
+    PK_SECTION_L_QUERY,
+    PK_SECTION_CS_OFFSETS,       // 3 * num_constraints + 1 term offsets
+    PK_SECTION_CS_INDICES,
+    PK_SECTION_CS_COEFFS,
+    PK_SECTION_COUNT = PK_SECTION_CS_COEFFS
+};
+
+struct mapped_pk_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t limb_bits;
+    uint64_t num_blocks;
+    uint64_t num_constraints;
+    uint64_t primary_input_size;
+    uint64_t auxiliary_input_size;
+    uint64_t b_query_domain_size;
+    uint64_t num_sections;
+    uint64_t checksum; // of the header, with this field zeroed, and the section table
+};
+
+struct mapped_pk_section
+{
+    uint32_t id;
+    uint32_t elem_size;
+    uint64_t count;
+    uint64_t offset;
+    uint64_t checksum;
+};
+
+/**
+* A point as stored in the file, its affine coordinates
+*/
+template <typename PointT>
+struct mapped_point
+{
+    decltype(PointT::X) X;
+    decltype(PointT::Y) Y;
+};
+
+typedef mapped_point<libff::G1<ppT>> mapped_g1;
+typedef mapped_point<libff::G2<ppT>> mapped_g2;
+
+// B_query entries, in both groups
+struct mapped_commitment
+{
+    mapped_g2 g;
+    mapped_g1 h;
+};
+
+/**
+* Affine coordinates of a point already in the special form, with Z = 1 or
+* the point at infinity
+*/
+template <typename PointT>
+inline mapped_point<PointT> to_mapped_point(const PointT &point)
+{
+    mapped_point<PointT> out;
+    if (point.is_zero())
+    {
+        out.X = decltype(PointT::X)::zero();
+        out.Y = decltype(PointT::Y)::zero();
+        return out;
+    }
+    out.X = point.X;
+    out.Y = point.Y;
+    return out;
+}
+
+template <typename PointT>
+inline PointT from_mapped_point(const mapped_point<PointT> &point)
+{
+    if (point.X.is_zero() && point.Y.is_zero())
+        return PointT::zero();
+    return PointT(point.X, point.Y, decltype(PointT::Z)::one());
+}
+
+inline KnowledgeCommitmentT from_mapped_commitment(const mapped_commitment &point)
+{
+    return KnowledgeCommitmentT(from_mapped_point(point.g), from_mapped_point(point.h));
+}
+
+inline uint64_t checksum64(const uint8_t *data, const size_t size, uint64_t h = 0xcbf29ce484222325ULL)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        ::memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++)
+    {
+        h = (h ^ data[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/**
+* Checksum of a section, independent of how many threads computed it
+*/
+inline uint64_t section_checksum(const std::vector<uint64_t> &chunk_sums)
+{
+    return checksum64((const uint8_t *)chunk_sums.data(), chunk_sums.size() * sizeof(uint64_t));
+}
+
+inline size_t num_chunks(const size_t size)
+{
+    return (size + MAPPED_PK_CHUNK - 1) / MAPPED_PK_CHUNK;
+}
+
+inline bool is_mapped_pk_file(const char *pk_file)
+{
+    char magic[sizeof(MAPPED_PK_MAGIC)] = {0};
+    std::ifstream fh(pk_file, std::ios::binary);
+    fh.read(magic, sizeof(magic));
+    return fh && 0 == ::memcmp(magic, MAPPED_PK_MAGIC, sizeof(magic));
+}
+
+/**
+* Writes the sectioned layout one section at a time, in id order. The size of
+* every section is fixed up front so their offsets are known, the data is
+* then appended in pieces of any size and only one checksum chunk is kept in
+* memory. The header and section table are written last.
+*/
+class mapped_pk_writer
+{
+public:
+    struct section_size
+    {
+        uint32_t elem_size;
+        uint64_t count;
+    };
+
+    mapped_pk_writer(const char *pk_file, const mapped_pk_header &in_header, const std::vector<section_size> &sizes)
+        : m_fh(pk_file, std::ios::binary | std::ios::trunc),
+          m_header(in_header),
+          m_table(sizes.size()),
+          m_current(0),
+          m_written(0)
+    {
+        ::memcpy(m_header.magic, MAPPED_PK_MAGIC, sizeof(m_header.magic));
+        m_header.version = MAPPED_PK_VERSION;
+        m_header.limb_bits = GMP_NUMB_BITS;
+        m_header.num_sections = sizes.size();
+        m_header.checksum = 0;
+
+        uint64_t offset = sizeof(m_header) + sizeof(mapped_pk_section) * m_table.size();
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            offset = (offset + MAPPED_PK_ALIGN - 1) / MAPPED_PK_ALIGN * MAPPED_PK_ALIGN;
+            m_table[i].id = i + 1;
+            m_table[i].elem_size = sizes[i].elem_size;
+            m_table[i].count = sizes[i].count;
+            m_table[i].offset = offset;
+            offset += sizes[i].elem_size * sizes[i].count;
+        }
+
+        // Placeholder until finish()
+        const std::vector<char> head(m_table.empty() ? sizeof(m_header) : m_table[0].offset, 0);
+        m_fh.write(head.data(), head.size());
+        m_chunk.reserve(MAPPED_PK_CHUNK);
+    }
+
+    /**
+    * Append `count` elements to the current section, moving on to the next
+    * section once it's full
+    */
+    void append(const void *data, const size_t count)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        size_t size = count * m_table.at(m_current).elem_size;
+        m_written += count;
+        if (m_written > m_table[m_current].count)
+            throw std::runtime_error("proving key section overflow");
+
+        while (size > 0)
+        {
+            const size_t n = std::min(size, MAPPED_PK_CHUNK - m_chunk.size());
+            m_chunk.insert(m_chunk.end(), bytes, bytes + n);
+            bytes += n;
+            size -= n;
+            if (m_chunk.size() == MAPPED_PK_CHUNK)
+                flush_chunk();
+        }
+
+        if (m_written == m_table[m_current].count)
+            next_section();
+    }
+
+    /**
+    * Write the header and section table, every section must be complete
+    */
+    bool finish()
+    {
+        while (m_current < m_table.size() && m_table[m_current].count == 0)
+            next_section();
+        if (m_current != m_table.size())
+            throw std::runtime_error("proving key section is incomplete");
+
+        m_header.checksum = checksum64((const uint8_t *)m_table.data(), sizeof(mapped_pk_section) * m_table.size(),
+                                       checksum64((const uint8_t *)&m_header, sizeof(m_header)));
+
+        m_fh.seekp(0);
+        m_fh.write((const char *)&m_header, sizeof(m_header));
+        m_fh.write((const char *)m_table.data(), sizeof(mapped_pk_section) * m_table.size());
+        m_fh.flush();
+        return bool(m_fh);
+    }
+
+    bool good() const
+    {
+        return bool(m_fh);
+    }
+
+private:
+    void flush_chunk()
+    {
+        m_chunk_sums.push_back(checksum64(m_chunk.data(), m_chunk.size()));
+        m_fh.write((const char *)m_chunk.data(), m_chunk.size());
+        m_chunk.clear();
+    }
+
+    void next_section()
+    {
+        if (!m_chunk.empty())
+            flush_chunk();
+        m_table[m_current].checksum = section_checksum(m_chunk_sums);
+        m_chunk_sums.clear();
+        m_written = 0;
+
+        // Skip sections which are empty, and pad up to the next one
+        while (++m_current < m_table.size())
+        {
+            const std::vector<char> padding(m_table[m_current].offset - static_cast<uint64_t>(m_fh.tellp()), 0);
+            m_fh.write(padding.data(), padding.size());
+            if (m_table[m_current].count != 0)
+                break;
+            m_table[m_current].checksum = section_checksum(m_chunk_sums);
+        }
+    }
+
+    std::ofstream m_fh;
+    mapped_pk_header m_header;
+    std::vector<mapped_pk_section> m_table;
+    size_t m_current;
+    uint64_t m_written;
+    std::vector<uint8_t> m_chunk;
+    std::vector<uint64_t> m_chunk_sums;
+};
+
+/**
+* Append points to the current section of `writer` in the stored form, a
+* slice at a time so only one slice is ever converted.
+*/
+template <typename PointT>
+void append_points(mapped_pk_writer &writer, const PointT *points, const size_t count)
+{
+    std::vector<PointT> slice;
+    std::vector<mapped_point<PointT>> stored;
+    for (size_t begin = 0; begin < count; begin += MAPPED_PK_SLICE)
+    {
+        const size_t end = std::min(count, begin + MAPPED_PK_SLICE);
+        slice.assign(points + begin, points + end);
+        libff::batch_to_special<PointT>(slice);
+        stored.clear();
+        for (const auto &point : slice)
+            stored.emplace_back(to_mapped_point(point));
+        writer.append(stored.data(), stored.size());
+    }
+}
+
+/**
+* Same as append_points() for B_query entries, each in both groups
+*/
+inline void append_commitments(mapped_pk_writer &writer, const KnowledgeCommitmentT *points, const size_t count)
+{
+    std::vector<libff::G2<ppT>> g_points;
+    std::vector<libff::G1<ppT>> h_points;
+    std::vector<mapped_commitment> stored;
+    for (size_t begin = 0; begin < count; begin += MAPPED_PK_SLICE)
+    {
+        const size_t end = std::min(count, begin + MAPPED_PK_SLICE);
+        g_points.clear();
+        h_points.clear();
+        for (size_t i = begin; i < end; i++)
+        {
+            g_points.emplace_back(points[i].g);
+            h_points.emplace_back(points[i].h);
+        }
+        libff::batch_to_special<libff::G2<ppT>>(g_points);
+        libff::batch_to_special<libff::G1<ppT>>(h_points);
+        stored.clear();
+        for (size_t i = 0; i < g_points.size(); i++)
+            stored.push_back({to_mapped_point(g_points[i]), to_mapped_point(h_points[i])});
+        writer.append(stored.data(), stored.size());
+    }
+}
+
+/**
+* Header fields of a proving key in the sectioned layout, the rest is filled in
+* by mapped_pk_writer
+*/
+inline mapped_pk_header make_mapped_pk_header(const ConstraintSystemT &cs, const size_t num_blocks, const size_t b_query_domain_size)
+{
+    mapped_pk_header header;
+    ::memset(&header, 0, sizeof(header));
+    header.num_blocks = num_blocks;
+    header.num_constraints = cs.num_constraints();
+    header.primary_input_size = cs.primary_input_size;
+    header.auxiliary_input_size = cs.auxiliary_input_size;
+    header.b_query_domain_size = b_query_domain_size;
+    return header;
+}
+
+/**
+* Sizes of the constraint system sections, without flattening it
+*/
+inline void constraint_system_section_sizes(const ConstraintSystemT &cs, std::vector<mapped_pk_writer::section_size> &sizes)
+{
+    uint64_t num_terms = 0;
+    for (const auto &constraint : cs.constraints)
+        num_terms += constraint.a.terms.size() + constraint.b.terms.size() + constraint.c.terms.size();
+
+    sizes.push_back({sizeof(uint64_t), 3 * cs.num_constraints() + 1});
+    sizes.push_back({sizeof(uint64_t), num_terms});
+    sizes.push_back({sizeof(FieldT), num_terms});
+}
+
+/**
+* Append the PK_SECTION_CS_* sections, one constraint at a time
+*/
+inline void write_constraint_system_sections(mapped_pk_writer &writer, const ConstraintSystemT &cs)
+{
+    uint64_t offset = 0;
+    writer.append(&offset, 1);
+    for (const auto &constraint : cs.constraints)
+    {
+        for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c})
+        {
+            offset += lc->terms.size();
+            writer.append(&offset, 1);
+        }
+    }
+
+    for (const auto &constraint : cs.constraints)
+    {
+        for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c})
+        {
+            for (const auto &term : lc->terms)
+            {
+                const uint64_t index = term.index;
+                writer.append(&index, 1);
+            }
+        }
+    }
+
+    for (const auto &constraint : cs.constraints)
+    {
+        for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c})
+        {
+            for (const auto &term : lc->terms)
+                writer.append(&term.coeff, 1);
+        }
+    }
+}
+
+/**
+* Write a proving key in the sectioned layout
+*/
+inline bool write_mapped_pk(const ProvingKeyT &pk, const size_t num_blocks, const char *pk_file)
+{
+    std::vector<libff::G1<ppT>> g1_constants = {pk.alpha_g1, pk.beta_g1, pk.delta_g1};
+    std::vector<libff::G2<ppT>> g2_constants = {pk.beta_g2, pk.delta_g2};
+    const std::vector<uint64_t> b_indices(pk.B_query.indices.begin(), pk.B_query.indices.end());
+
+    std::vector<mapped_pk_writer::section_size> sizes = {
+        {sizeof(mapped_g1), g1_constants.size()},
+        {sizeof(mapped_g2), g2_constants.size()},
+        {sizeof(mapped_g1), pk.A_query.size()},
+        {sizeof(uint64_t), b_indices.size()},
+        {sizeof(mapped_commitment), pk.B_query.values.size()},
+        {sizeof(mapped_g1), pk.H_query.size()},
+        {sizeof(mapped_g1), pk.L_query.size()},
+    };
+    constraint_system_section_sizes(pk.constraint_system, sizes);
+
+    mapped_pk_writer writer(pk_file, make_mapped_pk_header(pk.constraint_system, num_blocks, pk.B_query.domain_size()), sizes);
+    if (!writer.good())
+        return false;
+
+    append_points(writer, g1_constants.data(), g1_constants.size());
+    append_points(writer, g2_constants.data(), g2_constants.size());
+    append_points(writer, pk.A_query.data(), pk.A_query.size());
+    writer.append(b_indices.data(), b_indices.size());
+    append_commitments(writer, pk.B_query.values.data(), pk.B_query.values.size());
+    append_points(writer, pk.H_query.data(), pk.H_query.size());
+    append_points(writer, pk.L_query.data(), pk.L_query.size());
+    write_constraint_system_sections(writer, pk.constraint_system);
+
+    return writer.finish();
+}
+
+/**
+* Read-only mapping of a whole file, unmapped on destruction
+*/
+class mapped_file
+{
+public:
+    const uint8_t *data;
+    size_t size;
+
+    mapped_file(const char *path)
+        : data(nullptr), size(0)
+    {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("cannot open ") + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error(std::string("cannot stat ") + path);
+        }
+
+        size = st.st_size;
+        void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error(std::string("cannot map ") + path);
+
+        ::madvise(addr, size, MADV_WILLNEED);
+        data = (const uint8_t *)addr;
+    }
+
+    ~mapped_file()
+    {
+        if (data != nullptr)
+            ::munmap((void *)data, size);
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+};
+
+/**
+* Copy a section out of the mapping into `out`, verifying its checksum
+*/
+template <typename T>
+void load_mapped_section(const mapped_file &file, const mapped_pk_section &section, std::vector<T> &out, const size_t num_threads)
+{
+    if (section.elem_size != sizeof(T))
+        throw std::runtime_error("proving key was written with a different point size");
+
+    const size_t size = section.elem_size * section.count;
+    if (section.offset + size > file.size)
+        throw std::runtime_error("proving key is truncated");
+
+    out.resize(section.count);
+    const uint8_t *src = file.data + section.offset;
+    uint8_t *dst = (uint8_t *)out.data();
+
+    std::vector<uint64_t> chunk_sums(num_chunks(size));
+    parallel_for(0, chunk_sums.size(), num_threads, [&](size_t lo, size_t hi) {
+        for (size_t j = lo; j < hi; j++)
+        {
+            const size_t begin = j * MAPPED_PK_CHUNK;
+            const size_t length = std::min(size - begin, MAPPED_PK_CHUNK);
+            ::memcpy(dst + begin, src + begin, length);
+            chunk_sums[j] = checksum64(dst + begin, length);
+        }
+    });
+
+    if (section_checksum(chunk_sums) != section.checksum)
+        throw std::runtime_error("proving key checksum mismatch");
+}
+
+/**
+* Verify the checksum of a section in place, returns its elements within the
+* mapping
+*/
+template <typename T>
+const T *mapped_section_data(const mapped_file &file, const mapped_pk_section &section, const size_t num_threads)
+{
+    if (section.elem_size != sizeof(T))
+        throw std::runtime_error("proving key was written with a different point size");
+
+    const size_t size = section.elem_size * section.count;
+    if (section.offset + size > file.size)
+        throw std::runtime_error("proving key is truncated");
+
+    const uint8_t *src = file.data + section.offset;
+    std::vector<uint64_t> chunk_sums(num_chunks(size));
+    parallel_for(0, chunk_sums.size(), num_threads, [&](size_t lo, size_t hi) {
+        for (size_t j = lo; j < hi; j++)
+        {
+            const size_t begin = j * MAPPED_PK_CHUNK;
+            chunk_sums[j] = checksum64(src + begin, std::min(size - begin, MAPPED_PK_CHUNK));
+        }
+    });
+
+    if (section_checksum(chunk_sums) != section.checksum)
+        throw std::runtime_error("proving key checksum mismatch");
+
+    return (const T *)src;
+}
+
+/**
+* Load the points of a section, verifying its checksum and converting them
+* out of the stored form in parallel
+*/
+template <typename PointT>
+void load_mapped_points(const mapped_file &file, const mapped_pk_section &section, std::vector<PointT> &out, const size_t num_threads)
+{
+    const mapped_point<PointT> *src = mapped_section_data<mapped_point<PointT>>(file, section, num_threads);
+    out.resize(section.count);
+    parallel_for(0, section.count, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            out[i] = from_mapped_point(src[i]);
+    });
+}
+
+inline void load_mapped_commitments(const mapped_file &file, const mapped_pk_section &section, std::vector<KnowledgeCommitmentT> &out, const size_t num_threads)
+{
+    const mapped_commitment *src = mapped_section_data<mapped_commitment>(file, section, num_threads);
+    out.resize(section.count);
+    parallel_for(0, section.count, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            out[i] = from_mapped_commitment(src[i]);
+    });
+}
+
+/**
+* Load a proving key written by write_mapped_pk(), throws on any mismatch
+*
+* With `out_compact` the constraint system is read straight from the mapping
+* into it, and the one of the proving key is left without constraints, only
+* its input and auxiliary sizes are set.
+*/
+inline ProvingKeyT load_mapped_pk(
+    const char *pk_file,
+    const size_t num_blocks,
+    const size_t num_threads = 0,
+    compact_constraint_system *out_compact = nullptr)
+{
+    const mapped_file file(pk_file);
+
+    mapped_pk_header header;
+    if (file.size < sizeof(header))
+        throw std::runtime_error("proving key is truncated");
+    ::memcpy(&header, file.data, sizeof(header));
+
+    if (0 != ::memcmp(header.magic, MAPPED_PK_MAGIC, sizeof(header.magic)) || header.version != MAPPED_PK_VERSION)
+        throw std::runtime_error("not a mapped proving key");
+    if (header.limb_bits != GMP_NUMB_BITS)
+        throw std::runtime_error("proving key was written with a different limb size");
+    if (header.num_blocks != num_blocks)
+        throw std::runtime_error("proving key is for " + std::to_string(header.num_blocks) + " blocks");
+    if (header.num_sections != PK_SECTION_COUNT || file.size < sizeof(header) + sizeof(mapped_pk_section) * header.num_sections)
+        throw std::runtime_error("proving key has an unexpected section table");
+
+    std::vector<mapped_pk_section> table(header.num_sections);
+    ::memcpy(table.data(), file.data + sizeof(header), sizeof(mapped_pk_section) * table.size());
+
+    const uint64_t expected_checksum = header.checksum;
+    header.checksum = 0;
+    if (expected_checksum != checksum64((const uint8_t *)table.data(), sizeof(mapped_pk_section) * table.size(),
+                                        checksum64((const uint8_t *)&header, sizeof(header))))
+        throw std::runtime_error("proving key header checksum mismatch");
+
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        if (table[i].id != i + 1)
+            throw std::runtime_error("proving key has an unexpected section table");
+    }
+
+    auto section = [&](const mapped_pk_section_id id) -> const mapped_pk_section & {
+        return table[id - 1];
+    };
+
+    ProvingKeyT pk;
+
+    std::vector<libff::G1<ppT>> g1_constants;
+    std::vector<libff::G2<ppT>> g2_constants;
+    load_mapped_points(file, section(PK_SECTION_G1_CONSTANTS), g1_constants, 1);
+    load_mapped_points(file, section(PK_SECTION_G2_CONSTANTS), g2_constants, 1);
+    if (g1_constants.size() != 3 || g2_constants.size() != 2)
+        throw std::runtime_error("proving key has unexpected constants");
+    pk.alpha_g1 = g1_constants[0];
+    pk.beta_g1 = g1_constants[1];
+    pk.delta_g1 = g1_constants[2];
+    pk.beta_g2 = g2_constants[0];
+    pk.delta_g2 = g2_constants[1];
+
+    load_mapped_points(file, section(PK_SECTION_A_QUERY), pk.A_query, num_threads);
+    load_mapped_points(file, section(PK_SECTION_H_QUERY), pk.H_query, num_threads);
+    load_mapped_points(file, section(PK_SECTION_L_QUERY), pk.L_query, num_threads);
+
+    std::vector<uint64_t> b_indices;
+    load_mapped_section(file, section(PK_SECTION_B_QUERY_INDICES), b_indices, num_threads);
+    load_mapped_commitments(file, section(PK_SECTION_B_QUERY_VALUES), pk.B_query.values, num_threads);
+    pk.B_query.indices.assign(b_indices.begin(), b_indices.end());
+    pk.B_query.domain_size_ = header.b_query_domain_size;
+
+    ConstraintSystemT &cs = pk.constraint_system;
+    cs.primary_input_size = header.primary_input_size;
+    cs.auxiliary_input_size = header.auxiliary_input_size;
+
+    if (out_compact != nullptr)
+    {
+        const mapped_pk_section &offsets_section = section(PK_SECTION_CS_OFFSETS);
+        const mapped_pk_section &indices_section = section(PK_SECTION_CS_INDICES);
+        const mapped_pk_section &coeffs_section = section(PK_SECTION_CS_COEFFS);
+        const uint64_t *offsets = mapped_section_data<uint64_t>(file, offsets_section, num_threads);
+        const uint64_t *indices = mapped_section_data<uint64_t>(file, indices_section, num_threads);
+        const FieldT *coeffs = mapped_section_data<FieldT>(file, coeffs_section, num_threads);
+        if (offsets_section.count != 3 * header.num_constraints + 1 || offsets[offsets_section.count - 1] != indices_section.count || indices_section.count != coeffs_section.count)
+            throw std::runtime_error("proving key has an inconsistent constraint system");
+
+        *out_compact = compact_constraint_system();
+        out_compact->primary_input_size = header.primary_input_size;
+        out_compact->auxiliary_input_size = header.auxiliary_input_size;
+        for (size_t i = 0; i < 3 * header.num_constraints; i++)
+        {
+            if (offsets[i] > offsets[i + 1])
+                throw std::runtime_error("proving key has an inconsistent constraint system");
+            for (uint64_t j = offsets[i]; j < offsets[i + 1]; j++)
+                out_compact->add_term(indices[j], coeffs[j]);
+            out_compact->end_linear_combination();
+        }
+        out_compact->finish();
+        return pk;
+    }
+
+    // Rebuild the constraint system from its flattened form, one constraint per
+    // element so the threads never touch the same linear combination
+    std::vector<uint64_t> offsets, indices;
+    std::vector<FieldT> coeffs;
+    load_mapped_section(file, section(PK_SECTION_CS_OFFSETS), offsets, num_threads);
+    load_mapped_section(file, section(PK_SECTION_CS_INDICES), indices, num_threads);
+    load_mapped_section(file, section(PK_SECTION_CS_COEFFS), coeffs, num_threads);
+    if (offsets.size() != 3 * header.num_constraints + 1 || offsets.back() != indices.size() || indices.size() != coeffs.size())
+        throw std::runtime_error("proving key has an inconsistent constraint system");
+
+    cs.constraints.resize(header.num_constraints);
+
+    parallel_for(0, header.num_constraints, num_threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            auto &constraint = cs.constraints[i];
+            libsnark::linear_combination<FieldT> *lcs[3] = {&constraint.a, &constraint.b, &constraint.c};
+            for (size_t k = 0; k < 3; k++)
+            {
+                const size_t begin = offsets[3 * i + k];
+                const size_t end = offsets[3 * i + k + 1];
+                lcs[k]->terms.reserve(end - begin);
+                for (size_t j = begin; j < end; j++)
+                    lcs[k]->terms.emplace_back(libsnark::variable<FieldT>(indices[j]), coeffs[j]);
+            }
+        }
+    });
+
+    return pk;
+}
+
+/**
+* Load a proving key in either the sectioned layout or the libsnark
+* serialization written by stub_genkeys_from_pb()
+*
+* With `out_compact` the constraint system ends up there instead, see
+* load_mapped_pk(). A libsnark serialized key is still read in full first.
+*/
+inline ProvingKeyT load_proving_key(const char *pk_file, const size_t num_blocks, compact_constraint_system *out_compact = nullptr)
+{
+    if (is_mapped_pk_file(pk_file))
+        return load_mapped_pk(pk_file, num_blocks, 0, out_compact);
+
+    ProvingKeyT pk = stub_load_pk_from_file(pk_file);
+    if (out_compact != nullptr)
+    {
+        out_compact->assign(pk.constraint_system);
+        std::vector<libsnark::r1cs_constraint<FieldT>>().swap(pk.constraint_system.constraints);
+    }
+    return pk;
+}
+
+} // namespace ethsnarks
+
+#endif
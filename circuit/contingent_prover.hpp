@@ -0,0 +1,469 @@
+#ifndef CONTINGENT_PROVER_HPP_
+#define CONTINGENT_PROVER_HPP_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+#include "contingent.hpp"
+#include "contingent_constraints.hpp"
+#include "contingent_stats.hpp"
+
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
+#include <libfqfft/evaluation_domain/get_evaluation_domain.hpp>
+#include <libsnark/knowledge_commitment/kc_multiexp.hpp>
+
+namespace ethsnarks
+{
+
+typedef libfqfft::evaluation_domain<FieldT> DomainT;
+typedef libsnark::r1cs_constraint_system<FieldT> ConstraintSystemT;
+typedef libsnark::r1cs_auxiliary_input<FieldT> AuxiliaryInputT;
+
+/**
+* Circuit template for a fixed number of blocks
+*
+* The constraint system of the contingent circuit only depends on
+* `num_blocks` and the circuit variant, so everything derived from it is built once and then shared
+* by every proof of that size:
+*
+*  - the QAP evaluation domain used by the prover FFTs
+*  - a pool of protoboards with the gadget already laid out, a proof only
+*    has to fill in the witness on one of them
+*/
+class contingent_circuit
+{
+public:
+    struct instance
+    {
+        ProtoboardT pb;
+        contingent_gadget gadget;
+
+        instance(const size_t num_blocks, const unsigned int circuit)
+            : pb(), gadget(pb, num_blocks, "contingent_gadget", circuit)
+        {
+        }
+
+        /**
+        * Run the gadgets on the secret inputs only, and read back the
+        * public inputs which would satisfy the circuit
+        */
+        void derive_public_inputs(
+            const FieldT &in_key,
+            const std::vector<FieldT> &in_plaintext,
+            std::vector<uint8_t> &out_key_hash,
+            std::vector<FieldT> &out_ciphertext,
+            FieldT &out_plaintext_root)
+        {
+            gadget.generate_r1cs_witness(
+                std::vector<FieldT>(gadget.m_in_key_hash.size(), FieldT::zero()),
+                std::vector<FieldT>(gadget.m_in_ciphertext.size(), FieldT::zero()),
+                FieldT::zero(),
+                in_key,
+                in_plaintext);
+
+            out_key_hash = gadget.key_hash_result();
+            out_ciphertext = gadget.m_encrypt_gadget.result().get_vals(pb);
+            out_plaintext_root = pb.val(gadget.m_merkle_root_gadget.result());
+        }
+    };
+
+    typedef std::unique_ptr<instance> InstancePtrT;
+
+    const size_t num_blocks;
+    const unsigned int circuit;
+
+    size_t num_constraints;
+    size_t num_inputs;
+    size_t num_variables;
+
+    std::shared_ptr<DomainT> domain;
+
+    contingent_circuit(const size_t in_num_blocks, const unsigned int in_circuit)
+        : num_blocks(in_num_blocks), circuit(in_circuit)
+    {
+        // Constraints are only generated once to find the size of the QAP,
+        // the pooled instances never carry any constraints
+        ProtoboardT pb;
+        contingent_gadget gadget(pb, num_blocks, "contingent_gadget", circuit);
+        gadget.generate_r1cs_constraints();
+
+        num_constraints = pb.num_constraints();
+        num_inputs = pb.num_inputs();
+        num_variables = pb.num_variables();
+
+        domain = libfqfft::get_evaluation_domain<FieldT>(num_constraints + num_inputs + 1);
+    }
+
+    /**
+    * Template sized after the constraint system of a proving key, so the
+    * constraints aren't generated a second time
+    */
+    contingent_circuit(const size_t in_num_blocks, const unsigned int in_circuit, const compact_constraint_system &cs)
+        : num_blocks(in_num_blocks),
+          circuit(in_circuit),
+          num_constraints(cs.num_constraints()),
+          num_inputs(cs.num_inputs()),
+          num_variables(cs.num_variables())
+    {
+        domain = libfqfft::get_evaluation_domain<FieldT>(num_constraints + num_inputs + 1);
+    }
+
+    /**
+    * Returns the shared template for `num_blocks` and a circuit variant,
+    * building it on first use, from `cs` when given
+    */
+    static std::shared_ptr<contingent_circuit> get(
+        const size_t num_blocks,
+        const unsigned int circuit = CONTINGENT_CIRCUIT_DEFAULT,
+        const compact_constraint_system *cs = nullptr)
+    {
+        static std::mutex cache_mutex;
+        static std::map<std::pair<size_t, unsigned int>, std::shared_ptr<contingent_circuit>> cache;
+
+        const auto cache_key = std::make_pair(num_blocks, circuit);
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(cache_key);
+        if (it != cache.end())
+            return it->second;
+
+        auto result = cs ? std::make_shared<contingent_circuit>(num_blocks, circuit, *cs)
+                         : std::make_shared<contingent_circuit>(num_blocks, circuit);
+        cache[cache_key] = result;
+        return result;
+    }
+
+    /**
+    * Take a witness instance from the pool, it must be given back with
+    * release() once the proof has been made
+    */
+    InstancePtrT acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pool_mutex);
+            if (!m_pool.empty())
+            {
+                InstancePtrT inst = std::move(m_pool.back());
+                m_pool.pop_back();
+                return inst;
+            }
+        }
+        return InstancePtrT(new instance(num_blocks, circuit));
+    }
+
+    void release(InstancePtrT inst)
+    {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+        m_pool.emplace_back(std::move(inst));
+    }
+
+private:
+    std::mutex m_pool_mutex;
+    std::vector<InstancePtrT> m_pool;
+};
+
+/**
+* Decimal representation of a field element, as accepted by FieldT(const char*)
+*/
+inline std::string field_to_decimal(const FieldT &value)
+{
+    mpz_t t;
+    mpz_init(t);
+    value.as_bigint().to_mpz(t);
+    std::vector<char> buf(mpz_sizeinbase(t, 10) + 2, 0);
+    mpz_get_str(buf.data(), 10, t);
+    mpz_clear(t);
+    return std::string(buf.data());
+}
+
+/**
+* Coefficients of H(X) = (A(X)*B(X) - C(X)) / Z(X), this is libsnark's
+* r1cs_to_qap_witness_map() with d1 = d2 = d3 = 0 (as used by the ppzksnark
+* prover), but over a cached domain.
+*
+* The linear combinations are evaluated one at a time by `evaluate(i, k)`,
+* for the a (k = 0), b (k = 1) or c (k = 2) of constraint `i`, straight into
+* the FFT vectors, and `padded_assignment` is `1 || primary_input ||
+* auxiliary_input`, so the constraint system is never expanded or copied.
+*/
+template <typename EvaluateFn>
+std::vector<FieldT> qap_coefficients_for_H(
+    DomainT &domain,
+    const size_t num_constraints,
+    const size_t num_inputs,
+    const std::vector<FieldT> &padded_assignment,
+    const EvaluateFn &evaluate)
+{
+    // One spare element, so the result is returned without a copy
+    std::vector<FieldT> aA, aB(domain.m, FieldT::zero());
+    aA.reserve(domain.m + 1);
+    aA.resize(domain.m, FieldT::zero());
+
+    /* account for the additional constraints input_i * 0 = 0 */
+    for (size_t i = 0; i <= num_inputs; ++i)
+    {
+        aA[i + num_constraints] = padded_assignment[i];
+    }
+
+    /* account for all other constraints */
+    for (size_t i = 0; i < num_constraints; ++i)
+    {
+        aA[i] += evaluate(i, 0);
+        aB[i] += evaluate(i, 1);
+    }
+
+    domain.iFFT(aA);
+    domain.iFFT(aB);
+
+    domain.cosetFFT(aA, FieldT::multiplicative_generator);
+    domain.cosetFFT(aB, FieldT::multiplicative_generator);
+
+    std::vector<FieldT> &H_tmp = aA; // aA is not needed after this
+    for (size_t i = 0; i < domain.m; ++i)
+    {
+        H_tmp[i] = aA[i] * aB[i];
+    }
+
+    // aB is reused for C
+    std::vector<FieldT> &aC = aB;
+    std::fill(aC.begin(), aC.end(), FieldT::zero());
+    for (size_t i = 0; i < num_constraints; ++i)
+    {
+        aC[i] = evaluate(i, 2);
+    }
+
+    domain.iFFT(aC);
+    domain.cosetFFT(aC, FieldT::multiplicative_generator);
+
+    for (size_t i = 0; i < domain.m; ++i)
+    {
+        H_tmp[i] = (H_tmp[i] - aC[i]);
+    }
+    std::vector<FieldT>().swap(aB);
+
+    domain.divide_by_Z_on_coset(H_tmp);
+    domain.icosetFFT(H_tmp, FieldT::multiplicative_generator);
+
+    H_tmp.emplace_back(FieldT::zero());
+    return std::move(H_tmp);
+}
+
+/**
+* Same as above, for the linear combinations of a libsnark constraint system
+*/
+inline std::vector<FieldT> qap_coefficients_for_H(
+    DomainT &domain,
+    const ConstraintSystemT &cs,
+    const std::vector<FieldT> &padded_assignment)
+{
+    // linear_combination::evaluate() takes the assignment without the constant one
+    auto evaluate_lc = [&](const libsnark::linear_combination<FieldT> &lc) {
+        FieldT result = FieldT::zero();
+        for (const auto &term : lc.terms)
+            result += term.coeff * padded_assignment[term.index];
+        return result;
+    };
+
+    return qap_coefficients_for_H(domain, cs.num_constraints(), cs.num_inputs(), padded_assignment, [&](size_t i, size_t k) {
+        const auto &constraint = cs.constraints[i];
+        return evaluate_lc(k == 0 ? constraint.a : (k == 1 ? constraint.b : constraint.c));
+    });
+}
+
+/**
+* Number of multi-exponentiation chunks a single proof uses by default
+*/
+inline size_t prover_max_chunks()
+{
+#ifdef MULTICORE
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+typedef libsnark::knowledge_commitment<libff::G2<ppT>, libff::G1<ppT>> KnowledgeCommitmentT;
+
+/**
+* Multi-exponentiation terms of auxiliary variables whose values are the
+* same for many proofs, e.g. the plaintext and its Merkle tree when one file
+* is sold to many buyers. contingent_prover_run() adds them instead of going
+* over those variables again, only H depends on the whole witness.
+*/
+struct fixed_variables
+{
+    // [begin, end) variable indices, 0 being the constant one
+    std::vector<std::pair<size_t, size_t>> ranges;
+
+    libff::G1<ppT> At = libff::G1<ppT>::zero();
+    KnowledgeCommitmentT Bt = KnowledgeCommitmentT::zero();
+    libff::G1<ppT> Lt = libff::G1<ppT>::zero();
+
+    /**
+    * Add the terms of the variables from `begin` onwards, holding `values`
+    */
+    void add(const ProvingKeyT &pk, const size_t begin, const std::vector<FieldT> &values, const size_t chunks)
+    {
+        const size_t end = begin + values.size();
+        const size_t num_inputs = pk.constraint_system.num_inputs();
+        assert(begin > num_inputs);
+
+        At = At + libff::multi_exp_with_mixed_addition<libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+            pk.A_query.begin() + begin,
+            pk.A_query.begin() + end,
+            values.begin(),
+            values.end(),
+            chunks);
+
+        Bt = Bt + libsnark::kc_multi_exp_with_mixed_addition<libff::G2<ppT>, libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+            pk.B_query,
+            begin,
+            end,
+            values.begin(),
+            values.end(),
+            chunks);
+
+        // L_query starts at the first auxiliary variable
+        Lt = Lt + libff::multi_exp_with_mixed_addition<libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+            pk.L_query.begin() + (begin - num_inputs - 1),
+            pk.L_query.begin() + (end - num_inputs - 1),
+            values.begin(),
+            values.end(),
+            chunks);
+
+        ranges.emplace_back(begin, end);
+    }
+};
+
+/**
+* Same as r1cs_gg_ppzksnark_zok_prover(), but the QAP evaluation domain is
+* provided by the caller instead of being recreated for every proof
+*
+* `const_padded_assignment` is `1 || primary_input || auxiliary_input`, it's
+* taken by value and reused for the multi-exponentiation scalars. With
+* `compact` its linear combinations are used for H, the ones of
+* `pk.constraint_system` aren't read and may have been dropped.
+*
+* `chunks` is how many pieces the multi-exponentiations are split into, 0
+* uses the default of prover_max_chunks()
+*
+* With `fixed` the multi-exponentiations skip its variables and add its
+* precomputed terms, their values must match the witness
+*/
+inline ProofT contingent_prover_run(
+    const ProvingKeyT &pk,
+    DomainT &domain,
+    std::vector<FieldT> const_padded_assignment,
+    const compact_constraint_system *compact,
+    size_t chunks = 0,
+    const fixed_variables *fixed = nullptr)
+{
+    const ConstraintSystemT &cs = pk.constraint_system;
+    const size_t num_inputs = cs.num_inputs();
+    const size_t num_variables = cs.num_variables();
+
+    std::vector<FieldT> coefficients_for_H;
+    {
+        stats_phase phase("fft");
+        if (compact != nullptr)
+        {
+            coefficients_for_H = qap_coefficients_for_H(domain, compact->num_constraints(), num_inputs, const_padded_assignment, [&](size_t i, size_t k) {
+                return compact->evaluate(i, k, const_padded_assignment);
+            });
+        }
+        else
+        {
+            coefficients_for_H = qap_coefficients_for_H(domain, cs, const_padded_assignment);
+        }
+    }
+
+    const FieldT r = FieldT::random_element();
+    const FieldT s = FieldT::random_element();
+
+    if (chunks == 0)
+        chunks = prover_max_chunks();
+
+    stats_phase phase("multiexp");
+
+    // Zero scalars are skipped by the multi-exponentiations
+    if (fixed != nullptr)
+    {
+        for (const auto &range : fixed->ranges)
+            std::fill(const_padded_assignment.begin() + range.first, const_padded_assignment.begin() + range.second, FieldT::zero());
+    }
+
+    libff::G1<ppT> evaluation_At = libff::multi_exp_with_mixed_addition<libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+        pk.A_query.begin(),
+        pk.A_query.begin() + num_variables + 1,
+        const_padded_assignment.begin(),
+        const_padded_assignment.begin() + num_variables + 1,
+        chunks);
+
+    KnowledgeCommitmentT evaluation_Bt = libsnark::kc_multi_exp_with_mixed_addition<libff::G2<ppT>, libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+        pk.B_query,
+        0,
+        num_variables + 1,
+        const_padded_assignment.begin(),
+        const_padded_assignment.begin() + num_variables + 1,
+        chunks);
+
+    const libff::G1<ppT> evaluation_Ht = libff::multi_exp<libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+        pk.H_query.begin(),
+        pk.H_query.begin() + (domain.m - 1),
+        coefficients_for_H.begin(),
+        coefficients_for_H.begin() + (domain.m - 1),
+        chunks);
+
+    libff::G1<ppT> evaluation_Lt = libff::multi_exp_with_mixed_addition<libff::G1<ppT>, FieldT, libff::multi_exp_method_BDLO12>(
+        pk.L_query.begin(),
+        pk.L_query.end(),
+        const_padded_assignment.begin() + num_inputs + 1,
+        const_padded_assignment.begin() + num_variables + 1,
+        chunks);
+
+    if (fixed != nullptr)
+    {
+        evaluation_At = evaluation_At + fixed->At;
+        evaluation_Bt = evaluation_Bt + fixed->Bt;
+        evaluation_Lt = evaluation_Lt + fixed->Lt;
+    }
+
+    libff::G1<ppT> g1_A = pk.alpha_g1 + evaluation_At + r * pk.delta_g1;
+    libff::G1<ppT> g1_B = pk.beta_g1 + evaluation_Bt.h + s * pk.delta_g1;
+    libff::G2<ppT> g2_B = pk.beta_g2 + evaluation_Bt.g + s * pk.delta_g2;
+    libff::G1<ppT> g1_C = evaluation_Ht + evaluation_Lt + s * g1_A + r * g1_B - (r * s) * pk.delta_g1;
+
+    return ProofT(std::move(g1_A), std::move(g2_B), std::move(g1_C));
+}
+
+/**
+* contingent_prover_run() for a libsnark witness
+*/
+inline ProofT contingent_prover_run(
+    const ProvingKeyT &pk,
+    DomainT &domain,
+    const PrimaryInputT &primary_input,
+    const AuxiliaryInputT &auxiliary_input,
+    size_t chunks = 0,
+    const fixed_variables *fixed = nullptr)
+{
+    // 1 || primary_input || auxiliary_input
+    std::vector<FieldT> const_padded_assignment(1, FieldT::one());
+    const_padded_assignment.reserve(pk.constraint_system.num_variables() + 1);
+    const_padded_assignment.insert(const_padded_assignment.end(), primary_input.begin(), primary_input.end());
+    const_padded_assignment.insert(const_padded_assignment.end(), auxiliary_input.begin(), auxiliary_input.end());
+
+    return contingent_prover_run(pk, domain, std::move(const_padded_assignment), nullptr, chunks, fixed);
+}
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,444 @@
+#ifndef CONTINGENT_SERVE_HPP_
+#define CONTINGENT_SERVE_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "contingent.hpp"
+#include "contingent_file.hpp"
+#include "contingent_parallel.hpp"
+
+/**
+* Proving daemon, `contingent_cli serve`
+*
+* Keeps the proving and verification keys of several sizes loaded and takes
+* jobs over a Unix domain socket, one per line, each starting with an id
+* chosen by the client:
+*
+*   <id> prove <num_blocks>[:<circuit>] <key-hash> <ciphertext...> <plaintext-root> <key> <plaintext...>
+*   <id> verify <num_blocks>[:<circuit>] <proof> <key-hash> <ciphertext...> <plaintext-root>
+*
+* The circuit variant is given by its names as for --circuit, e.g. `8:mimc`,
+* and defaults to the one of the daemon. The key hash and proofs are hex
+* strings, proofs in the binary encoding, field elements are decimal. Jobs run on a fixed pool of workers and the
+* results are written back as soon as they're done, so possibly out of
+* order:
+*
+*   <id> ok <proof>
+*   <id> valid | <id> invalid
+*   <id> error <message>
+*
+* The job queue is bounded, once it's full connections aren't read from
+* until a worker takes a job, which pushes back on the clients. Lines are
+* bounded too, by the size of a prove job for the largest keys loaded: a
+* longer one is answered with `<id> error line too long` and its connection
+* closed.
+*/
+
+namespace ethsnarks
+{
+
+/**
+* Fixed capacity FIFO shared between producer and consumer threads
+*/
+template <typename T>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(const size_t capacity)
+        : m_capacity(std::max<size_t>(1, capacity)), m_closed(false)
+    {
+    }
+
+    // Blocks while the queue is full
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_items.size() < m_capacity || m_closed; });
+        if (m_closed)
+            return;
+        m_items.emplace_back(std::move(item));
+        m_not_empty.notify_one();
+    }
+
+    // Blocks until an item is available, returns false once closed
+    bool pop(T &out_item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+        if (m_items.empty())
+            return false;
+        out_item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    const size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+};
+
+/**
+* Client connection, kept open until its reader and every job it queued are
+* done
+*/
+class serve_connection
+{
+public:
+    serve_connection(const int in_fd, const size_t max_line_size)
+        : m_fd(in_fd), m_max_line_size(max_line_size)
+    {
+    }
+
+    ~serve_connection()
+    {
+        ::close(m_fd);
+    }
+
+    /**
+    * Read the next line, returns false at the end of the stream or once a
+    * line goes over the maximum size
+    */
+    bool read_line(std::string &out_line)
+    {
+        for (;;)
+        {
+            const size_t end = m_buffer.find('\n');
+            if (end != std::string::npos && end <= m_max_line_size)
+            {
+                out_line = m_buffer.substr(0, end);
+                m_buffer.erase(0, end + 1);
+                return true;
+            }
+
+            if (m_buffer.size() > m_max_line_size)
+            {
+                const std::string id = m_buffer.substr(0, std::min<size_t>(m_buffer.find(' '), 64));
+                send_line(id + " error line too long");
+                m_buffer.clear();
+                return false;
+            }
+
+            char chunk[65536];
+            const ssize_t n = ::read(m_fd, chunk, sizeof(chunk));
+            if (n <= 0)
+                return false;
+            m_buffer.append(chunk, n);
+        }
+    }
+
+    void send_line(const std::string &line)
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        const std::string data = line + "\n";
+        size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t n = ::write(m_fd, data.data() + written, data.size() - written);
+            if (n <= 0)
+                return;
+            written += n;
+        }
+    }
+
+private:
+    serve_connection(const serve_connection &) = delete;
+    serve_connection &operator=(const serve_connection &) = delete;
+
+    const int m_fd;
+    const size_t m_max_line_size;
+    std::string m_buffer;
+    std::mutex m_write_mutex;
+};
+
+struct serve_job
+{
+    std::shared_ptr<serve_connection> connection;
+    std::vector<std::string> fields;
+};
+
+class contingent_server
+{
+public:
+    contingent_server(const size_t num_workers, const size_t queue_size, const unsigned int default_circuit)
+        : m_num_workers(resolve_num_threads(num_workers)), m_default_circuit(default_circuit), m_queue(queue_size),
+          m_max_line_size(0)
+    {
+    }
+
+    ~contingent_server()
+    {
+        for (auto &it : m_keys)
+        {
+            contingent_prover_close(it.second.prover);
+            contingent_verifier_close(it.second.verifier);
+        }
+    }
+
+    /**
+    * Load the keys for `num_blocks` and a circuit variant, the proving
+    * key's threads are split between the workers so concurrent proofs don't
+    * oversubscribe the host
+    */
+    bool add_keys(const size_t num_blocks, const unsigned int circuit, const char *pk_file, const char *vk_file)
+    {
+        if (m_keys.count(std::make_pair(num_blocks, circuit)))
+        {
+            std::cerr << "Error: keys for " << num_blocks << " blocks of circuit " << circuit << " given twice" << std::endl;
+            return false;
+        }
+
+        contingent_prover_t *prover = contingent_prover_open_ex(pk_file, num_blocks, circuit);
+        if (prover == nullptr)
+            return false;
+
+        contingent_verifier_t *verifier = contingent_verifier_open_ex(vk_file, num_blocks, circuit);
+        if (verifier == nullptr)
+        {
+            contingent_prover_close(prover);
+            return false;
+        }
+
+        const thread_budget &budget = default_thread_budget();
+        const size_t total_threads = budget.num_threads ? budget.num_threads : resolve_num_threads(0);
+        contingent_prover_set_threads(prover, std::max<size_t>(1, total_threads / m_num_workers), -1);
+
+        m_keys[std::make_pair(num_blocks, circuit)] = {prover, verifier};
+
+        // A prove job: the id, command and size, the key hash in hex, then
+        // 2 * num_blocks + 2 decimal field elements of at most 78 digits
+        m_max_line_size = std::max(m_max_line_size, 1024 + ((2 * num_blocks) + 2) * 80);
+        return true;
+    }
+
+    /**
+    * Listen on `socket_path` and serve until the process is stopped
+    */
+    int run(const std::string &socket_path)
+    {
+        struct sockaddr_un addr;
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "Error: socket path too long: " << socket_path << std::endl;
+            return 1;
+        }
+
+        const int server_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server_fd < 0)
+        {
+            std::cerr << "Error: cannot create socket" << std::endl;
+            return 1;
+        }
+
+        ::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        ::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(socket_path.c_str());
+        if (0 != ::bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) || 0 != ::listen(server_fd, 16))
+        {
+            std::cerr << "Error: cannot listen on " << socket_path << std::endl;
+            ::close(server_fd);
+            return 1;
+        }
+
+        // Clients going away mid-reply mustn't kill the daemon
+        ::signal(SIGPIPE, SIG_IGN);
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < m_num_workers; i++)
+            workers.emplace_back(&contingent_server::worker, this);
+
+        std::cerr << "Serving " << m_keys.size() << " key sizes on " << socket_path
+                  << " with " << m_num_workers << " workers" << std::endl;
+
+        for (;;)
+        {
+            const int client_fd = ::accept(server_fd, nullptr, nullptr);
+            if (client_fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            auto connection = std::make_shared<serve_connection>(client_fd, m_max_line_size);
+            std::thread(&contingent_server::read_connection, this, connection).detach();
+        }
+
+        m_queue.close();
+        for (auto &t : workers)
+            t.join();
+        ::close(server_fd);
+        ::unlink(socket_path.c_str());
+        return 0;
+    }
+
+private:
+    struct keys
+    {
+        contingent_prover_t *prover;
+        contingent_verifier_t *verifier;
+    };
+
+    void read_connection(std::shared_ptr<serve_connection> connection)
+    {
+        std::string line;
+        while (connection->read_line(line))
+        {
+            std::stringstream line_stream(line);
+            serve_job job;
+            std::string field;
+            while (line_stream >> field)
+                job.fields.emplace_back(field);
+
+            if (job.fields.empty())
+                continue;
+
+            job.connection = connection;
+            m_queue.push(std::move(job));
+        }
+    }
+
+    void worker()
+    {
+        serve_job job;
+        while (m_queue.pop(job))
+        {
+            std::string result;
+            try
+            {
+                result = run_job(job.fields);
+            }
+            catch (const std::exception &ex)
+            {
+                result = std::string("error ") + ex.what();
+            }
+            job.connection->send_line(job.fields[0] + " " + result);
+            job = serve_job();
+        }
+    }
+
+    std::string run_job(const std::vector<std::string> &fields)
+    {
+        if (fields.size() < 3)
+            return "error expected <id> <prove|verify> <num_blocks>[:<circuit>] ...";
+
+        const std::string &command = fields[1];
+        const size_t separator = fields[2].find(':');
+        const size_t num_blocks = std::stoul(fields[2].substr(0, separator));
+        unsigned int circuit = m_default_circuit;
+        if (separator != std::string::npos && !parse_circuit(fields[2].substr(separator + 1), circuit))
+            return "error unknown circuit " + fields[2].substr(separator + 1);
+
+        const auto it = m_keys.find(std::make_pair(num_blocks, circuit));
+        if (it == m_keys.end())
+            return "error no keys for " + fields[2] + " blocks";
+        const keys &k = it->second;
+
+        std::vector<uint8_t> key_hash;
+        std::vector<const char *> ciphertext;
+        if (command == "prove")
+        {
+            if (fields.size() != 6 + (2 * num_blocks))
+                return "error expected " + std::to_string(6 + (2 * num_blocks)) + " fields";
+            if (!hex_string_to_bytes(fields[3], key_hash) || key_hash.size() != 32)
+                return "error invalid key hash";
+
+            std::vector<const char *> plaintext;
+            for (size_t i = 0; i < num_blocks; i++)
+            {
+                ciphertext.emplace_back(fields[4 + i].c_str());
+                plaintext.emplace_back(fields[6 + num_blocks + i].c_str());
+            }
+
+            std::vector<uint8_t> proof(CONTINGENT_PROOF_BINARY_SIZE);
+            const size_t proof_size = contingent_prover_prove_binary(
+                k.prover,
+                (const char *)key_hash.data(),
+                ciphertext.data(),
+                fields[4 + num_blocks].c_str(),
+                fields[5 + num_blocks].c_str(),
+                plaintext.data(),
+                proof.data(),
+                proof.size());
+            if (proof_size == 0)
+            {
+                // The reason, e.g. which native check failed
+                char *error = contingent_last_error();
+                const std::string message = error ? error : "proof failed";
+                contingent_free(error);
+                return "error " + message;
+            }
+
+            proof.resize(proof_size);
+            return "ok " + bytes_to_hex_string(proof);
+        }
+        else if (command == "verify")
+        {
+            if (fields.size() != 6 + num_blocks)
+                return "error expected " + std::to_string(6 + num_blocks) + " fields";
+
+            std::vector<uint8_t> proof;
+            if (!hex_string_to_bytes(fields[3], proof))
+                return "error invalid proof";
+            if (!hex_string_to_bytes(fields[4], key_hash) || key_hash.size() != 32)
+                return "error invalid key hash";
+
+            for (size_t i = 0; i < num_blocks; i++)
+                ciphertext.emplace_back(fields[5 + i].c_str());
+
+            const bool valid = contingent_verifier_verify_binary(
+                k.verifier,
+                proof.data(),
+                proof.size(),
+                (const char *)key_hash.data(),
+                ciphertext.data(),
+                fields[5 + num_blocks].c_str());
+            return valid ? "valid" : "invalid";
+        }
+
+        return "error unknown command " + command;
+    }
+
+    const size_t m_num_workers;
+    const unsigned int m_default_circuit;
+    std::map<std::pair<size_t, unsigned int>, keys> m_keys;
+    bounded_queue<serve_job> m_queue;
+
+    // Longest line read from a client, see add_keys()
+    size_t m_max_line_size;
+};
+
+} // namespace ethsnarks
+
+#endif
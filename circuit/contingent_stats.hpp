@@ -0,0 +1,260 @@
+#ifndef CONTINGENT_STATS_HPP_
+#define CONTINGENT_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <time.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+/**
+* Per-call statistics of the C API entry points
+*
+* Every prove, verify and genkeys call records the wall and CPU time of its
+* phases on the calling thread, they are read back as JSON with
+* contingent_last_stats(). When an entry point calls another one, e.g. the
+* one-shot contingent_prove() opening a prover, the phases are recorded in
+* the stats of the outermost call.
+*
+* The CPU time, heap growth and allocated bytes are process-wide figures,
+* they also count the OpenMP threads of the call and anything else running
+* in the process. They are reported with a process_ prefix, and left out
+* when another call overlapped this one, as its work would be counted too.
+*/
+
+namespace ethsnarks
+{
+
+struct phase_timing
+{
+    std::string name;
+    double wall_ms;
+    double process_cpu_ms;
+};
+
+struct call_stats
+{
+    std::string call;
+    std::vector<phase_timing> phases;
+    double wall_ms = 0;
+    double process_cpu_ms = 0;
+
+    size_t num_constraints = 0;
+    size_t num_variables = 0;
+    size_t num_inputs = 0;
+
+    // Time it took to load the key used by the call, also reported when the
+    // key was loaded earlier by contingent_prover_open() or
+    // contingent_verifier_open()
+    double key_load_ms = 0;
+
+    // Net growth of the heap and bytes allocated with new during the call,
+    // and peak RSS of the process
+    long long process_heap_growth_bytes = 0;
+    unsigned long long process_allocated_bytes = 0;
+    long peak_rss_kb = 0;
+
+    // Another call ran at the same time, the process-wide figures are left
+    // out of the JSON then
+    bool overlapped = false;
+
+    // Why the call failed, see contingent_last_error()
+    std::string error;
+
+    void clear(const char *in_call)
+    {
+        *this = call_stats();
+        call = in_call;
+    }
+
+    std::string to_json() const
+    {
+        std::stringstream out;
+        out << "{\"call\": \"" << call << "\""
+            << ", \"wall_ms\": " << wall_ms
+            << ", \"constraints\": " << num_constraints
+            << ", \"variables\": " << num_variables
+            << ", \"inputs\": " << num_inputs
+            << ", \"key_load_ms\": " << key_load_ms
+            << ", \"peak_rss_kb\": " << peak_rss_kb
+            << ", \"overlapped\": " << (overlapped ? "true" : "false");
+        if (!overlapped)
+        {
+            out << ", \"process_cpu_ms\": " << process_cpu_ms
+                << ", \"process_heap_growth_bytes\": " << process_heap_growth_bytes
+                << ", \"process_allocated_bytes\": " << process_allocated_bytes;
+        }
+        out << ", \"phases\": [";
+        for (size_t i = 0; i < phases.size(); i++)
+        {
+            out << (i ? ", " : "")
+                << "{\"name\": \"" << phases[i].name << "\""
+                << ", \"wall_ms\": " << phases[i].wall_ms;
+            if (!overlapped)
+                out << ", \"process_cpu_ms\": " << phases[i].process_cpu_ms;
+            out << "}";
+        }
+        out << "]}";
+        return out.str();
+    }
+};
+
+inline call_stats &thread_call_stats()
+{
+    static thread_local call_stats stats;
+    return stats;
+}
+
+inline int &thread_call_depth()
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+/**
+* Outermost calls running in the process, and the number started so far
+*/
+inline std::atomic<int> &active_calls()
+{
+    static std::atomic<int> count(0);
+    return count;
+}
+
+inline std::atomic<unsigned long> &started_calls()
+{
+    static std::atomic<unsigned long> count(0);
+    return count;
+}
+
+/**
+* Bytes allocated with operator new by the whole process, counted by the
+* replacement operator new in contingent.cpp
+*/
+inline std::atomic<unsigned long long> &allocated_bytes()
+{
+    static std::atomic<unsigned long long> count(0);
+    return count;
+}
+
+inline double wall_time_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* CPU time of the whole process, so it includes the OpenMP threads of the
+* FFTs and multi-exponentiations, as well as anything else running
+*/
+inline double cpu_time_ms()
+{
+    struct timespec ts;
+    if (0 != clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+        return 0;
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+inline long long heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (unsigned int)mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+inline long peak_rss_kb()
+{
+    struct rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage))
+        return 0;
+    return usage.ru_maxrss;
+}
+
+/**
+* Marks an API entry point, the stats of the calling thread are reset when
+* it's the outermost one
+*
+* The call overlapped another one if any was running when it started, or if
+* any other started before it ended.
+*/
+class stats_call
+{
+public:
+    stats_call(const char *name)
+        : m_outermost(thread_call_depth()++ == 0),
+          m_others(m_outermost ? active_calls()++ : 0),
+          m_started(m_outermost ? started_calls()++ : 0),
+          m_wall(wall_time_ms()),
+          m_cpu(cpu_time_ms()),
+          m_heap(heap_in_use()),
+          m_allocated(allocated_bytes())
+    {
+        if (m_outermost)
+            thread_call_stats().clear(name);
+    }
+
+    ~stats_call()
+    {
+        thread_call_depth()--;
+        if (!m_outermost)
+            return;
+
+        call_stats &stats = thread_call_stats();
+        stats.wall_ms = wall_time_ms() - m_wall;
+        stats.process_cpu_ms = cpu_time_ms() - m_cpu;
+        stats.process_heap_growth_bytes = heap_in_use() - m_heap;
+        stats.process_allocated_bytes = allocated_bytes() - m_allocated;
+        stats.peak_rss_kb = peak_rss_kb();
+        stats.overlapped = m_others != 0 || started_calls() != m_started + 1;
+        active_calls()--;
+    }
+
+private:
+    stats_call(const stats_call &) = delete;
+    stats_call &operator=(const stats_call &) = delete;
+
+    const bool m_outermost;
+    const int m_others;
+    const unsigned long m_started;
+    const double m_wall;
+    const double m_cpu;
+    const long long m_heap;
+    const unsigned long long m_allocated;
+};
+
+/**
+* Records the time until it goes out of scope as a phase of the current call,
+* nothing is recorded outside of an entry point
+*/
+class stats_phase
+{
+public:
+    stats_phase(const char *name)
+        : m_name(name), m_wall(wall_time_ms()), m_cpu(cpu_time_ms())
+    {
+    }
+
+    ~stats_phase()
+    {
+        if (thread_call_depth() > 0)
+            thread_call_stats().phases.push_back({m_name, wall_time_ms() - m_wall, cpu_time_ms() - m_cpu});
+    }
+
+private:
+    stats_phase(const stats_phase &) = delete;
+    stats_phase &operator=(const stats_phase &) = delete;
+
+    const char *m_name;
+    const double m_wall;
+    const double m_cpu;
+};
+
+} // namespace ethsnarks
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef CONTINGENT_VERIFIER_HPP_
+#define CONTINGENT_VERIFIER_HPP_
+
+#include <vector>
+
+#include "contingent.hpp"
+
+namespace ethsnarks
+{
+
+typedef libsnark::r1cs_gg_ppzksnark_zok_verification_key<ppT> VerificationKeyT;
+typedef libsnark::r1cs_gg_ppzksnark_zok_processed_verification_key<ppT> ProcessedVerificationKeyT;
+
+/**
+* Verification key with everything that doesn't depend on the proof
+* computed up front, so it can be used for any number of verifications
+*/
+struct prepared_verification_key
+{
+    const VerificationKeyT vk;
+    const ProcessedVerificationKeyT pvk;
+
+    // G2 side of the batch verification pairings
+    const libff::G2_precomp<ppT> beta_g2_precomp;
+    const libff::G2_precomp<ppT> gamma_g2_precomp;
+    const libff::G2_precomp<ppT> delta_g2_precomp;
+
+    prepared_verification_key(const VerificationKeyT &in_vk)
+        : vk(in_vk),
+          pvk(libsnark::r1cs_gg_ppzksnark_zok_verifier_process_vk<ppT>(in_vk)),
+          beta_g2_precomp(ppT::precompute_G2(in_vk.beta_g2)),
+          gamma_g2_precomp(ppT::precompute_G2(in_vk.gamma_g2)),
+          delta_g2_precomp(ppT::precompute_G2(in_vk.delta_g2))
+    {
+    }
+
+    bool verify(const ProofT &proof, const PrimaryInputT &primary_input) const
+    {
+        return libsnark::r1cs_gg_ppzksnark_zok_online_verifier_strong_IC<ppT>(pvk, primary_input, proof);
+    }
+};
+
+/**
+* Verify many proofs against the same verification key at once
+*
+* Every proof must satisfy the Groth16 pairing equation
+*
+*   e(A_i, B_i) == e(alpha, beta) * e(L_i, gamma) * e(C_i, delta)
+*
+* where L_i is the accumulated public input. Raising each equation to an
+* independent random power r_i and multiplying them together folds all of
+* them into a single multi-pairing check
+*
+*   prod e(r_i*A_i, B_i) * e(-sum(r_i)*alpha, beta)
+*       * e(-sum(r_i*L_i), gamma) * e(-sum(r_i*C_i), delta) == 1
+*
+* which needs N + 3 Miller loops and one final exponentiation, instead of
+* four pairings per proof. If any proof is invalid the check fails except
+* with negligible probability, it does not tell which one.
+*/
+inline bool batch_verify(
+    const prepared_verification_key &key,
+    const std::vector<ProofT> &proofs,
+    const std::vector<PrimaryInputT> &primary_inputs)
+{
+    const VerificationKeyT &vk = key.vk;
+
+    assert(proofs.size() == primary_inputs.size());
+
+    if (proofs.empty())
+        return true;
+
+    libff::Fqk<ppT> miller = libff::Fqk<ppT>::one();
+
+    FieldT sum_r = FieldT::zero();
+    libff::G1<ppT> sum_L = libff::G1<ppT>::zero();
+    libff::G1<ppT> sum_C = libff::G1<ppT>::zero();
+
+    for (size_t i = 0; i < proofs.size(); i++)
+    {
+        const ProofT &proof = proofs[i];
+        const PrimaryInputT &primary_input = primary_inputs[i];
+
+        // Same checks as the strong IC verifier
+        if (primary_input.size() != vk.gamma_ABC_g1.domain_size())
+            return false;
+        if (!proof.is_well_formed())
+            return false;
+
+        const auto accumulated_IC = vk.gamma_ABC_g1.template accumulate_chunk<FieldT>(primary_input.begin(), primary_input.end(), 0);
+        assert(accumulated_IC.is_fully_accumulated());
+
+        const FieldT r = FieldT::random_element();
+        sum_r += r;
+        sum_L = sum_L + r * accumulated_IC.first;
+        sum_C = sum_C + r * proof.g_C;
+
+        const libff::G1<ppT> rA = r * proof.g_A;
+        miller = miller * ppT::miller_loop(ppT::precompute_G1(rA), ppT::precompute_G2(proof.g_B));
+    }
+
+    const libff::G1<ppT> neg_alpha = -(sum_r * vk.alpha_g1);
+    miller = miller * ppT::miller_loop(ppT::precompute_G1(neg_alpha), key.beta_g2_precomp);
+    miller = miller * ppT::miller_loop(ppT::precompute_G1(-sum_L), key.gamma_g2_precomp);
+    miller = miller * ppT::miller_loop(ppT::precompute_G1(-sum_C), key.delta_g2_precomp);
+
+    return ppT::final_exponentiation(miller) == libff::GT<ppT>::one();
+}
+
+} // namespace ethsnarks
+
+#endif
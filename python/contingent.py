@@ -17,52 +17,301 @@ You should have received a copy of the GNU General Public License
 along with Miximus.  If not, see <https://www.gnu.org/licenses/>.
 """
 
-__all__ = ('Contingent',)
+__all__ = ('Contingent', 'ContingentProver', 'ContingentProveJob', 'ContingentVerifier', 'ContingentVerifyJob',
+           'ContingentRegistry', 'CIRCUIT_DEFAULT', 'CIRCUIT_MIMC_KEY', 'CIRCUIT_PACKED_KEY_HASH',
+           'CIRCUIT_CIPHERTEXT_HASH', 'CIRCUIT_PADDED', 'DECRYPT_OK', 'DECRYPT_BAD_KEY', 'DECRYPT_BAD_ROOT',
+           'DECRYPT_IO_ERROR', 'fields_to_bytes')
 
 import os
 import re
 import sys
+import json
 import ctypes
 import argparse
 
 from ethsnarks.verifier import Proof, VerifyingKey
 
 
+# Circuit variants, same as CONTINGENT_CIRCUIT_* in contingent.hpp
+CIRCUIT_DEFAULT = 0
+# key_hash is mimc_hash([key], 1) as 32 bytes big-endian, instead of SHA256(key)
+CIRCUIT_MIMC_KEY = 1
+# SHA256(key) as two public field elements instead of 256 bits, the key_hash
+# argument stays the 32 byte digest
+CIRCUIT_PACKED_KEY_HASH = 2
+# Only the Merkle root of the ciphertext is a public input, can be combined
+# with either of the above
+CIRCUIT_CIPHERTEXT_HASH = 4
+# The number of data blocks is a public input and the blocks after it are
+# zero, so shorter files can be proven with the key of a larger size class
+CIRCUIT_PADDED = 8
+
+# Results of Contingent.decrypt_file(), same as CONTINGENT_DECRYPT_*
+DECRYPT_OK = 0
+DECRYPT_BAD_KEY = 1
+DECRYPT_BAD_ROOT = 2
+DECRYPT_IO_ERROR = 3
+
+
+def fields_to_bytes(values):
+    """
+    Pack field elements as consecutive 32 byte little-endian values, the
+    buffer layout taken by prove() and verify() instead of lists of ints
+    """
+    return b''.join(int(_).to_bytes(32, 'little') for _ in values)
+
+
+def _take_proof(free, ptr):
+    """
+    Proof JSON returned by the library, released with `free` once copied
+    """
+    if not ptr:
+        raise RuntimeError("Could not prove!")
+    try:
+        return ctypes.string_at(ptr).decode('ascii')
+    finally:
+        free(ptr)
+
+
+def _is_buffer(values):
+    return isinstance(values, (bytes, bytearray, memoryview))
+
+
+def _buffer_arg(values, count):
+    """
+    Pointer to `count` 32 byte field elements, bytes and writable buffers are
+    passed without a copy
+    """
+    view = memoryview(values).cast('B')
+    assert view.nbytes == 32 * count
+    if isinstance(values, bytes):
+        return values
+    if view.readonly:
+        return view.tobytes()
+    return (ctypes.c_char * view.nbytes).from_buffer(view)
+
+
+class ContingentProveJob(ctypes.Structure):
+    _fields_ = [
+        ('key_hash', ctypes.c_char_p),
+        ('ciphertext', ctypes.POINTER(ctypes.c_char_p)),
+        ('plaintext_root', ctypes.c_char_p),
+        ('key', ctypes.c_char_p),
+        ('plaintext', ctypes.POINTER(ctypes.c_char_p)),
+    ]
+
+
+class ContingentVerifyJob(ctypes.Structure):
+    _fields_ = [
+        ('proof_json', ctypes.c_char_p),
+        ('key_hash', ctypes.c_char_p),
+        ('ciphertext', ctypes.POINTER(ctypes.c_char_p)),
+        ('plaintext_root', ctypes.c_char_p),
+    ]
+
+
 class Contingent(object):
-    def __init__(self, native_library_path, num_blocks):
+    def __init__(self, native_library_path, num_blocks, circuit=CIRCUIT_DEFAULT):
         assert isinstance(num_blocks, int)
         assert num_blocks > 0
+        assert circuit & ~(CIRCUIT_MIMC_KEY | CIRCUIT_PACKED_KEY_HASH | CIRCUIT_CIPHERTEXT_HASH | CIRCUIT_PADDED) == 0
 
         self.num_blocks = num_blocks
+        self.circuit = circuit
 
         lib = ctypes.cdll.LoadLibrary(native_library_path)
 
-        lib_genkeys = lib.contingent_genkeys
-        lib_genkeys.argtypes = [ctypes.c_size_t, ctypes.c_char_p, ctypes.c_char_p]
+        lib_genkeys = lib.contingent_genkeys_ex
+        lib_genkeys.argtypes = [ctypes.c_size_t, ctypes.c_uint, ctypes.c_char_p, ctypes.c_char_p]
         lib_genkeys.restype = ctypes.c_int
         self._genkeys = lib_genkeys
 
-        lib_prove = lib.contingent_prove
+        lib_prove = lib.contingent_prove_ex
         lib_prove.argtypes = \
             [ctypes.c_char_p] + \
-            [ctypes.c_size_t] + \
+            [ctypes.c_size_t, ctypes.c_uint] + \
             [ctypes.c_char_p] + \
             [(ctypes.c_char_p * num_blocks)] + \
             ([ctypes.c_char_p] * 2) + \
             [(ctypes.c_char_p * num_blocks)]
-        lib_prove.restype = ctypes.c_char_p
+        lib_prove.restype = ctypes.c_void_p
         self._prove = lib_prove
 
-        lib_verify = lib.contingent_verify
+        lib_prover_open = lib.contingent_prover_open_ex
+        lib_prover_open.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint]
+        lib_prover_open.restype = ctypes.c_void_p
+        self._prover_open = lib_prover_open
+
+        lib_prover_prove = lib.contingent_prover_prove
+        lib_prover_prove.argtypes = \
+            [ctypes.c_void_p] + \
+            [ctypes.c_char_p] + \
+            [(ctypes.c_char_p * num_blocks)] + \
+            ([ctypes.c_char_p] * 2) + \
+            [(ctypes.c_char_p * num_blocks)]
+        lib_prover_prove.restype = ctypes.c_void_p
+        self._prover_prove = lib_prover_prove
+
+        # The *_raw functions take 32 byte little-endian buffers. Like every
+        # ctypes call on a CDLL they run with the GIL released.
+        lib_prove_raw = lib.contingent_prove_raw_ex
+        lib_prove_raw.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint] + ([ctypes.c_char_p] * 5)
+        lib_prove_raw.restype = ctypes.c_void_p
+        self._prove_raw = lib_prove_raw
+
+        lib_prover_prove_raw = lib.contingent_prover_prove_raw
+        lib_prover_prove_raw.argtypes = [ctypes.c_void_p] + ([ctypes.c_char_p] * 5)
+        lib_prover_prove_raw.restype = ctypes.c_void_p
+        self._prover_prove_raw = lib_prover_prove_raw
+
+        lib_prover_prove_chunked = lib.contingent_prover_prove_chunked
+        lib_prover_prove_chunked.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+        lib_prover_prove_chunked.restype = ctypes.c_size_t
+        self._prover_prove_chunked = lib_prover_prove_chunked
+
+        lib_prover_prepare = lib.contingent_prover_prepare
+        lib_prover_prepare.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_char_p)]
+        lib_prover_prepare.restype = ctypes.c_void_p
+        self._prover_prepare = lib_prover_prepare
+
+        lib_prepared_plaintext_root = lib.contingent_prepared_plaintext_root
+        lib_prepared_plaintext_root.argtypes = [ctypes.c_void_p]
+        lib_prepared_plaintext_root.restype = ctypes.c_void_p
+        self._prepared_plaintext_root = lib_prepared_plaintext_root
+
+        lib_prover_prove_prepared = lib.contingent_prover_prove_prepared
+        lib_prover_prove_prepared.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p]
+        lib_prover_prove_prepared.restype = ctypes.c_void_p
+        self._prover_prove_prepared = lib_prover_prove_prepared
+
+        lib_prepared_close = lib.contingent_prepared_close
+        lib_prepared_close.argtypes = [ctypes.c_void_p]
+        lib_prepared_close.restype = None
+        self._prepared_close = lib_prepared_close
+
+        lib_prover_set_full_check = lib.contingent_prover_set_full_check
+        lib_prover_set_full_check.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+        lib_prover_set_full_check.restype = None
+        self._prover_set_full_check = lib_prover_set_full_check
+
+        lib_set_lean_proving = lib.contingent_set_lean_proving
+        lib_set_lean_proving.argtypes = [ctypes.c_bool]
+        lib_set_lean_proving.restype = None
+        self._set_lean_proving = lib_set_lean_proving
+
+        lib_prover_close = lib.contingent_prover_close
+        lib_prover_close.argtypes = [ctypes.c_void_p]
+        lib_prover_close.restype = None
+        self._prover_close = lib_prover_close
+
+        lib_prover_set_threads = lib.contingent_prover_set_threads
+        lib_prover_set_threads.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+        lib_prover_set_threads.restype = None
+        self._prover_set_threads = lib_prover_set_threads
+
+        lib_prover_prove_batch = lib.contingent_prover_prove_batch
+        lib_prover_prove_batch.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ContingentProveJob), ctypes.c_size_t, ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+        lib_prover_prove_batch.restype = ctypes.c_size_t
+        self._prover_prove_batch = lib_prover_prove_batch
+
+        lib_prove_batch = lib.contingent_prove_batch
+        lib_prove_batch.argtypes = [
+            ctypes.c_char_p, ctypes.c_size_t,
+            ctypes.POINTER(ContingentProveJob), ctypes.c_size_t, ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+        lib_prove_batch.restype = ctypes.c_size_t
+        self._prove_batch = lib_prove_batch
+
+        lib_free = lib.contingent_free
+        lib_free.argtypes = [ctypes.c_void_p]
+        lib_free.restype = None
+        self._free = lib_free
+
+        lib_last_stats = lib.contingent_last_stats
+        lib_last_stats.argtypes = []
+        lib_last_stats.restype = ctypes.c_void_p
+        self._last_stats = lib_last_stats
+
+        lib_verifier_open = lib.contingent_verifier_open_ex
+        lib_verifier_open.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint]
+        lib_verifier_open.restype = ctypes.c_void_p
+        self._verifier_open = lib_verifier_open
+
+        lib_verifier_num_blocks = lib.contingent_verifier_num_blocks
+        lib_verifier_num_blocks.argtypes = [ctypes.c_void_p]
+        lib_verifier_num_blocks.restype = ctypes.c_size_t
+        self._verifier_num_blocks = lib_verifier_num_blocks
+
+        lib_verifier_verify = lib.contingent_verifier_verify
+        lib_verifier_verify.argtypes = \
+            [ctypes.c_void_p, ctypes.c_char_p] + \
+            [ctypes.c_char_p] + \
+            [(ctypes.c_char_p * num_blocks)] + \
+            ([ctypes.c_char_p])
+        lib_verifier_verify.restype = ctypes.c_bool
+        self._verifier_verify = lib_verifier_verify
+
+        lib_verifier_verify_raw = lib.contingent_verifier_verify_raw
+        lib_verifier_verify_raw.argtypes = [ctypes.c_void_p] + ([ctypes.c_char_p] * 4)
+        lib_verifier_verify_raw.restype = ctypes.c_bool
+        self._verifier_verify_raw = lib_verifier_verify_raw
+
+        lib_verify_raw = lib.contingent_verify_raw_ex
+        lib_verify_raw.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint] + ([ctypes.c_char_p] * 3)
+        lib_verify_raw.restype = ctypes.c_bool
+        self._verify_raw = lib_verify_raw
+
+        lib_verifier_verify_batch = lib.contingent_verifier_verify_batch
+        lib_verifier_verify_batch.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(ContingentVerifyJob), ctypes.c_size_t, ctypes.POINTER(ctypes.c_bool)]
+        lib_verifier_verify_batch.restype = ctypes.c_size_t
+        self._verifier_verify_batch = lib_verifier_verify_batch
+
+        lib_verifier_verify_chunked = lib.contingent_verifier_verify_chunked
+        lib_verifier_verify_chunked.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p]
+        lib_verifier_verify_chunked.restype = ctypes.c_bool
+        self._verifier_verify_chunked = lib_verifier_verify_chunked
+
+        lib_verifier_close = lib.contingent_verifier_close
+        lib_verifier_close.argtypes = [ctypes.c_void_p]
+        lib_verifier_close.restype = None
+        self._verifier_close = lib_verifier_close
+
+        lib_decrypt_file = lib.contingent_decrypt_file
+        lib_decrypt_file.argtypes = [
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint64, ctypes.c_uint,
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+        lib_decrypt_file.restype = ctypes.c_int
+        self._decrypt_file = lib_decrypt_file
+
+        lib_verify = lib.contingent_verify_ex
         lib_verify.argtypes = \
             [ctypes.c_char_p, ctypes.c_char_p] + \
-            [ctypes.c_size_t] + \
+            [ctypes.c_size_t, ctypes.c_uint] + \
             [ctypes.c_char_p] + \
             [(ctypes.c_char_p * num_blocks)] + \
             ([ctypes.c_char_p])
         lib_verify.restype = ctypes.c_bool
         self._verify = lib_verify
 
+        lib_verify_batch = lib.contingent_verify_batch_ex
+        lib_verify_batch.argtypes = [
+            ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint,
+            ctypes.POINTER(ContingentVerifyJob), ctypes.c_size_t, ctypes.POINTER(ctypes.c_bool)]
+        lib_verify_batch.restype = ctypes.c_size_t
+        self._verify_batch = lib_verify_batch
+
     def genkeys(self, pk_file, vk_file):
         assert isinstance(vk_file, str)
         assert isinstance(pk_file, str)
@@ -71,10 +320,9 @@ class Contingent(object):
         arg_pk_file = ctypes.c_char_p(pk_file.encode('ascii'))
         arg_vk_file = ctypes.c_char_p(vk_file.encode('ascii'))
 
-        return self._genkeys(num_blocks, arg_pk_file, arg_vk_file)
+        return self._genkeys(num_blocks, self.circuit, arg_pk_file, arg_vk_file)
 
-    def prove(self, pk_file, key_hash, ciphertext, plaintext_root, key, plaintext):
-        assert os.path.exists(pk_file)
+    def _prove_args(self, key_hash, ciphertext, plaintext_root, key, plaintext):
         assert isinstance(key_hash, bytes)
         assert len(key_hash) == 32
         assert isinstance(ciphertext, (list, tuple))
@@ -84,27 +332,110 @@ class Contingent(object):
         assert isinstance(plaintext, (list, tuple))
         assert len(plaintext) == self.num_blocks
 
-        arg_pk_file = ctypes.c_char_p(str(pk_file).encode('ascii'))
-        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
-
         # Public parameters
         arg_key_hash = ctypes.c_char_p(key_hash)
         arg_ciphertext = (ctypes.c_char_p * len(ciphertext))()
         arg_ciphertext[:] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in ciphertext]
         arg_plaintext_root = ctypes.c_char_p(str(plaintext_root).encode('ascii'))
-    
+
         # Private parameters
         arg_key = ctypes.c_char_p(str(key).encode('ascii'))
         arg_plaintext = (ctypes.c_char_p * len(plaintext))()
         arg_plaintext[:] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in plaintext]
 
-        proof = self._prove(arg_pk_file, arg_num_blocks, arg_key_hash, arg_ciphertext, arg_plaintext_root, arg_key, arg_plaintext)
-        if proof is None:
-            raise RuntimeError("Could not prove!")
-        return proof.decode('ascii')
+        return (arg_key_hash, arg_ciphertext, arg_plaintext_root, arg_key, arg_plaintext)
 
-    def verify(self, vk_file, proof_json, key_hash, ciphertext, plaintext_root):
-        assert os.path.exists(vk_file)
+    def _raw_prove_args(self, key_hash, ciphertext, plaintext_root, key, plaintext):
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(plaintext_root, int)
+        assert isinstance(key, int)
+
+        return (key_hash,
+                _buffer_arg(ciphertext, self.num_blocks),
+                plaintext_root.to_bytes(32, 'little'),
+                key.to_bytes(32, 'little'),
+                _buffer_arg(plaintext, self.num_blocks))
+
+    def prove(self, pk_file, key_hash, ciphertext, plaintext_root, key, plaintext):
+        """
+        The ciphertext and plaintext are lists of ints, or buffers of 32 byte
+        little-endian values (see fields_to_bytes()) which are passed as is
+        """
+        assert os.path.exists(pk_file)
+
+        arg_pk_file = ctypes.c_char_p(str(pk_file).encode('ascii'))
+        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
+        if _is_buffer(plaintext):
+            args = self._raw_prove_args(key_hash, ciphertext, plaintext_root, key, plaintext)
+            proof = self._prove_raw(arg_pk_file, arg_num_blocks, self.circuit, *args)
+        else:
+            args = self._prove_args(key_hash, ciphertext, plaintext_root, key, plaintext)
+            proof = self._prove(arg_pk_file, arg_num_blocks, self.circuit, *args)
+        return _take_proof(self._free, proof)
+
+    def prove_batch(self, pk_file, jobs, num_threads=0):
+        """
+        Prove many (key_hash, ciphertext, plaintext_root, key, plaintext)
+        jobs with one loaded proving key, spread across `num_threads`
+        workers (0 uses every core).
+
+        Returns a list with one (proof, error) tuple per job, where exactly
+        one of the two is None.
+        """
+        assert os.path.exists(pk_file)
+        assert isinstance(num_threads, int) and num_threads >= 0
+
+        arg_pk_file = ctypes.c_char_p(str(pk_file).encode('ascii'))
+        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
+
+        # Keep the converted arguments alive until the native call returns
+        job_args = [self._prove_args(*job) for job in jobs]
+        arg_jobs = (ContingentProveJob * len(jobs))()
+        for i, args in enumerate(job_args):
+            arg_jobs[i] = ContingentProveJob(*args)
+
+        out_proofs = (ctypes.c_void_p * len(jobs))()
+        out_errors = (ctypes.c_void_p * len(jobs))()
+
+        if self.circuit != CIRCUIT_DEFAULT:
+            with self.prover(pk_file) as prover:
+                self._prover_prove_batch(prover._handle, arg_jobs, len(jobs), num_threads, out_proofs, out_errors)
+        else:
+            self._prove_batch(arg_pk_file, arg_num_blocks, arg_jobs, len(jobs), num_threads, out_proofs, out_errors)
+
+        results = []
+        for proof, error in zip(out_proofs, out_errors):
+            results.append((
+                ctypes.string_at(proof).decode('ascii') if proof else None,
+                ctypes.string_at(error).decode('ascii') if error else None))
+            self._free(proof)
+            self._free(error)
+        return results
+
+    def _chunked_args(self, values):
+        assert isinstance(values, (list, tuple))
+        assert len(values) % self.num_blocks == 0
+        arg_values = (ctypes.c_char_p * len(values))()
+        arg_values[:] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in values]
+        return arg_values
+
+    def prover(self, pk_file):
+        """
+        Load the proving key once, returns a ContingentProver which
+        can be used to make many proofs with the same key
+        """
+        assert os.path.exists(pk_file)
+
+        arg_pk_file = ctypes.c_char_p(str(pk_file).encode('ascii'))
+        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
+
+        handle = self._prover_open(arg_pk_file, arg_num_blocks, self.circuit)
+        if not handle:
+            raise RuntimeError("Could not load proving key!")
+        return ContingentProver(self, handle)
+
+    def _verify_args(self, proof_json, key_hash, ciphertext, plaintext_root):
         assert isinstance(proof_json, str)
         assert isinstance(key_hash, bytes)
         assert len(key_hash) == 32
@@ -112,15 +443,465 @@ class Contingent(object):
         assert len(ciphertext) == self.num_blocks
         assert isinstance(plaintext_root, int)
 
-        arg_vk_file = ctypes.c_char_p(vk_file.encode('ascii'))
         arg_proof_json = ctypes.c_char_p(proof_json.encode('ascii'))
-        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
         arg_key_hash = ctypes.c_char_p(key_hash)
         arg_ciphertext = (ctypes.c_char_p * len(ciphertext))()
         arg_ciphertext[:] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in ciphertext]
         arg_plaintext_root = ctypes.c_char_p(str(plaintext_root).encode('ascii'))
 
-        return self._verify(arg_vk_file, arg_proof_json, arg_num_blocks, arg_key_hash, arg_ciphertext, arg_plaintext_root)
+        return (arg_proof_json, arg_key_hash, arg_ciphertext, arg_plaintext_root)
+
+    def _raw_verify_args(self, proof_json, key_hash, ciphertext, plaintext_root, *extra):
+        assert isinstance(proof_json, str)
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(plaintext_root, int)
+
+        return (proof_json.encode('ascii'),) + extra + (
+            key_hash, _buffer_arg(ciphertext, self.num_blocks), plaintext_root.to_bytes(32, 'little'))
+
+    def verify(self, vk_file, proof_json, key_hash, ciphertext, plaintext_root):
+        assert os.path.exists(vk_file)
+
+        arg_vk_file = ctypes.c_char_p(vk_file.encode('ascii'))
+        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
+        if _is_buffer(ciphertext):
+            args = self._raw_verify_args(proof_json, key_hash, ciphertext, plaintext_root, arg_num_blocks, self.circuit)
+            return self._verify_raw(arg_vk_file, *args)
+
+        arg_proof_json, arg_key_hash, arg_ciphertext, arg_plaintext_root = \
+            self._verify_args(proof_json, key_hash, ciphertext, plaintext_root)
+
+        return self._verify(arg_vk_file, arg_proof_json, arg_num_blocks, self.circuit, arg_key_hash, arg_ciphertext, arg_plaintext_root)
+
+    def verify_batch(self, vk_file, jobs):
+        """
+        Verify many (proof_json, key_hash, ciphertext, plaintext_root) jobs
+        with a single multi-pairing check, returns whether each one passed
+        """
+        assert os.path.exists(vk_file)
+
+        arg_vk_file = ctypes.c_char_p(vk_file.encode('ascii'))
+        arg_num_blocks = ctypes.c_size_t(self.num_blocks)
+
+        # Keep the converted arguments alive until the native call returns
+        job_args = [self._verify_args(*job) for job in jobs]
+        arg_jobs = (ContingentVerifyJob * len(jobs))()
+        for i, args in enumerate(job_args):
+            arg_jobs[i] = ContingentVerifyJob(*args)
+
+        out_results = (ctypes.c_bool * len(jobs))()
+        self._verify_batch(arg_vk_file, arg_num_blocks, self.circuit, arg_jobs, len(jobs), out_results)
+        return list(out_results)
+
+    def last_stats(self):
+        """
+        Statistics of the last prove, verify or genkeys call made on this
+        thread as a dict: wall and CPU time per phase, constraint counts,
+        key load time, heap growth and peak RSS. None before the first call.
+        """
+        ptr = self._last_stats()
+        if not ptr:
+            return None
+        try:
+            return json.loads(ctypes.string_at(ptr).decode('ascii'))
+        finally:
+            self._free(ptr)
+
+    def set_lean_proving(self, lean):
+        """
+        Whether provers opened afterwards keep the constraint system in a
+        compact form and lay out the circuit again for every proof, which
+        uses less memory for large numbers of blocks. Applies to the whole
+        library, not only this wrapper. Off by default.
+        """
+        self._set_lean_proving(lean)
+
+    def decrypt_file(self, ciphertext_file, out_file, size, key_hash, key, plaintext_root, num_threads=0):
+        """
+        Check the revealed key against `key_hash`, decrypt the ciphertext
+        (32 byte big-endian field elements) and write the first `size` bytes
+        of the 31 byte plaintext blocks to `out_file`. Returns one of the
+        DECRYPT_* results, the output is removed when the plaintext doesn't
+        match `plaintext_root`.
+        """
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(key, int)
+        assert isinstance(plaintext_root, int)
+
+        return self._decrypt_file(
+            ciphertext_file.encode('ascii'), out_file.encode('ascii'),
+            self.num_blocks, size, self.circuit, key_hash,
+            str(key).encode('ascii'), str(plaintext_root).encode('ascii'), num_threads)
+
+    def verifier(self, vk_file):
+        """
+        Parse the verification key once, returns a ContingentVerifier which
+        can be used to verify many proofs with the same key
+        """
+        assert os.path.exists(vk_file)
+
+        handle = self._verifier_open(ctypes.c_char_p(vk_file.encode('ascii')), self.num_blocks, self.circuit)
+        if not handle:
+            raise RuntimeError("Could not load verification key!")
+        return ContingentVerifier(self, handle)
+
+
+class ContingentProver(object):
+    def __init__(self, wrapper, handle):
+        self._wrapper = wrapper
+        self._handle = ctypes.c_void_p(handle)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def prove(self, key_hash, ciphertext, plaintext_root, key, plaintext):
+        assert self._handle is not None
+        if _is_buffer(plaintext):
+            args = self._wrapper._raw_prove_args(key_hash, ciphertext, plaintext_root, key, plaintext)
+            proof = self._wrapper._prover_prove_raw(self._handle, *args)
+        else:
+            args = self._wrapper._prove_args(key_hash, ciphertext, plaintext_root, key, plaintext)
+            proof = self._wrapper._prover_prove(self._handle, *args)
+        return _take_proof(self._wrapper._free, proof)
+
+    def prepare(self, plaintext):
+        """
+        Compute the part of the proof which only depends on the plaintext,
+        for proving the same file under many keys with the returned
+        ContingentPrepared. Fewer blocks than the prover's are zero-padded
+        with CIRCUIT_PADDED.
+        """
+        assert self._handle is not None
+        assert isinstance(plaintext, (list, tuple))
+
+        arg_plaintext = (ctypes.c_char_p * max(1, len(plaintext)))()
+        arg_plaintext[:len(plaintext)] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in plaintext]
+        handle = self._wrapper._prover_prepare(self._handle, len(plaintext), arg_plaintext)
+        if not handle:
+            raise RuntimeError("Could not prepare plaintext!")
+        return ContingentPrepared(self, handle, len(plaintext))
+
+    def set_full_check(self, full_check):
+        """
+        Whether to also check the witness against every constraint before
+        proving, after the native check of the key hash, ciphertext and
+        plaintext root. On by default.
+        """
+        assert self._handle is not None
+        self._wrapper._prover_set_full_check(self._handle, full_check)
+
+    def prove_chunked(self, key_hash, ciphertext, key, plaintext, num_threads=0):
+        """
+        Prove a file of any multiple of `num_blocks` blocks as segments of
+        `num_blocks` each, in parallel.
+
+        Returns (proofs, sub_roots), one entry per segment.
+        """
+        assert self._handle is not None
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(key, int)
+        assert len(ciphertext) == len(plaintext)
+
+        num_chunks = len(plaintext) // self._wrapper.num_blocks
+        arg_ciphertext = self._wrapper._chunked_args(ciphertext)
+        arg_plaintext = self._wrapper._chunked_args(plaintext)
+        arg_key = ctypes.c_char_p(str(key).encode('ascii'))
+
+        out_proofs = (ctypes.c_void_p * num_chunks)()
+        out_sub_roots = (ctypes.c_void_p * num_chunks)()
+        out_errors = (ctypes.c_void_p * num_chunks)()
+
+        num_failed = self._wrapper._prover_prove_chunked(
+            self._handle, num_chunks, key_hash, arg_ciphertext, arg_key, arg_plaintext,
+            num_threads, out_proofs, out_sub_roots, out_errors)
+
+        proofs, sub_roots, errors = [], [], []
+        for proof, sub_root, error in zip(out_proofs, out_sub_roots, out_errors):
+            if proof:
+                proofs.append(ctypes.string_at(proof).decode('ascii'))
+            if sub_root:
+                sub_roots.append(int(ctypes.string_at(sub_root).decode('ascii')))
+            if error:
+                errors.append(ctypes.string_at(error).decode('ascii'))
+            self._wrapper._free(proof)
+            self._wrapper._free(sub_root)
+            self._wrapper._free(error)
+
+        if num_failed:
+            raise RuntimeError("Could not prove: " + '; '.join(errors))
+        return proofs, sub_roots
+
+    def set_threads(self, num_threads, first_core=-1):
+        """
+        Threads every proof of this prover may use, 0 for one per core. With
+        `first_core` >= 0 they're pinned to the cores from `first_core` on,
+        the calling thread keeps its affinity.
+        """
+        assert self._handle is not None
+        assert isinstance(num_threads, int) and num_threads >= 0
+        self._wrapper._prover_set_threads(self._handle, num_threads, first_core)
+
+    def close(self):
+        if self._handle is not None:
+            self._wrapper._prover_close(self._handle)
+            self._handle = None
+
+
+class ContingentPrepared(object):
+    """
+    Plaintext prepared by ContingentProver.prepare(), only valid while its
+    prover is open
+    """
+    def __init__(self, prover, handle, num_blocks):
+        self._prover = prover
+        self._handle = ctypes.c_void_p(handle)
+        self.num_blocks = num_blocks
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    @property
+    def plaintext_root(self):
+        assert self._handle is not None
+        wrapper = self._prover._wrapper
+        ptr = wrapper._prepared_plaintext_root(self._handle)
+        try:
+            return int(ctypes.string_at(ptr).decode('ascii'))
+        finally:
+            wrapper._free(ptr)
+
+    def prove(self, key_hash, ciphertext, key):
+        """
+        Prove the prepared plaintext encrypted to `ciphertext` with `key`
+        """
+        assert self._handle is not None
+        assert self._prover._handle is not None
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(key, int)
+        assert len(ciphertext) == self.num_blocks
+
+        arg_ciphertext = (ctypes.c_char_p * max(1, len(ciphertext)))()
+        arg_ciphertext[:len(ciphertext)] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in ciphertext]
+        proof = self._prover._wrapper._prover_prove_prepared(
+            self._prover._handle, self._handle, key_hash, arg_ciphertext, str(key).encode('ascii'))
+        return _take_proof(self._prover._wrapper._free, proof)
+
+    def close(self):
+        if getattr(self, '_handle', None) is not None:
+            self._prover._wrapper._prepared_close(self._handle)
+            self._handle = None
+
+
+class ContingentVerifier(object):
+    def __init__(self, wrapper, handle):
+        self._wrapper = wrapper
+        self._handle = ctypes.c_void_p(handle)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def verify(self, proof_json, key_hash, ciphertext, plaintext_root):
+        assert self._handle is not None
+        if _is_buffer(ciphertext):
+            args = self._wrapper._raw_verify_args(proof_json, key_hash, ciphertext, plaintext_root)
+            return self._wrapper._verifier_verify_raw(self._handle, *args)
+
+        args = self._wrapper._verify_args(proof_json, key_hash, ciphertext, plaintext_root)
+        return self._wrapper._verifier_verify(self._handle, *args)
+
+    def verify_batch(self, jobs):
+        """
+        Verify many (proof_json, key_hash, ciphertext, plaintext_root) jobs
+        with a single multi-pairing check, returns whether each one passed
+        """
+        assert self._handle is not None
+
+        # Keep the converted arguments alive until the native call returns
+        job_args = [self._wrapper._verify_args(*job) for job in jobs]
+        arg_jobs = (ContingentVerifyJob * len(jobs))()
+        for i, args in enumerate(job_args):
+            arg_jobs[i] = ContingentVerifyJob(*args)
+
+        out_results = (ctypes.c_bool * len(jobs))()
+        self._wrapper._verifier_verify_batch(self._handle, arg_jobs, len(jobs), out_results)
+        return list(out_results)
+
+    def verify_chunked(self, proofs, sub_roots, key_hash, ciphertext, plaintext_root):
+        assert self._handle is not None
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(plaintext_root, int)
+        assert len(proofs) == len(sub_roots)
+        assert len(ciphertext) == len(proofs) * self._wrapper.num_blocks
+
+        arg_proofs = (ctypes.c_char_p * len(proofs))()
+        arg_proofs[:] = [ctypes.c_char_p(_.encode('ascii')) for _ in proofs]
+        arg_sub_roots = (ctypes.c_char_p * len(sub_roots))()
+        arg_sub_roots[:] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in sub_roots]
+        arg_ciphertext = self._wrapper._chunked_args(ciphertext)
+        arg_plaintext_root = ctypes.c_char_p(str(plaintext_root).encode('ascii'))
+
+        return self._wrapper._verifier_verify_chunked(
+            self._handle, len(proofs), arg_proofs, arg_sub_roots, key_hash, arg_ciphertext, arg_plaintext_root)
+
+    def close(self):
+        if self._handle is not None:
+            self._wrapper._verifier_close(self._handle)
+            self._handle = None
+
+
+class ContingentRegistry(object):
+    """
+    Keys for the power-of-two size classes of a padded circuit variant, kept
+    in `keys_dir` and loaded the first time a class is used. The prover
+    generates them with `genkeys()`, a verifier only needs the verification
+    keys. A file of any number of blocks is proven with the key of its size
+    class, its plaintext root is that of the plaintext zero-padded to the class.
+    """
+    def __init__(self, native_library_path, keys_dir, circuit=CIRCUIT_DEFAULT):
+        assert circuit & ~(CIRCUIT_MIMC_KEY | CIRCUIT_PACKED_KEY_HASH | CIRCUIT_CIPHERTEXT_HASH | CIRCUIT_PADDED) == 0
+        assert os.path.isdir(keys_dir)
+
+        self.circuit = circuit | CIRCUIT_PADDED
+
+        lib = ctypes.cdll.LoadLibrary(native_library_path)
+
+        lib_size_class = lib.contingent_size_class
+        lib_size_class.argtypes = [ctypes.c_size_t]
+        lib_size_class.restype = ctypes.c_size_t
+        self._size_class = lib_size_class
+
+        lib_registry_open = lib.contingent_registry_open
+        lib_registry_open.argtypes = [ctypes.c_char_p, ctypes.c_uint]
+        lib_registry_open.restype = ctypes.c_void_p
+
+        lib_registry_genkeys = lib.contingent_registry_genkeys
+        lib_registry_genkeys.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib_registry_genkeys.restype = ctypes.c_int
+        self._registry_genkeys = lib_registry_genkeys
+
+        lib_registry_prover = lib.contingent_registry_prover
+        lib_registry_prover.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib_registry_prover.restype = ctypes.c_void_p
+        self._registry_prover = lib_registry_prover
+
+        lib_registry_verifier = lib.contingent_registry_verifier
+        lib_registry_verifier.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib_registry_verifier.restype = ctypes.c_void_p
+        self._registry_verifier = lib_registry_verifier
+
+        lib_registry_close = lib.contingent_registry_close
+        lib_registry_close.argtypes = [ctypes.c_void_p]
+        lib_registry_close.restype = None
+        self._registry_close = lib_registry_close
+
+        lib_prover_prove_padded = lib.contingent_prover_prove_padded
+        lib_prover_prove_padded.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p,
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p)]
+        lib_prover_prove_padded.restype = ctypes.c_void_p
+        self._prover_prove_padded = lib_prover_prove_padded
+
+        lib_verifier_verify_padded = lib.contingent_verifier_verify_padded
+        lib_verifier_verify_padded.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p,
+            ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p]
+        lib_verifier_verify_padded.restype = ctypes.c_bool
+        self._verifier_verify_padded = lib_verifier_verify_padded
+
+        lib_free = lib.contingent_free
+        lib_free.argtypes = [ctypes.c_void_p]
+        lib_free.restype = None
+        self._free = lib_free
+
+        self._handle = lib_registry_open(keys_dir.encode('ascii'), self.circuit)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def size_class(self, num_blocks):
+        return self._size_class(num_blocks)
+
+    @staticmethod
+    def _field_args(values):
+        arg_values = (ctypes.c_char_p * max(1, len(values)))()
+        arg_values[:len(values)] = [ctypes.c_char_p(str(_).encode('ascii')) for _ in values]
+        return arg_values
+
+    def genkeys(self, num_blocks):
+        """
+        Generate the keys of the size class of `num_blocks` unless they are
+        in the directory already, on the prover's side only
+        """
+        assert self._handle is not None
+        if self._registry_genkeys(self._handle, num_blocks) != 0:
+            raise RuntimeError("Could not generate keys!")
+
+    def prove(self, key_hash, ciphertext, plaintext_root, key, plaintext):
+        assert self._handle is not None
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(plaintext_root, int)
+        assert isinstance(key, int)
+        assert len(ciphertext) == len(plaintext)
+
+        prover = self._registry_prover(self._handle, len(plaintext))
+        if not prover:
+            raise RuntimeError("Could not load proving key!")
+
+        proof = self._prover_prove_padded(
+            prover, len(plaintext), key_hash, self._field_args(ciphertext),
+            str(plaintext_root).encode('ascii'), str(key).encode('ascii'), self._field_args(plaintext))
+        return _take_proof(self._free, proof)
+
+    def verify(self, proof_json, key_hash, ciphertext, plaintext_root):
+        assert self._handle is not None
+        assert isinstance(proof_json, str)
+        assert isinstance(key_hash, bytes)
+        assert len(key_hash) == 32
+        assert isinstance(plaintext_root, int)
+
+        verifier = self._registry_verifier(self._handle, len(ciphertext))
+        if not verifier:
+            raise RuntimeError("Could not load verification key!")
+
+        return self._verifier_verify_padded(
+            verifier, len(ciphertext), proof_json.encode('ascii'), key_hash,
+            self._field_args(ciphertext), str(plaintext_root).encode('ascii'))
+
+    def close(self):
+        if getattr(self, '_handle', None) is not None:
+            self._registry_close(self._handle)
+            self._handle = None
 
 
 class Main(object):
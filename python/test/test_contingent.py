@@ -1,17 +1,94 @@
+import os
+import json
+import shutil
 import hashlib
+import socket
+import subprocess
+import time
 import unittest
 
 from ethsnarks.field import FQ
-from ethsnarks.mimc import mimc_encrypt
+from ethsnarks.mimc import mimc_encrypt, mimc_hash
 from ethsnarks.utils import native_lib_path
 from ethsnarks.merkletree2 import merkle_root
-from contingent import Contingent
+from contingent import Contingent, ContingentRegistry, CIRCUIT_MIMC_KEY, CIRCUIT_PACKED_KEY_HASH, \
+	CIRCUIT_CIPHERTEXT_HASH, CIRCUIT_PADDED, DECRYPT_OK, DECRYPT_BAD_KEY, DECRYPT_BAD_ROOT, fields_to_bytes
 
 
 NATIVE_LIB_PATH = native_lib_path('../.build/libcontingent')
 VK_PATH = '../.keys/contingent.vk.json'
 PK_PATH = '../.keys/contingent.pk.raw'
 PROOF_PATH = '../.keys/contingent.proof.json'
+HANDLE_VK_PATH = '../.keys/contingent.handle.vk.json'
+HANDLE_PK_PATH = '../.keys/contingent.handle.pk.raw'
+BATCH_VK_PATH = '../.keys/contingent.batch.vk.json'
+BATCH_PK_PATH = '../.keys/contingent.batch.pk.raw'
+ENCODING_VK_PATH = '../.keys/contingent.encoding.vk.json'
+ENCODING_PK_PATH = '../.keys/contingent.encoding.pk.raw'
+CHUNK_VK_PATH = '../.keys/contingent.chunk.vk.json'
+CHUNK_PK_PATH = '../.keys/contingent.chunk.pk.raw'
+PARALLEL_VK_PATH = '../.keys/contingent.parallel.vk.json'
+PARALLEL_PK_PATH = '../.keys/contingent.parallel.pk.raw'
+MIMC_VK_PATH = '../.keys/contingent.mimc.vk.json'
+MIMC_PK_PATH = '../.keys/contingent.mimc.pk.raw'
+PACKED_VK_PATH = '../.keys/contingent.packed.vk.json'
+PACKED_PK_PATH = '../.keys/contingent.packed.pk.raw'
+CTHASH_VK_PATH = '../.keys/contingent.cthash.vk.json'
+CTHASH_PK_PATH = '../.keys/contingent.cthash.pk.raw'
+ENCRYPT_VK_PATH = '../.keys/contingent.encrypt.vk.json'
+ENCRYPT_PK_PATH = '../.keys/contingent.encrypt.pk.raw'
+ENCRYPT_IN_PATH = '../.keys/contingent.encrypt.in'
+ENCRYPT_PREFIX = '../.keys/contingent.encrypt'
+ENCRYPT_PROOF_PATH = '../.keys/contingent.encrypt.proof.json'
+DECRYPT_CT_PATH = '../.keys/contingent.decrypt.ct'
+DECRYPT_OUT_PATH = '../.keys/contingent.decrypt.out'
+THREADS_VK_PATH = '../.keys/contingent.threads.vk.json'
+THREADS_PK_PATH = '../.keys/contingent.threads.pk.raw'
+THREADS_PROOF_PATH = '../.keys/contingent.threads.proof.json'
+STATS_VK_PATH = '../.keys/contingent.stats.vk.json'
+STATS_PK_PATH = '../.keys/contingent.stats.pk.raw'
+SERVE_VK_PATH = '../.keys/contingent.serve.vk.json'
+SERVE_PK_PATH = '../.keys/contingent.serve.pk.raw'
+SERVE_KEYS_PATH = '../.keys/contingent.serve.keys'
+SERVE_SOCKET_PATH = '../.keys/contingent.serve.sock'
+REGISTRY_PATH = '../.keys/registry'
+REGISTRY_VK_PATH = '../.keys/registry-vk'
+MAPPED_VK_PATH = '../.keys/contingent.mapped.vk.json'
+MAPPED_PK_PATH = '../.keys/contingent.mapped.pk.map'
+CLI_PATH = '../.build/contingent_cli'
+CLI_INPUTS_PATH = '../.keys/contingent.cli.inputs'
+CLI_PROOF_PATH = '../.keys/contingent.cli.proof.bin'
+CONVERT_IN_PATH = '../.keys/contingent.convert.in'
+CONVERT_OUT_PATH = '../.keys/contingent.convert.out'
+PROOF_BINARY_SIZE = 134
+FQ_MODULUS = 21888242871839275222246405745257275088696311157297823662689037894645226208583
+
+
+def _convert(data):
+	"""
+	Proof or verification key in the other encoding, JSON or binary, with
+	`contingent_cli convert`
+	"""
+	with open(CONVERT_IN_PATH, 'wb') as handle:
+		handle.write(data)
+	subprocess.run([CLI_PATH, 'convert', CONVERT_IN_PATH, CONVERT_OUT_PATH], check=True)
+	with open(CONVERT_OUT_PATH, 'rb') as handle:
+		return handle.read()
+
+
+def _json_values(document):
+	"""
+	Hex strings of a JSON proof or verification key as ints, so documents
+	compare equal whatever their formatting
+	"""
+	if isinstance(document, dict):
+		return {k: _json_values(v) for k, v in document.items()}
+	if isinstance(document, list):
+		return [_json_values(_) for _ in document]
+	if isinstance(document, str) and document.startswith('0x'):
+		return int(document, 16)
+	return document
+
 
 class TestContingent(unittest.TestCase):
 	def test_make_proof(self):
@@ -66,6 +143,689 @@ class TestContingent(unittest.TestCase):
 
 		print('Verify done!')
 
+	def test_prover_handle(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(HANDLE_PK_PATH, HANDLE_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Prove repeatedly with the proving key held in memory
+		with wrapper.prover(HANDLE_PK_PATH) as prover:
+			for _ in range(2):
+				proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+				self.assertTrue(wrapper.verify(HANDLE_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+			# A wrong key is refused
+			with self.assertRaises(RuntimeError):
+				prover.prove(key_hash, ciphertext, plaintext_root, key + 1, plaintext)
+
+		print('Prover handle done!')
+
+	def test_prove_batch(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(BATCH_PK_PATH, BATCH_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Batch of proofs on three workers proving at the same time, the
+		# last job uses the wrong key
+		good_job = (key_hash, ciphertext, plaintext_root, key, plaintext)
+		results = wrapper.prove_batch(BATCH_PK_PATH, [good_job] * 3 + [
+			(key_hash, ciphertext, plaintext_root, key + 1, plaintext),
+		], num_threads=3)
+		self.assertEqual(len(results), 4)
+		for proof, error in results[:3]:
+			self.assertIsNone(error)
+			self.assertTrue(wrapper.verify(BATCH_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+		self.assertIsNone(results[3][0])
+		self.assertIsNotNone(results[3][1])
+
+		print('Batch prove done!')
+
+	def test_verify_batch(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(BATCH_PK_PATH, BATCH_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Batch verification flags only the tampered proof, whose C point
+		# is replaced by its A point
+		proofs = [wrapper.prove(BATCH_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext) for _ in range(3)]
+		tampered = json.loads(proofs[1])
+		tampered['C'] = tampered['A']
+		proofs[1] = json.dumps(tampered)
+		self.assertEqual(wrapper.verify_batch(BATCH_VK_PATH, [
+			(proof, key_hash, ciphertext, plaintext_root) for proof in proofs
+		]), [True, False, True])
+
+		print('Batch verify done!')
+
+	def test_verifier_handle(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(HANDLE_PK_PATH, HANDLE_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Verify repeatedly with the verification key held in memory
+		proof = wrapper.prove(HANDLE_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+		with wrapper.verifier(HANDLE_VK_PATH) as verifier:
+			for _ in range(2):
+				self.assertTrue(verifier.verify(proof, key_hash, ciphertext, plaintext_root))
+			self.assertFalse(verifier.verify(proof, key_hash, ciphertext, plaintext_root + 1))
+
+			# And as a batch, with the second job's root wrong
+			self.assertEqual(verifier.verify_batch([
+				(proof, key_hash, ciphertext, plaintext_root),
+				(proof, key_hash, ciphertext, plaintext_root + 1),
+			]), [True, False])
+
+		print('Verifier handle done!')
+
+	def test_encoding_roundtrip(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(ENCODING_PK_PATH, ENCODING_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+		proof = wrapper.prove(ENCODING_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+
+		# The proof, and the same proof with A negated, whose y has the other
+		# parity, so both values of the odd flag are covered
+		negated = json.loads(proof)
+		y = negated['A'][1]
+		negated['A'][1] = '0x{:0{}x}'.format(FQ_MODULUS - int(y, 16), len(y) - 2)
+		odd_flags = []
+		for document in (proof, json.dumps(negated)):
+			binary = _convert(document.encode('ascii'))
+			self.assertEqual(len(binary), PROOF_BINARY_SIZE)
+			self.assertEqual(_json_values(json.loads(_convert(binary))), _json_values(json.loads(document)))
+			self.assertEqual(_convert(_convert(binary)), binary)
+			odd_flags.append(binary[6] & 0x80)
+		self.assertNotEqual(odd_flags[0], odd_flags[1])
+
+		# A at infinity is the infinity flag followed by zeros
+		infinity = binary[:6] + bytes([0x40]) + bytes(31) + binary[38:]
+		self.assertEqual(_convert(_convert(infinity)), infinity)
+
+		with open(ENCODING_VK_PATH, 'rb') as handle:
+			vk = handle.read()
+		binary = _convert(vk)
+		self.assertEqual(_json_values(json.loads(_convert(binary))), _json_values(json.loads(vk)))
+		self.assertEqual(_convert(_convert(binary)), binary)
+
+		print('Encoding round trip done!')
+
+	def test_encoding_rejects_non_canonical(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(ENCODING_PK_PATH, ENCODING_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+		binary = _convert(wrapper.prove(ENCODING_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext).encode('ascii'))
+
+		def rejected(data):
+			with open(CONVERT_IN_PATH, 'wb') as handle:
+				handle.write(data)
+			return subprocess.run([CLI_PATH, 'convert', CONVERT_IN_PATH, CONVERT_OUT_PATH]).returncode != 0
+
+		# The point at infinity with the odd flag, or with any other bit set
+		self.assertTrue(rejected(binary[:6] + bytes([0xC0]) + bytes(31) + binary[38:]))
+		self.assertTrue(rejected(binary[:6] + bytes([0x40]) + bytes(30) + bytes([1]) + binary[38:]))
+		self.assertTrue(rejected(binary[:38] + bytes([0x40]) + bytes(62) + bytes([1]) + binary[102:]))
+
+		# B on the twist, but outside of the subgroup of order r: x = (k, 0)
+		# for the first k where x^3 + 3/(9+u) is a square in Fq2
+		q = FQ_MODULUS
+		b = (27 * pow(82, q - 2, q) % q, -3 * pow(82, q - 2, q) % q)
+		k = 1
+		while pow((pow(k, 3, q) + b[0]) ** 2 + b[1] ** 2, (q - 1) // 2, q) != 1:
+			k += 1
+		twist = bytes(32) + k.to_bytes(32, 'big')
+		self.assertTrue(rejected(binary[:38] + twist + binary[102:]))
+
+		print('Non-canonical encodings done!')
+
+	def test_chunked_proof(self):
+		chunk_blocks = 8
+		num_chunks = 4
+		num_blocks = chunk_blocks * num_chunks
+
+		wrapper = Contingent(NATIVE_LIB_PATH, chunk_blocks)
+		self.assertTrue(wrapper.genkeys(CHUNK_PK_PATH, CHUNK_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		with wrapper.prover(CHUNK_PK_PATH) as prover, wrapper.verifier(CHUNK_VK_PATH) as verifier:
+			proofs, sub_roots = prover.prove_chunked(key_hash, ciphertext, key, plaintext)
+			self.assertEqual(len(proofs), num_chunks)
+			self.assertTrue(verifier.verify_chunked(
+				proofs, sub_roots, key_hash, ciphertext, plaintext_root))
+
+			# Segments swapped around no longer add up to the root
+			self.assertFalse(verifier.verify_chunked(
+				proofs[::-1], sub_roots[::-1], key_hash, ciphertext, plaintext_root))
+
+		print('Chunked prove done!')
+
+	def test_parallel_witness_proof(self):
+		# PARALLEL_WITNESS_MIN_BLOCKS, the witnesses and the Merkle subtrees
+		# are computed concurrently from here on
+		num_blocks = 64
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(PARALLEL_PK_PATH, PARALLEL_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# The witness is checked against every constraint before proving
+		with wrapper.prover(PARALLEL_PK_PATH) as prover:
+			proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+			self.assertTrue(wrapper.verify(PARALLEL_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+			with self.assertRaises(RuntimeError):
+				prover.prove(key_hash, ciphertext, plaintext_root + 1, key, plaintext)
+
+		print('Parallel witness prove done!')
+
+	def test_mimc_key_proof(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks, circuit=CIRCUIT_MIMC_KEY)
+		self.assertTrue(wrapper.genkeys(MIMC_PK_PATH, MIMC_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = int(mimc_hash([key], 1)).to_bytes(32, 'big')
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		proof = wrapper.prove(MIMC_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+		self.assertTrue(wrapper.verify(MIMC_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+		self.assertEqual(wrapper.verify_batch(MIMC_VK_PATH, [(proof, key_hash, ciphertext, plaintext_root)] * 2), [True, True])
+
+		# The SHA256 key hash doesn't satisfy the MiMC circuit
+		sha256_key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		with self.assertRaises(RuntimeError):
+			wrapper.prove(MIMC_PK_PATH, sha256_key_hash, ciphertext, plaintext_root, key, plaintext)
+
+		print('MiMC key prove done!')
+
+	def test_packed_key_hash_proof(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks, circuit=CIRCUIT_PACKED_KEY_HASH)
+		self.assertTrue(wrapper.genkeys(PACKED_PK_PATH, PACKED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		proof = wrapper.prove(PACKED_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+		self.assertTrue(wrapper.verify(PACKED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		# Flipping a bit in either half of the key hash fails verification
+		for i in (0, 31):
+			bad_key_hash = bytearray(key_hash)
+			bad_key_hash[i] ^= 1
+			self.assertFalse(wrapper.verify(PACKED_VK_PATH, proof, bytes(bad_key_hash), ciphertext, plaintext_root))
+
+		print('Packed key hash prove done!')
+
+	def test_ciphertext_hash_proof(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks, circuit=CIRCUIT_PACKED_KEY_HASH | CIRCUIT_CIPHERTEXT_HASH)
+		self.assertTrue(wrapper.genkeys(CTHASH_PK_PATH, CTHASH_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		proof = wrapper.prove(CTHASH_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+		self.assertTrue(wrapper.verify(CTHASH_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		# The verifier recomputes the ciphertext root, a changed block fails
+		bad_ciphertext = list(ciphertext)
+		bad_ciphertext[-1] = int(FQ(bad_ciphertext[-1]) + 1)
+		self.assertFalse(wrapper.verify(CTHASH_VK_PATH, proof, key_hash, bad_ciphertext, plaintext_root))
+
+		print('Ciphertext hash prove done!')
+
+	def test_encrypt_file(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(ENCRYPT_PK_PATH, ENCRYPT_VK_PATH) == 0)
+
+		# 31 byte blocks, the last one partly filled
+		data = os.urandom(31 * (num_blocks - 1) + 7)
+		with open(ENCRYPT_IN_PATH, 'wb') as handle:
+			handle.write(data)
+		subprocess.run([CLI_PATH, 'encrypt', ENCRYPT_IN_PATH, ENCRYPT_PREFIX], check=True)
+
+		with open(ENCRYPT_PREFIX + '.json') as handle:
+			info = json.load(handle)
+		with open(ENCRYPT_PREFIX + '.key.json') as handle:
+			key = int(json.load(handle)['key'])
+		with open(ENCRYPT_PREFIX + '.ct', 'rb') as handle:
+			ct = handle.read()
+
+		padded = data + bytes(31 * num_blocks - len(data))
+		plaintext = [int.from_bytes(padded[i:i + 31], 'big') for i in range(0, len(padded), 31)]
+		self.assertEqual(int(info['num_blocks']), num_blocks)
+		self.assertEqual(int(info['size']), len(data))
+		self.assertEqual(int(info['plaintext_root']), int(merkle_root(plaintext)))
+		self.assertEqual(bytes.fromhex(info['key_hash']), hashlib.sha256(key.to_bytes(32, 'little')).digest())
+		self.assertEqual(
+			[int.from_bytes(ct[i:i + 32], 'little') for i in range(0, len(ct), 32)],
+			[int(_) for _ in mimc_encrypt(plaintext, key)])
+
+		def verify():
+			result = subprocess.run(
+				[CLI_PATH, 'verify', ENCRYPT_VK_PATH, ENCRYPT_PROOF_PATH, '--encrypted', ENCRYPT_PREFIX],
+				check=True, stdout=subprocess.PIPE)
+			return b'Verification Passed!' in result.stdout
+
+		subprocess.run([CLI_PATH, 'prove', ENCRYPT_PK_PATH, ENCRYPT_PROOF_PATH, '--encrypted', ENCRYPT_PREFIX], check=True)
+		self.assertTrue(verify())
+
+		# The proof doesn't hold for another plaintext root
+		info['plaintext_root'] = str(int(info['plaintext_root']) + 1)
+		with open(ENCRYPT_PREFIX + '.json', 'w') as handle:
+			json.dump(info, handle)
+		self.assertFalse(verify())
+
+		print('Encrypt prove done!')
+
+	def test_decrypt_file(self):
+		num_blocks = 16
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+
+		# 31 byte blocks, the last one partly filled
+		data = os.urandom(31 * (num_blocks - 1) + 7)
+		padded = data + bytes(31 * num_blocks - len(data))
+		plaintext = [int.from_bytes(padded[i:i + 31], 'big') for i in range(0, len(padded), 31)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		with open(DECRYPT_CT_PATH, 'wb') as handle:
+			for block in ciphertext:
+				handle.write(int(block).to_bytes(32, 'little'))
+
+		result = wrapper.decrypt_file(DECRYPT_CT_PATH, DECRYPT_OUT_PATH, len(data), key_hash, key, plaintext_root)
+		self.assertEqual(result, DECRYPT_OK)
+		with open(DECRYPT_OUT_PATH, 'rb') as handle:
+			self.assertEqual(handle.read(), data)
+
+		bad_key = int(FQ(key) + 1)
+		result = wrapper.decrypt_file(DECRYPT_CT_PATH, DECRYPT_OUT_PATH, len(data), key_hash, bad_key, plaintext_root)
+		self.assertEqual(result, DECRYPT_BAD_KEY)
+
+		result = wrapper.decrypt_file(DECRYPT_CT_PATH, DECRYPT_OUT_PATH, len(data), key_hash, key, plaintext_root + 1)
+		self.assertEqual(result, DECRYPT_BAD_ROOT)
+		self.assertFalse(os.path.exists(DECRYPT_OUT_PATH))
+
+		print('Decrypt done!')
+
+	def test_thread_budget(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(THREADS_PK_PATH, THREADS_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+		affinity = os.sched_getaffinity(0)
+		first_core = min(affinity)
+
+		# An explicit budget, then pinned to the cores from first_core on
+		with wrapper.prover(THREADS_PK_PATH) as prover:
+			for pin in (-1, first_core):
+				prover.set_threads(2, pin)
+				proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+				self.assertTrue(wrapper.verify(THREADS_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+				self.assertEqual(os.sched_getaffinity(0), affinity)
+
+		# The same with contingent_cli --threads and --pin
+		args = [str(_) for _ in [num_blocks, key_hash.hex()] + ciphertext + [plaintext_root, key] + plaintext]
+		subprocess.run([CLI_PATH, '--threads', '2', '--pin', str(first_core), 'prove', THREADS_PK_PATH, THREADS_PROOF_PATH] + args, check=True)
+		with open(THREADS_PROOF_PATH) as handle:
+			proof = handle.read()
+		self.assertTrue(wrapper.verify(THREADS_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		print('Thread budget prove done!')
+
+	def test_stats(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(STATS_PK_PATH, STATS_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		proof = wrapper.prove(STATS_PK_PATH, key_hash, ciphertext, plaintext_root, key, plaintext)
+
+		# Per-phase statistics of the prove call
+		stats = wrapper.last_stats()
+		self.assertEqual(stats['call'], 'prove')
+		self.assertGreater(stats['constraints'], 0)
+		phases = [phase['name'] for phase in stats['phases']]
+		for name in ('key_load', 'witness', 'fft', 'multiexp'):
+			self.assertIn(name, phases)
+
+		# Nothing else ran, so the process-wide figures are reported
+		self.assertFalse(stats['overlapped'])
+		self.assertGreater(stats['process_cpu_ms'], 0)
+		self.assertGreater(stats['process_allocated_bytes'], 0)
+		self.assertIn('process_heap_growth_bytes', stats)
+
+		self.assertTrue(wrapper.verify(STATS_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+		self.assertEqual(wrapper.last_stats()['call'], 'verify')
+
+		print('Stats done!')
+
+	def test_serve(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(SERVE_PK_PATH, SERVE_VK_PATH) == 0)
+		with open(SERVE_KEYS_PATH, 'w') as handle:
+			handle.write('%d %s %s\n' % (num_blocks, SERVE_PK_PATH, SERVE_VK_PATH))
+
+		if os.path.exists(SERVE_SOCKET_PATH):
+			os.unlink(SERVE_SOCKET_PATH)
+		daemon = subprocess.Popen([CLI_PATH, 'serve', SERVE_SOCKET_PATH, SERVE_KEYS_PATH])
+		try:
+			# The socket is created once the keys are loaded
+			for _ in range(600):
+				if os.path.exists(SERVE_SOCKET_PATH) or daemon.poll() is not None:
+					break
+				time.sleep(0.1)
+			self.assertTrue(os.path.exists(SERVE_SOCKET_PATH))
+
+			plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+			plaintext_root = merkle_root(plaintext)
+			key = int(FQ.random())
+			key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+			ciphertext = mimc_encrypt(plaintext, key)
+			with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+				client.connect(SERVE_SOCKET_PATH)
+				replies = client.makefile('r')
+
+				def job(*fields):
+					client.sendall((' '.join(str(_) for _ in fields) + '\n').encode('ascii'))
+					return replies.readline().split()
+
+				reply = job('p1', 'prove', num_blocks, key_hash.hex(), *(ciphertext + [plaintext_root, key] + plaintext))
+				self.assertEqual(reply[:2], ['p1', 'ok'])
+				proof = reply[2]
+				self.assertEqual(len(bytes.fromhex(proof)), PROOF_BINARY_SIZE)
+
+				reply = job('v1', 'verify', num_blocks, proof, key_hash.hex(), *(ciphertext + [plaintext_root]))
+				self.assertEqual(reply, ['v1', 'valid'])
+
+				reply = job('v2', 'verify', num_blocks, proof, key_hash.hex(), *(ciphertext + [plaintext_root + 1]))
+				self.assertEqual(reply, ['v2', 'invalid'])
+
+				# A line longer than any job is refused and the connection closed
+				reply = job('big', 'verify', num_blocks, '0' * 10000)
+				self.assertEqual(reply, ['big', 'error', 'line', 'too', 'long'])
+				self.assertEqual(replies.readline(), '')
+		finally:
+			daemon.terminate()
+			daemon.wait()
+
+		print('Serve done!')
+
+	def test_registry_proof(self):
+		os.makedirs(REGISTRY_PATH, exist_ok=True)
+
+		with ContingentRegistry(NATIVE_LIB_PATH, REGISTRY_PATH, circuit=CIRCUIT_PACKED_KEY_HASH) as registry:
+			num_blocks = 5
+			self.assertEqual(registry.size_class(num_blocks), 8)
+			registry.genkeys(num_blocks)
+
+			# The plaintext root covers the file zero-padded to its size class
+			plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+			plaintext_root = merkle_root(plaintext + [0] * 3)
+			key = int(FQ.random())
+			key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+			ciphertext = mimc_encrypt(plaintext, key)
+
+			proof = registry.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+			self.assertTrue(registry.verify(proof, key_hash, ciphertext, plaintext_root))
+
+			# The number of data blocks is bound by the proof
+			self.assertFalse(registry.verify(proof, key_hash, ciphertext + [0], plaintext_root))
+
+		# A buyer verifies with the verification key alone, nothing is generated
+		vk_name = 'contingent.8.%d.vk.json' % (CIRCUIT_PACKED_KEY_HASH | CIRCUIT_PADDED)
+		os.makedirs(REGISTRY_VK_PATH, exist_ok=True)
+		shutil.copyfile(os.path.join(REGISTRY_PATH, vk_name), os.path.join(REGISTRY_VK_PATH, vk_name))
+		with ContingentRegistry(NATIVE_LIB_PATH, REGISTRY_VK_PATH, circuit=CIRCUIT_PACKED_KEY_HASH) as registry:
+			self.assertTrue(registry.verify(proof, key_hash, ciphertext, plaintext_root))
+			with self.assertRaises(RuntimeError):
+				registry.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+		self.assertEqual(os.listdir(REGISTRY_VK_PATH), [vk_name])
+
+		print('Registry prove done!')
+
+	def test_mapped_keygen_proof(self):
+		num_blocks = 8
+
+		# Generated section by section straight into the sectioned layout
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		with wrapper.prover(MAPPED_PK_PATH) as prover:
+			proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+		self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		print('Mapped keygen prove done!')
+
+	def test_raw_proof(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Buffers of 32 byte little-endian field elements
+		ciphertext_bytes = fields_to_bytes(ciphertext)
+		plaintext_bytes = bytearray(fields_to_bytes(plaintext))
+
+		proof = wrapper.prove(MAPPED_PK_PATH, key_hash, ciphertext_bytes, plaintext_root, key, memoryview(plaintext_bytes))
+		self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext_bytes, plaintext_root))
+		self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		with wrapper.prover(MAPPED_PK_PATH) as prover, wrapper.verifier(MAPPED_VK_PATH) as verifier:
+			proof = prover.prove(key_hash, ciphertext_bytes, plaintext_root, key, plaintext_bytes)
+			self.assertTrue(verifier.verify(proof, key_hash, memoryview(ciphertext_bytes), plaintext_root))
+
+			# Values outside the field are rejected
+			overflow = b'\xff' * 32 + ciphertext_bytes[32:]
+			self.assertFalse(verifier.verify(proof, key_hash, overflow, plaintext_root))
+
+		print('Raw prove done!')
+
+	def test_precheck(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+		bad_ciphertext = ciphertext[:3] + [ciphertext[3] + 1] + ciphertext[4:]
+
+		with wrapper.prover(MAPPED_PK_PATH) as prover:
+			# Rejected by the native check before the witness is generated
+			with self.assertRaises(RuntimeError):
+				prover.prove(key_hash, bad_ciphertext, plaintext_root, key, plaintext)
+			phases = [phase['name'] for phase in wrapper.last_stats()['phases']]
+			self.assertIn('precheck', phases)
+			self.assertNotIn('witness', phases)
+
+			# Without the constraint check once the inputs are known good
+			prover.set_full_check(False)
+			proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+			phases = [phase['name'] for phase in wrapper.last_stats()['phases']]
+			self.assertNotIn('check', phases)
+		self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+		print('Precheck done!')
+
+	def test_prepared_plaintext(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+
+		# The same file sold to several buyers, each with their own key
+		with wrapper.prover(MAPPED_PK_PATH) as prover, prover.prepare(plaintext) as prepared:
+			self.assertEqual(prepared.plaintext_root, plaintext_root)
+			for _ in range(2):
+				key = int(FQ.random())
+				key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+				ciphertext = mimc_encrypt(plaintext, key)
+
+				proof = prepared.prove(key_hash, ciphertext, key)
+				self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+			with self.assertRaises(RuntimeError):
+				prepared.prove(key_hash, ciphertext, key + 1)
+
+		print('Prepared plaintext done!')
+
+	def test_cli_inputs(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# The key hash as is, then 32 byte little-endian field elements
+		public_inputs = key_hash + fields_to_bytes(ciphertext) + fields_to_bytes([plaintext_root])
+		with open(CLI_INPUTS_PATH, 'wb') as handle:
+			handle.write(public_inputs + fields_to_bytes([key]) + fields_to_bytes(plaintext))
+
+		result = subprocess.run([CLI_PATH, 'prove', MAPPED_PK_PATH, CLI_PROOF_PATH, '--inputs', CLI_INPUTS_PATH])
+		self.assertEqual(result.returncode, 0)
+
+		# Public inputs from stdin, the proof in the binary encoding
+		result = subprocess.run(
+			[CLI_PATH, 'verify', MAPPED_VK_PATH, CLI_PROOF_PATH, '--inputs', '-'],
+			input=public_inputs, stdout=subprocess.PIPE)
+		self.assertEqual(result.returncode, 0)
+		self.assertIn(b'Verification Passed!', result.stdout)
+
+		print('CLI inputs done!')
+
+	def test_lean_proof(self):
+		num_blocks = 8
+
+		wrapper = Contingent(NATIVE_LIB_PATH, num_blocks)
+		self.assertTrue(wrapper.genkeys(MAPPED_PK_PATH, MAPPED_VK_PATH) == 0)
+
+		plaintext = [int(FQ.random()) for n in range(0, num_blocks)]
+		plaintext_root = merkle_root(plaintext)
+		key = int(FQ.random())
+		key_hash = hashlib.sha256(key.to_bytes(32, 'little')).digest()
+		ciphertext = mimc_encrypt(plaintext, key)
+
+		# Compact constraint system, with and without a prepared plaintext
+		wrapper.set_lean_proving(True)
+		try:
+			with wrapper.prover(MAPPED_PK_PATH) as prover:
+				proof = prover.prove(key_hash, ciphertext, plaintext_root, key, plaintext)
+				self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+
+				with prover.prepare(plaintext) as prepared:
+					proof = prepared.prove(key_hash, ciphertext, key)
+				self.assertTrue(wrapper.verify(MAPPED_VK_PATH, proof, key_hash, ciphertext, plaintext_root))
+		finally:
+			wrapper.set_lean_proving(False)
+
+		print('Lean prove done!')
+
 
 if __name__ == "__main__":
 	unittest.main()
@@ -0,0 +1,26 @@
+pragma solidity ^0.5.0;
+
+import "./HashedTimelock.sol";
+import "./MiMC.sol";
+
+/**
+ * @title Hashed Timelock Contracts (HTLCs) on Ethereum ETH, with a MiMC hashlock.
+ *
+ * Same as HashedTimelock, but the hashlock is the MiMC key commitment used
+ * by the contingent circuit built with CONTINGENT_CIRCUIT_MIMC_KEY, so the
+ * key hash proven by the zk-SNARK can be used as the hashlock directly.
+ * The preimage is the key as a big-endian field element.
+ */
+contract HashedTimelockMiMC is HashedTimelock {
+
+    uint256 constant SCALAR_FIELD = 0x30644e72e131a029b85045b68181585d2833e84879b9709143e1f593f0000001;
+
+    modifier hashlockMatches(bytes32 _contractId, bytes32 _x) {
+        require(uint256(_x) < SCALAR_FIELD, "preimage is not a field element");
+        require(
+            contracts[_contractId].hashlock == MiMC.commitKey(uint256(_x)),
+            "hashlock hash does not match"
+        );
+        _;
+    }
+}
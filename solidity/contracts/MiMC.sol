@@ -0,0 +1,53 @@
+pragma solidity ^0.5.0;
+
+/**
+ * @title MiMC-p/p with exponent 7 over the alt_bn128 scalar field.
+ *
+ * Same construction and round constants as the ethsnarks MiMC gadget used
+ * by the contingent circuit: 91 rounds, constants derived by repeatedly
+ * hashing keccak256("mimc"), and the Miyaguchi-Preneel compression for
+ * hashing a list of field elements.
+ */
+library MiMC {
+
+    uint256 constant SCALAR_FIELD = 0x30644e72e131a029b85045b68181585d2833e84879b9709143e1f593f0000001;
+    uint256 constant ROUNDS = 91;
+
+    function encipher(uint256 _x, uint256 _k) internal pure returns (uint256 out_x) {
+        uint256 seed = uint256(keccak256("mimc"));
+        uint256 q = SCALAR_FIELD;
+        uint256 rounds = ROUNDS;
+        assembly {
+            let c := mload(0x40)
+            mstore(0x40, add(c, 32))
+            mstore(c, seed)
+            let t
+            let a
+            for { let i := rounds } gt(i, 0) { i := sub(i, 1) } {
+                mstore(c, keccak256(c, 32))
+                t := addmod(addmod(_x, mload(c), q), _k, q)
+                a := mulmod(t, t, q)
+                _x := mulmod(mulmod(a, mulmod(a, a, q), q), t, q)
+            }
+            out_x := addmod(_x, _k, q)
+        }
+    }
+
+    function hash(uint256[] memory _msgs, uint256 _iv) internal pure returns (uint256) {
+        uint256 r = _iv;
+        for (uint256 i = 0; i < _msgs.length; i++) {
+            r = addmod(addmod(r, _msgs[i], SCALAR_FIELD), encipher(_msgs[i], r), SCALAR_FIELD);
+        }
+        return r;
+    }
+
+    /**
+     * @dev Key commitment checked by the CONTINGENT_CIRCUIT_MIMC_KEY circuit,
+     * mimc_hash([key], 1)
+     */
+    function commitKey(uint256 _key) internal pure returns (bytes32) {
+        uint256[] memory msgs = new uint256[](1);
+        msgs[0] = _key;
+        return bytes32(hash(msgs, 1));
+    }
+}